@@ -11,16 +11,35 @@
 #define NOGDI
 #define NOCRYPT
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <set>
 #include <streambuf>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
@@ -34,11 +53,16 @@
 #pragma warning( disable : 4275 4996 )
 #endif
 #include <json/json.h>
-#include <tinyxml2.h>
 #if defined( WIN32 )
 #pragma warning( pop )
 #endif
 
+#include "sc2build.h"
+#include "sc2combat.h"
+#include "sc2gamedata.h"
+
+namespace db = sc2gamedata;
+
 #if defined( WIN32 )
 #define PATHSEP "\\"
 #else
@@ -60,27 +84,483 @@ using std::vector;
 using StringVector = vector<string>;
 using StringSet = set<string>;
 
-using NameToIDMapping = std::map<string, size_t>;
+// Building with GENERATOR_COUNT_ALLOCATIONS replaces the global operator new to count
+// every heap allocation, so the effect of the arena below can be seen in the "[m]" log
+// lines. It is off by default: the replacement applies to everything linked into the
+// generator and costs an atomic increment per allocation.
+#ifdef GENERATOR_COUNT_ALLOCATIONS
+std::atomic<uint64_t> g_heapAllocations( 0 );
+std::atomic<uint64_t> g_heapBytes( 0 );
+
+void* operator new( size_t size )
+{
+  g_heapAllocations++;
+  g_heapBytes += size;
+  if ( auto ptr = malloc( size ? size : 1 ) )
+    return ptr;
+  throw std::bad_alloc();
+}
+
+#ifdef __GNUC__
+__attribute__( ( noinline ) ) // keeps gcc from pairing the inlined free() with new-expressions
+#endif
+void operator delete( void* ptr ) noexcept
+{
+  free( ptr );
+}
+#endif
+
+// Monotonic allocator for the catalogs. They are built once, written out and thrown
+// away with the process, so an allocation is a bump of the calling thread's cursor and
+// nothing is handed back before exit. Building with GENERATOR_NO_ARENA sends it all to
+// the heap instead, for comparison.
+class Arena
+{
+public:
+  static const size_t blockSize = 256 * 1024;
+
+  Arena():
+      allocations_( 0 ), bytes_( 0 ) {}
+
+  void* allocate( size_t size, size_t align )
+  {
+    allocations_++;
+    bytes_ += size;
+    if ( size > blockSize / 4 )
+      return newBlock( size );
+    auto& cursor = cursor_;
+    size_t offset = ( cursor.used + align - 1 ) & ~( align - 1 );
+    if ( !cursor.block || offset + size > blockSize )
+    {
+      cursor.block = newBlock( blockSize );
+      offset = 0;
+    }
+    cursor.used = offset + size;
+    return cursor.block + offset;
+  }
+
+  uint64_t allocations() const { return allocations_; }
+  uint64_t bytes() const { return bytes_; }
+
+  size_t blocks()
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return blocks_.size();
+  }
+
+private:
+  struct Cursor {
+    char* block;
+    size_t used;
+  };
+
+  char* newBlock( size_t size )
+  {
+    std::unique_ptr<char[]> block( new char[size] );
+    std::lock_guard<std::mutex> lock( mutex_ );
+    blocks_.push_back( std::move( block ) );
+    return blocks_.back().get();
+  }
+
+  static thread_local Cursor cursor_;
+  std::atomic<uint64_t> allocations_;
+  std::atomic<uint64_t> bytes_;
+  std::mutex mutex_;
+  vector<std::unique_ptr<char[]>> blocks_;
+};
+
+thread_local Arena::Cursor Arena::cursor_ = { nullptr, 0 };
+
+Arena g_arena;
+
+template <class T>
+struct ArenaAllocator {
+  using value_type = T;
+
+  ArenaAllocator() {}
+  template <class U>
+  ArenaAllocator( const ArenaAllocator<U>& ) {}
+
+  T* allocate( size_t count )
+  {
+#ifdef GENERATOR_NO_ARENA
+    return static_cast<T*>( ::operator new( count * sizeof( T ) ) );
+#else
+    return static_cast<T*>( g_arena.allocate( count * sizeof( T ), alignof( T ) ) );
+#endif
+  }
+
+  void deallocate( T* ptr, size_t )
+  {
+#ifdef GENERATOR_NO_ARENA
+    ::operator delete( ptr );
+#else
+    (void)ptr;
+#endif
+  }
+};
+
+template <class T, class U>
+bool operator==( const ArenaAllocator<T>&, const ArenaAllocator<U>& )
+{
+  return true;
+}
+
+template <class T, class U>
+bool operator!=( const ArenaAllocator<T>&, const ArenaAllocator<U>& )
+{
+  return false;
+}
+
+template <class T>
+using ArenaVector = vector<T, ArenaAllocator<T>>;
+template <class T, class Less = std::less<T>>
+using ArenaSet = set<T, Less, ArenaAllocator<T>>;
+template <class K, class V, class Less = std::less<K>>
+using ArenaMap = std::map<K, V, Less, ArenaAllocator<std::pair<const K, V>>>;
+
+void reportAllocations( const char* phase )
+{
+#ifdef GENERATOR_COUNT_ALLOCATIONS
+  printf_s( "[m] %s: %llu heap allocations (%llu KB), %llu arena allocations (%llu KB in %llu blocks)\r\n", phase,
+    static_cast<unsigned long long>( g_heapAllocations ), static_cast<unsigned long long>( g_heapBytes / 1024 ),
+    static_cast<unsigned long long>( g_arena.allocations() ), static_cast<unsigned long long>( g_arena.bytes() / 1024 ),
+    static_cast<unsigned long long>( g_arena.blocks() ) );
+#else
+  printf_s( "[m] %s: %llu arena allocations (%llu KB in %llu blocks)\r\n", phase,
+    static_cast<unsigned long long>( g_arena.allocations() ), static_cast<unsigned long long>( g_arena.bytes() / 1024 ),
+    static_cast<unsigned long long>( g_arena.blocks() ) );
+#endif
+}
+
+// Owns the names behind Symbols. Interning takes a lock, since the catalogs are parsed
+// on several threads; name() does not, because a symbol's name is written before the
+// symbol is handed out and never changes afterwards.
+class SymbolTable
+{
+public:
+  SymbolTable():
+      count_( 0 )
+  {
+    intern( "", 0 ); // id 0
+  }
+
+  uint32_t intern( const char* name, size_t length )
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    key_.assign( name, length );
+    auto it = ids_.find( key_ );
+    if ( it != ids_.end() )
+      return it->second;
+    if ( count_ == blockSize * maxBlocks )
+      throw runtime_error( "Too many symbols" );
+    auto id = count_++;
+    it = ids_.emplace( key_, id ).first;
+    auto& block = blocks_[id / blockSize];
+    if ( !block )
+      block.reset( new const string*[blockSize] );
+    block[id % blockSize] = &it->first;
+    return id;
+  }
+
+  // id of name, or 0 if it was never interned
+  uint32_t lookup( const string& name ) const
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    auto it = ids_.find( name );
+    return ( it == ids_.end() ? 0 : it->second );
+  }
+
+  const string& name( uint32_t id ) const
+  {
+    return *blocks_[id / blockSize][id % blockSize];
+  }
+
+private:
+  static const uint32_t blockSize = 4096;
+  static const uint32_t maxBlocks = 4096;
+
+  mutable std::mutex mutex_;
+  string key_; // lookup buffer, reused so that finding an existing name does not allocate
+  std::unordered_map<string, uint32_t> ids_; // nodes never move, so names point into it
+  std::unique_ptr<const string*[]> blocks_[maxBlocks];
+  uint32_t count_;
+};
+
+SymbolTable g_symbols;
+
+// Interned catalog id (unit, ability, effect, requirement, ...). Catalogs and the
+// references between them are keyed by symbols, so lookups hash and compare a 32-bit
+// id instead of a string. Symbols are case-sensitive, as the catalog ids always were
+// here, and compare by id; the default symbol is the empty name. Containers that are
+// written out in order use SymbolNameLess or byName() so the order stays by name.
+class Symbol
+{
+public:
+  Symbol():
+      id_( 0 ) {}
+
+  // interns name; null is the empty symbol
+  explicit Symbol( const char* name ):
+      id_( name ? g_symbols.intern( name, strlen( name ) ) : 0 ) {}
+
+  explicit Symbol( const string& name ):
+      id_( g_symbols.intern( name.data(), name.size() ) ) {}
+
+  // the symbol of name if anything interned it, the empty symbol otherwise
+  static Symbol lookup( const string& name )
+  {
+    Symbol sym;
+    sym.id_ = g_symbols.lookup( name );
+    return sym;
+  }
+
+  uint32_t id() const
+  {
+    return id_;
+  }
+
+  const string& str() const
+  {
+    return g_symbols.name( id_ );
+  }
+
+  const char* c_str() const
+  {
+    return str().c_str();
+  }
+
+  bool empty() const
+  {
+    return id_ == 0;
+  }
+
+  bool operator==( Symbol other ) const
+  {
+    return id_ == other.id_;
+  }
+
+  bool operator!=( Symbol other ) const
+  {
+    return id_ != other.id_;
+  }
+
+private:
+  uint32_t id_;
+};
+
+namespace std {
+  template <>
+  struct hash<Symbol> {
+    size_t operator()( Symbol sym ) const
+    {
+      return sym.id();
+    }
+  };
+}
+
+inline std::ostream& operator<<( std::ostream& out, Symbol sym )
+{
+  return out << sym.str();
+}
+
+struct SymbolNameLess {
+  bool operator()( Symbol a, Symbol b ) const
+  {
+    return a.str() < b.str();
+  }
+};
+
+using SymbolVector = ArenaVector<Symbol>;
+using SymbolSet = ArenaSet<Symbol, SymbolNameLess>;
+
+// Hash map from Symbol to T for the catalogs. The table is open-addressed (linear
+// probing over a power-of-two array of entry indices) and the entries themselves sit
+// in a deque in insertion order, so references to them stay valid as the map grows,
+// just like with the node-based maps the code was written for. There is no erase.
+template <class T>
+class SymbolMap
+{
+public:
+  using value_type = std::pair<const Symbol, T>;
+  using Entries = std::deque<value_type, ArenaAllocator<value_type>>;
+  using iterator = typename Entries::iterator;
+  using const_iterator = typename Entries::const_iterator;
+
+  iterator begin()
+  {
+    return entries_.begin();
+  }
+
+  iterator end()
+  {
+    return entries_.end();
+  }
+
+  const_iterator begin() const
+  {
+    return entries_.begin();
+  }
+
+  const_iterator end() const
+  {
+    return entries_.end();
+  }
+
+  size_t size() const
+  {
+    return entries_.size();
+  }
+
+  bool empty() const
+  {
+    return entries_.empty();
+  }
+
+  void reserve( size_t count )
+  {
+    size_t capacity = 16;
+    while ( capacity * 3 < count * 4 )
+      capacity *= 2;
+    if ( capacity > slots_.size() )
+      rehash( capacity );
+  }
+
+  iterator find( Symbol key )
+  {
+    auto index = indexOf( key );
+    return ( index ? entries_.begin() + ( index - 1 ) : entries_.end() );
+  }
+
+  const_iterator find( Symbol key ) const
+  {
+    auto index = indexOf( key );
+    return ( index ? entries_.begin() + ( index - 1 ) : entries_.end() );
+  }
+
+  size_t count( Symbol key ) const
+  {
+    return ( indexOf( key ) ? 1 : 0 );
+  }
+
+  T& operator[]( Symbol key )
+  {
+    if ( ( entries_.size() + 1 ) * 4 > slots_.size() * 3 )
+      rehash( slots_.empty() ? 16 : slots_.size() * 2 );
+    auto slot = slotOf( key );
+    if ( !slots_[slot] )
+    {
+      entries_.emplace_back( key, T() );
+      slots_[slot] = static_cast<uint32_t>( entries_.size() );
+    }
+    return entries_[slots_[slot] - 1].second;
+  }
+
+private:
+  // the slot holding key, or the empty one it would go into
+  size_t slotOf( Symbol key ) const
+  {
+    size_t mask = slots_.size() - 1;
+    size_t slot = ( key.id() * 2654435769u ) & mask;
+    while ( slots_[slot] && entries_[slots_[slot] - 1].first != key )
+      slot = ( slot + 1 ) & mask;
+    return slot;
+  }
+
+  // 1-based index of key's entry, 0 if it is not in the map
+  uint32_t indexOf( Symbol key ) const
+  {
+    return ( slots_.empty() ? 0 : slots_[slotOf( key )] );
+  }
+
+  void rehash( size_t capacity )
+  {
+    slots_.assign( capacity, 0 );
+    for ( size_t i = 0; i < entries_.size(); i++ )
+      slots_[slotOf( entries_[i].first )] = static_cast<uint32_t>( i + 1 );
+  }
+
+  Entries entries_;
+  vector<uint32_t> slots_; // 1-based indices into entries_, 0 = free
+};
+
+// The entries of a map keyed by Symbol as a flat vector sorted by name, which is the
+// order everything is written out in.
+template <class Map>
+vector<typename Map::value_type*> byName( Map& map )
+{
+  vector<typename Map::value_type*> entries;
+  entries.reserve( map.size() );
+  for ( auto& entry : map )
+    entries.push_back( &entry );
+  std::sort( entries.begin(), entries.end(), []( typename Map::value_type* a, typename Map::value_type* b ) { return a->first.str() < b->first.str(); } );
+  return entries;
+}
+
+// A container that copies share until one of them modifies it. Catalog entries start
+// out as copies of their parent or of the default entry, and most of them never touch
+// the card layouts, grids and sets they inherit, so those are only copied on write().
+template <class T>
+class CopyOnWrite
+{
+public:
+  CopyOnWrite() {}
+  CopyOnWrite( T value ):
+      value_( std::allocate_shared<T>( ArenaAllocator<T>(), std::move( value ) ) ) {}
+
+  const T& get() const { return value_ ? *value_ : blank(); }
+  operator const T&() const { return get(); }
+  typename T::const_iterator begin() const { return get().begin(); }
+  typename T::const_iterator end() const { return get().end(); }
+  size_t size() const { return get().size(); }
+  bool empty() const { return get().empty(); }
+  template <class Index>
+  auto operator[]( Index index ) const -> decltype( std::declval<const T&>()[index] ) { return get()[index]; }
+
+  // detaches this copy from the ones it shares its value with
+  T& write()
+  {
+    if ( !value_ )
+      value_ = std::allocate_shared<T>( ArenaAllocator<T>() );
+    else if ( value_.use_count() > 1 )
+      value_ = std::allocate_shared<T>( ArenaAllocator<T>(), *value_ );
+    return *value_;
+  }
+
+private:
+  static const T& blank()
+  {
+    static const T value;
+    return value;
+  }
+  std::shared_ptr<T> value_;
+};
+
+using NameToIDMapping = SymbolMap<size_t>;
 
 NameToIDMapping g_unitMapping;
 NameToIDMapping g_abilityMapping;
 NameToIDMapping g_upgradeMapping;
 
-using AliasMap = std::map<string, set<string>>;
+// stableid.json the other way round, indexed by id; ids nothing claims are empty symbols
+using IDToNameMapping = vector<Symbol>;
 
-AliasMap g_aliases;
+IDToNameMapping g_unitNames;
+IDToNameMapping g_abilityNames;
+IDToNameMapping g_upgradeNames;
 
-inline StringSet resolveAlias( string alias )
+// the stableid.json id of name, 0 if it has none; unlike operator[] it never inserts, so
+// the outputs can look ids up while they are written concurrently
+inline uint32_t stableID( const NameToIDMapping& mapping, Symbol name )
 {
-  if ( g_aliases.find( alias ) == g_aliases.end() )
-  {
-    StringSet set;
-    set.insert( alias );
-    return set;
-  }
-  return g_aliases[alias];
+  auto it = mapping.find( name );
+  return ( it == mapping.end() ? 0 : static_cast<uint32_t>( it->second ) );
 }
 
+using AliasMap = SymbolMap<SymbolSet>;
+
+AliasMap g_aliases;
+
 enum Race {
   Race_Neutral,
   Race_Terran,
@@ -98,15 +578,23 @@ enum ResourceType {
 
 struct UnitAbilityCard {
   string name;
-  std::map<uint64_t, string> commands;
+  ArenaMap<uint64_t, Symbol> commands; // "Ability,Command"
   bool removed;
   size_t indexCtr;
   UnitAbilityCard():
       removed( false ), indexCtr( 0 ) {}
 };
 
+// The fields of each catalog struct, in the order snapshots store them. A field that
+// is not listed does not survive a snapshot, so add new ones here as well.
+template <class Archive>
+void snapshotFields( Archive& ar, UnitAbilityCard& card )
+{
+  ar( card.name, card.commands, card.removed, card.indexCtr );
+}
+
 struct Unit {
-  string name;
+  Symbol name;
   Race race;
   double lifeStart;
   double lifeMax;
@@ -134,27 +622,27 @@ struct Unit {
   bool campaign;
   // StringSet abilityCommands;
   //std::map<uint64_t, string> abilityCommandsMap;
-  std::map<size_t, UnitAbilityCard> abilityCardsMap;
-  std::map<size_t, size_t> abilityRowCo;
+  CopyOnWrite<ArenaMap<size_t, UnitAbilityCard>> abilityCardsMap;
+  CopyOnWrite<ArenaMap<size_t, size_t>> abilityRowCo;
   string mover;
   double shieldRegenDelay;
   double shieldRegenRate;
-  StringSet weapons;
+  CopyOnWrite<SymbolSet> weapons;
   int64_t scoreMake;
   int64_t scoreKill;
   ResourceType resourceType;
-  set<string> collides;
+  CopyOnWrite<ArenaSet<string>> collides;
   string aiEvaluateAlias;
   double aiEvalFactor;
   double attackTargetPriority;
   double stationaryTurningRate;
   double lateralAcceleration;
-  set<string> planeArray;
+  CopyOnWrite<ArenaSet<string>> planeArray;
   bool invulnerable;
   bool resourceHarvestable; // vs. Raw (geyser without extractor)
-  set<string> techAliases;
+  CopyOnWrite<SymbolSet> techAliases;
   string glossaryAlias;
-  string footprint;
+  Symbol footprint;
   double energyStart;
   double energyMax;
   double energyRegenRate;
@@ -170,6 +658,19 @@ struct Unit {
   }
 };
 
+template <class Archive>
+void snapshotFields( Archive& ar, Unit& unit )
+{
+  ar( unit.name, unit.race, unit.lifeStart, unit.lifeMax, unit.speed, unit.acceleration, unit.food );
+  ar( unit.light, unit.biological, unit.mechanical, unit.armored, unit.structure, unit.psionic, unit.massive );
+  ar( unit.sight, unit.cargoSize, unit.turningRate, unit.shieldsStart, unit.shieldsMax, unit.lifeRegenRate, unit.radius, unit.lifeArmor );
+  ar( unit.speedMultiplierCreep, unit.mineralCost, unit.vespeneCost, unit.campaign, unit.abilityCardsMap, unit.abilityRowCo );
+  ar( unit.mover, unit.shieldRegenDelay, unit.shieldRegenRate, unit.weapons, unit.scoreMake, unit.scoreKill, unit.resourceType );
+  ar( unit.collides, unit.aiEvaluateAlias, unit.aiEvalFactor, unit.attackTargetPriority, unit.stationaryTurningRate, unit.lateralAcceleration );
+  ar( unit.planeArray, unit.invulnerable, unit.resourceHarvestable, unit.techAliases, unit.glossaryAlias, unit.footprint );
+  ar( unit.energyStart, unit.energyMax, unit.energyRegenRate );
+}
+
 struct EffectArrayEntry {
   string operation;
   string referenceType;
@@ -178,8 +679,14 @@ struct EffectArrayEntry {
   string value;
 };
 
+template <class Archive>
+void snapshotFields( Archive& ar, EffectArrayEntry& entry )
+{
+  ar( entry.operation, entry.referenceType, entry.referenceId, entry.referenceAttribute, entry.value );
+}
+
 struct Upgrade {
-  string name;
+  Symbol name;
   Race race;
   vector<EffectArrayEntry> effectArray;
 
@@ -187,7 +694,13 @@ struct Upgrade {
       race( Race_Neutral ) {}
 };
 
-using UpgradeMap = std::map<string, Upgrade>;
+template <class Archive>
+void snapshotFields( Archive& ar, Upgrade& upgrade )
+{
+  ar( upgrade.name, upgrade.race, upgrade.effectArray );
+}
+
+using UpgradeMap = SymbolMap<Upgrade>;
 
 enum AbilType {
   AbilType_Train,
@@ -202,26 +715,32 @@ enum AbilType {
 struct AbilityCommand {
   string index;
   double time;
-  StringVector units;
-  string requirements;
+  SymbolVector units;
+  Symbol requirements;
   bool isUpgrade;
-  string upgrade; // upgrade name
+  Symbol upgrade;
   int64_t mineralCost; // for upgrade
   int64_t vespeneCost; // for upgrade
   AbilityCommand( const string& idx ):
       index( idx ), time( 0.0 ), isUpgrade( false ), mineralCost( 0 ), vespeneCost( 0 ) {}
   AbilityCommand():
-      time( 0.0 ) {}
+      time( 0.0 ), isUpgrade( false ), mineralCost( 0 ), vespeneCost( 0 ) {}
 };
 
-using AbilityCommandMap = std::map<string, AbilityCommand>;
+template <class Archive>
+void snapshotFields( Archive& ar, AbilityCommand& cmd )
+{
+  ar( cmd.index, cmd.time, cmd.units, cmd.requirements, cmd.isUpgrade, cmd.upgrade, cmd.mineralCost, cmd.vespeneCost );
+}
+
+using AbilityCommandMap = ArenaMap<string, AbilityCommand>;
 
 struct Ability {
-  string name;
+  Symbol name;
   AbilType type;
   AbilityCommandMap commands;
-  string morphUnit;
-  string effect;
+  Symbol morphUnit;
+  Symbol effect;
   bool warp;
   bool buildFinishKillsPeon;
   bool buildInterruptible;
@@ -231,9 +750,16 @@ struct Ability {
       type( AbilType_Other ), warp( false ), buildFinishKillsPeon( false ), buildInterruptible( false ), trainFinishKills( false ), trainCancelKills( false ) {}
 };
 
-using AbilityMap = std::map<string, Ability>;
+template <class Archive>
+void snapshotFields( Archive& ar, Ability& ability )
+{
+  ar( ability.name, ability.type, ability.commands, ability.morphUnit, ability.effect );
+  ar( ability.warp, ability.buildFinishKillsPeon, ability.buildInterruptible, ability.trainFinishKills, ability.trainCancelKills );
+}
+
+using AbilityMap = SymbolMap<Ability>;
 
-using UnitMap = std::map<string, Unit>;
+using UnitMap = SymbolMap<Unit>;
 using UnitVector = std::vector<Unit>;
 
 enum FilterAttribute {
@@ -246,7 +772,9 @@ enum FilterAttribute {
   Search_Stasis,
 };
 
-void parseFilters( string full, std::set<FilterAttribute>& requires, std::set<FilterAttribute>& excludez )
+using FilterSet = ArenaSet<FilterAttribute>;
+
+void parseFilters( string full, FilterSet& requires, FilterSet& excludez )
 {
   string excludes;
   auto split = full.find( ";" );
@@ -258,7 +786,7 @@ void parseFilters( string full, std::set<FilterAttribute>& requires, std::set<Fi
   boost::char_separator<char> sep( "," );
   boost::tokenizer<boost::char_separator<char>> requireTokens( full, sep );
   boost::tokenizer<boost::char_separator<char>> excludeTokens( excludes, sep );
-  auto func = []( boost::tokenizer<boost::char_separator<char>>& tokens, std::set<FilterAttribute>& st )
+  auto func = []( boost::tokenizer<boost::char_separator<char>>& tokens, FilterSet& st )
   {
     for ( const auto& tk : tokens )
     {
@@ -294,11 +822,6 @@ inline Race raceToEnum( const char* str )
     return Race_Neutral;
 }
 
-inline bool boolValue( tinyxml2::XMLElement* element )
-{
-  return ( element->IntAttribute( "value" ) > 0 ? true : false );
-}
-
 inline ResourceType resourceToEnum( const char* str )
 {
   if ( _strcmpi( str, "Minerals" ) == 0 )
@@ -318,2301 +841,5657 @@ inline uint64_t encodePoint( uint64_t page, uint64_t index )
   return ( page << 32 ) | ( index );
 };
 
-struct Weapon {
-  string name;
-  double range;
-  double period; // time between attacks
-  string effect; // name of effect
-  double arc;
-  double damagePoint;
-  double backSwing;
-  double rangeSlop;
-  double arcSlop;
-  double minScanRange;
-  double randomDelayMin;
-  double randomDelayMax;
-  bool melee;
-  bool hidden;
-  bool disabled;
-  bool suicide;
-  std::set<FilterAttribute> targetRequire;
-  std::set<FilterAttribute> targetExclude;
-  Weapon():
-      range( 0.0 ), period( 0.0 ), arc( 0.0 ), damagePoint( 0.0 ), backSwing( 0.0 ),
-      rangeSlop( 0.0 ), arcSlop( 0.0 ), minScanRange( 0.0 ), randomDelayMin( 0.0 ), randomDelayMax( 0.0 ),
-      melee( false ), hidden( false ), disabled( false ), suicide( false ) {}
-};
+// One element reported by CatalogReader: its name, nesting depth (0 = <Catalog>,
+// 1 = catalog entry, 2 = entry field, ...) and attributes. The accessors mirror the
+// tinyxml2 ones the parsers were written against. Its attribute values are only valid
+// for the duration of the callback.
+struct CatalogElement {
+  const char* name;
+  size_t depth;
+  size_t tag; // index of the start or end tag in its reader, for replay()
+  vector<std::pair<const char*, const char*>> attributes;
 
-using WeaponMap = std::map<string, Weapon>;
-
-void parseWeaponData( const string& filename, WeaponMap& weapons, Weapon& defaultWeapon )
-{
-  tinyxml2::XMLDocument doc;
-  if ( doc.LoadFile( filename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( "Could not load XML file " + filename );
-
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement();
-  while ( entry )
-  {
-    bool isDefault = ( entry->Attribute( "default" ) && entry->Int64Attribute( "default" ) == 1 && !entry->Attribute( "id" ) );
-    auto id = entry->Attribute( "id" );
-    if ( id || isDefault )
-    {
-      if ( !isDefault && weapons.find( id ) == weapons.end() )
-        weapons[id] = defaultWeapon;
-
-      Weapon& wpn = ( isDefault ? defaultWeapon : weapons[id] );
-      if ( !isDefault )
-      {
-        wpn.name = id;
-        printf_s( "[+] weapon: %s\r\n", wpn.name.c_str() );
-      }
-
-      auto field = entry->FirstChildElement();
-      while ( field )
-      {
-        if ( _strcmpi( field->Name(), "Range" ) == 0 )
-          wpn.range = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "Period" ) == 0 )
-          wpn.period = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "Arc" ) == 0 )
-          wpn.arc = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "DamagePoint" ) == 0 )
-          wpn.damagePoint = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "BackSwing" ) == 0 )
-          wpn.backSwing = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "RangeSlop" ) == 0 )
-          wpn.rangeSlop = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "ArcSlop" ) == 0 )
-          wpn.arcSlop = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "MinScanRange" ) == 0 )
-          wpn.minScanRange = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "RandomDelayMin" ) == 0 )
-          wpn.randomDelayMin = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "RandomDelayMax" ) == 0 )
-          wpn.randomDelayMax = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "TargetFilters" ) == 0 && field->Attribute( "value" ) )
-        {
-          string full = field->Attribute( "value" );
-          parseFilters( full, wpn.targetRequire, wpn.targetExclude );
-        }
-        else if ( _strcmpi( field->Name(), "Options" ) == 0 )
-        {
-          if ( field->Attribute( "index" ) && field->Attribute( "value" ) )
-          {
-            if ( _stricmp( field->Attribute( "index" ), "Melee" ) == 0 )
-              wpn.melee = boolValue( field );
-            else if ( _stricmp( field->Attribute( "index" ), "Hidden" ) == 0 )
-              wpn.hidden = boolValue( field );
-            else if ( _stricmp( field->Attribute( "index" ), "Disabled" ) == 0 )
-              wpn.disabled = boolValue( field );
-          }
-        }
-        else if ( _strcmpi( field->Name(), "Effect" ) == 0 && field->Attribute( "value" ) )
-          wpn.effect = field->Attribute( "value" );
-        field = field->NextSiblingElement();
-      }
-    }
-    entry = entry->NextSiblingElement();
+  CatalogElement():
+      name( "" ), depth( 0 ), tag( 0 ) {}
+
+  const char* Name() const
+  {
+    return name;
   }
-}
 
-struct EffectBonus {
-  double value;
-};
+  size_t Depth() const
+  {
+    return depth;
+  }
 
-struct EffectSplash {
-  double radius;
-  double fraction;
-  string enumAreaEffect;
-};
+  const char* Attribute( const char* attribute ) const
+  {
+    for ( auto& attr : attributes )
+      if ( strcmp( attr.first, attribute ) == 0 )
+        return attr.second;
+    return nullptr;
+  }
 
-struct Effect {
-  enum Type {
-    Effect_Missile,
-    Effect_Damage,
-    Effect_CreateUnit,
-    Effect_CreateHealer,
-    Effect_Set,
-    // Effect_Suicide, this is figured out for json export in resolveEffect()
-    Effect_Persistent, // like lurker's spike
-    Effect_EnumArea,
-    Effect_Other,
-  } type;
-  enum ImpactLocation {
-    Impact_Undefined,
-    Impact_SourceUnit,
-    Impact_TargetPoint,
-    Impact_TargetUnitOrPoint,
-    Impact_TargetUnit,
-    Impact_CasterUnit,
-    Impact_CasterPoint,
-  };
-  string name;
-  string impactEffect; // for missile
-  std::map<string, EffectBonus> attributeBonuses;
-  std::map<size_t, EffectSplash> splashArea;
-  double damageAmount;
-  double damageArmorReduction;
-  string damageKind;
-  ImpactLocation impactLocation;
-  bool flagKill;
-  std::map<size_t, string> setSubEffects;
-  std::set<FilterAttribute> searchRequires;
-  std::set<FilterAttribute> searchExcludes;
-  std::set<string> persistentEffects;
-  std::vector<double> persistentPeriods;
-  size_t periodCount;
-  Effect():
-      damageAmount( 0.0 ), damageArmorReduction( 0.0 ), impactLocation( Impact_Undefined ), flagKill( false ), periodCount( 0 ) {}
-};
+  int64_t Int64Attribute( const char* attribute, int64_t defaultValue = 0 ) const
+  {
+    auto value = Attribute( attribute );
+    if ( !value )
+      return defaultValue;
+    char* end;
+    auto result = strtoll( value, &end, 10 );
+    return ( end == value ? defaultValue : result );
+  }
 
-using EffectMap = std::map<string, Effect>;
+  int IntAttribute( const char* attribute, int defaultValue = 0 ) const
+  {
+    return static_cast<int>( Int64Attribute( attribute, defaultValue ) );
+  }
 
-void parseEffectData( const string& filename, EffectMap& effects, size_t& notFoundCount )
-{
-  notFoundCount = 0;
+  unsigned UnsignedAttribute( const char* attribute, unsigned defaultValue = 0 ) const
+  {
+    auto value = Attribute( attribute );
+    if ( !value )
+      return defaultValue;
+    char* end;
+    auto result = strtoul( value, &end, 10 );
+    return ( end == value ? defaultValue : static_cast<unsigned>( result ) );
+  }
 
-  string effstr;
+  double DoubleAttribute( const char* attribute, double defaultValue = 0.0 ) const
+  {
+    auto value = Attribute( attribute );
+    if ( !value )
+      return defaultValue;
+    char* end;
+    auto result = strtod( value, &end );
+    return ( end == value ? defaultValue : result );
+  }
+};
 
-  ifstream in;
-  in.open( filename, std::ifstream::in );
-  if ( !in.is_open() )
-    throw runtime_error( string( "Could not load XML file " ) + filename );
-  in.seekg( 0, std::ios::end );
-  effstr.reserve( in.tellg() );
-  in.seekg( 0, std::ios::beg );
-  effstr.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
-  in.close();
+struct CatalogHandler {
+  virtual ~CatalogHandler() {}
+  virtual void elementStart( const CatalogElement& element ) = 0;
+  virtual void elementEnd( const CatalogElement& element )
+  {
+    (void)element;
+  }
+};
 
-  boost::replace_all( effstr, R"(<?token id="abil" type="CAbilLink"?>)", "" );
-  boost::replace_all( effstr, R"(<?token id="abil"?>)", "" );
-  boost::replace_all( effstr, R"(<?token id="n" type="uint32"?>)", "" );
-  boost::replace_all( effstr, R"(<?token id="nNext" type="uint32"?>)", "" );
+// Read-only view of a whole file. The file is mapped into memory instead of being
+// copied into a buffer, so the parsers scan the page cache directly.
+class MappedFile
+{
+public:
+  explicit MappedFile( const string& filename ):
+      data_( nullptr ), size_( 0 )
+  {
+#if defined( WIN32 )
+    mapping_ = NULL;
+    file_ = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    LARGE_INTEGER size;
+    if ( file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx( file_, &size ) )
+    {
+      close();
+      throw runtime_error( "Could not load XML file " + filename );
+    }
+    size_ = static_cast<size_t>( size.QuadPart );
+    if ( size_ == 0 )
+      return;
+    mapping_ = CreateFileMappingA( file_, NULL, PAGE_READONLY, 0, 0, NULL );
+    if ( mapping_ )
+      data_ = static_cast<const char*>( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+    fd_ = open( filename.c_str(), O_RDONLY );
+    struct stat st;
+    if ( fd_ < 0 || fstat( fd_, &st ) != 0 )
+    {
+      close();
+      throw runtime_error( "Could not load XML file " + filename );
+    }
+    size_ = static_cast<size_t>( st.st_size );
+    if ( size_ == 0 )
+      return;
+    void* mapped = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+    if ( mapped != MAP_FAILED )
+    {
+      data_ = static_cast<const char*>( mapped );
+      madvise( mapped, size_, MADV_SEQUENTIAL );
+    }
+#endif
+    if ( !data_ )
+    {
+      close();
+      throw runtime_error( "Could not map XML file " + filename );
+    }
+  }
 
-  tinyxml2::XMLDocument doc;
-  auto ret = doc.Parse( effstr.c_str() );
-  if ( ret != tinyxml2::XML_SUCCESS )
+  ~MappedFile()
   {
-    doc.PrintError();
-    throw runtime_error( "Could not parse XML file" );
+    close();
   }
 
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement();
-  while ( entry )
+  const char* data() const
   {
-    auto id = entry->Attribute( "id" );
-    if ( id )
-    {
-      if ( entry->Attribute( "parent" ) && strlen( entry->Attribute( "parent" ) ) > 0 )
-      {
-        string parentId = entry->Attribute( "parent" );
-        if ( effects.find( parentId ) == effects.end() )
-        {
-          notFoundCount++;
-          entry = entry->NextSiblingElement();
-          continue;
-        }
-        else if ( effects.find( id ) == effects.end() )
-        {
-          const Effect& parent = effects[parentId];
-          effects[id] = parent;
-        }
-      }
+    return data_;
+  }
 
-      Effect& effect = effects[id];
-      effect.name = id;
-
-      printf_s( "[+] effect: %s\r\n", effect.name.c_str() );
-
-      if ( _stricmp( entry->Name(), "CEffectDamage" ) == 0 )
-        effect.type = Effect::Effect_Damage;
-      else if ( _stricmp( entry->Name(), "CEffectLaunchMissile" ) == 0 )
-        effect.type = Effect::Effect_Missile;
-      else if ( _stricmp( entry->Name(), "CEffectCreateUnit" ) == 0 )
-        effect.type = Effect::Effect_CreateUnit;
-      else if ( _stricmp( entry->Name(), "CEffectCreateHealer" ) == 0 )
-        effect.type = Effect::Effect_CreateHealer;
-      else if ( _stricmp( entry->Name(), "CEffectSet" ) == 0 )
-        effect.type = Effect::Effect_Set;
-      else if ( _stricmp( entry->Name(), "CEffectCreatePersistent" ) == 0 )
-        effect.type = Effect::Effect_Persistent;
-      else if ( _stricmp( entry->Name(), "CEffectEnumArea" ) == 0 )
-        effect.type = Effect::Effect_EnumArea;
-      else
-        effect.type = Effect::Effect_Other;
-
-      size_t areaArrayCtr = 0;
-      size_t fxArrayCtr = 0;
-      auto field = entry->FirstChildElement();
-      while ( field )
-      {
-        if ( _strcmpi( field->Name(), "ArmorReduction" ) == 0 )
-          effect.damageArmorReduction = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "Amount" ) == 0 )
-          effect.damageAmount = field->DoubleAttribute( "value" );
-        else if ( _strcmpi( field->Name(), "ImpactEffect" ) == 0 )
-          effect.impactEffect = field->Attribute( "value" );
-        else if ( _strcmpi( field->Name(), "Kind" ) == 0 )
-          effect.damageKind = field->Attribute( "value" );
-        else if ( _strcmpi( field->Name(), "Flags" ) == 0 && field->Attribute( "index" ) && field->Attribute( "value" ) )
-        {
-          if ( boost::iequals( field->Attribute( "index" ), "Kill" ) )
-            effect.flagKill = field->IntAttribute( "value" ) > 0;
-        }
-        else if ( _strcmpi( field->Name(), "ImpactLocation" ) == 0 && field->Attribute( "Value" ) )
-        {
-          if ( boost::iequals( field->Attribute( "Value" ), "SourceUnit" ) )
-            effect.impactLocation = Effect::Impact_SourceUnit;
-          else if ( boost::iequals( field->Attribute( "Value" ), "TargetPoint" ) )
-            effect.impactLocation = Effect::Impact_TargetPoint;
-          else if ( boost::iequals( field->Attribute( "Value" ), "TargetUnitOrPoint" ) )
-            effect.impactLocation = Effect::Impact_TargetUnitOrPoint;
-          else if ( boost::iequals( field->Attribute( "Value" ), "TargetUnit" ) )
-            effect.impactLocation = Effect::Impact_TargetUnit;
-          else if ( boost::iequals( field->Attribute( "Value" ), "CasterPoint" ) )
-            effect.impactLocation = Effect::Impact_CasterPoint;
-          else if ( boost::iequals( field->Attribute( "Value" ), "CasterUnit" ) )
-            effect.impactLocation = Effect::Impact_CasterUnit;
-        }
-        else if ( _strcmpi( field->Name(), "SearchFilters" ) == 0 && field->Attribute( "value" ) )
-        {
-          string full = field->Attribute( "value" );
-          parseFilters( full, effect.searchRequires, effect.searchExcludes );
-        }
-        else if ( _strcmpi( field->Name(), "AreaArray" ) == 0 )
-        {
-          areaArrayCtr = ( field->Attribute( "index" ) ? field->UnsignedAttribute( "index" ) : areaArrayCtr );
-          auto& area = effect.splashArea[areaArrayCtr];
-          if ( field->Attribute( "Radius" ) )
-            area.radius = field->DoubleAttribute( "Radius" );
-          if ( field->Attribute( "Fraction" ) )
-            area.fraction = field->DoubleAttribute( "Fraction" );
-          if ( field->Attribute( "Effect" ) )
-            area.enumAreaEffect = field->Attribute( "Effect" );
-          areaArrayCtr++;
-        }
-        // Array of effects, usually one, that will run after each period.
-        else if ( boost::iequals( field->Name(), "PeriodicEffectArray" ) && field->Attribute( "value" ) )
-        {
-          effect.persistentEffects.insert( field->Attribute( "value" ) );
-        }
-        // Array of waiting periods between each effect of this periodic set. If less than PeriodCount, loops around.
-        else if ( boost::iequals( field->Name(), "PeriodicPeriodArray" ) && field->Attribute( "value" ) )
-        {
-          effect.persistentPeriods.push_back( field->DoubleAttribute( "value" ) );
-        }
-        // Count of periods this effect lasts. If not specified, using the size of PeriodicPeriodArray (?)
-        else if ( boost::iequals( field->Name(), "PeriodCount" ) && field->Attribute( "value" ) )
-        {
-          effect.periodCount = field->UnsignedAttribute( "value" );
-        }
-        else if ( _strcmpi( field->Name(), "AttributeBonus" ) == 0 && field->Attribute( "index" ) )
-        {
-          if ( field->Attribute( "value" ) )
-            effect.attributeBonuses[field->Attribute( "index" )].value = field->DoubleAttribute( "value" );
-        }
-        else if ( _strcmpi( field->Name(), "EffectArray" ) == 0 )
-        {
-          fxArrayCtr = ( field->Attribute( "index" ) ? field->UnsignedAttribute( "index" ) : fxArrayCtr );
-          if ( field->Attribute( "value" ) )
-            effect.setSubEffects[fxArrayCtr] = field->Attribute( "value" );
-          fxArrayCtr++;
-        }
-        field = field->NextSiblingElement();
-      }
-    }
-    entry = entry->NextSiblingElement();
+  size_t size() const
+  {
+    return size_;
   }
-}
 
-inline size_t encodeRowCol( int row, int col )
-{
-  return ( ( (size_t)row * 100 ) + (size_t)col );
-}
+private:
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
 
-void parseUnitData( const string& filename, UnitMap& units, Unit& defaultUnit, size_t& notFoundCount )
-{
-  notFoundCount = 0;
+  void close()
+  {
+#if defined( WIN32 )
+    if ( data_ )
+      UnmapViewOfFile( data_ );
+    if ( mapping_ )
+      CloseHandle( mapping_ );
+    if ( file_ != INVALID_HANDLE_VALUE )
+      CloseHandle( file_ );
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if ( data_ )
+      munmap( const_cast<char*>( data_ ), size_ );
+    if ( fd_ >= 0 )
+      ::close( fd_ );
+    fd_ = -1;
+#endif
+    data_ = nullptr;
+  }
 
-  tinyxml2::XMLDocument doc;
-  if ( doc.LoadFile( filename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( string( "Could not load XML file " ) + filename );
+#if defined( WIN32 )
+  HANDLE file_;
+  HANDLE mapping_;
+#else
+  int fd_;
+#endif
+  const char* data_;
+  size_t size_;
+};
 
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement( "CUnit" );
-  while ( entry )
+// Reader for the XML subset used by the GameData catalogs: elements and attributes.
+// Processing instructions (including the <?token ...?> ones inside effect and ability
+// entries), comments, CDATA and text are skipped in place, so the mapped file is never
+// copied or rewritten. The constructor scans the whole file once into a flat list of
+// start and end tags; a tag keeps its element and attribute names as ids into a table
+// of the names seen in the file, and its attribute values as offsets into the mapping.
+// read() and replay() then report those tags to a CatalogHandler, decoding a tag's
+// values only for the duration of its callback. All the scanning happens in the
+// constructor, so a reader can be loaded on another thread while an earlier one is
+// being read.
+class CatalogReader
+{
+public:
+  explicit CatalogReader( const string& filename ):
+      filename_( filename ), file_( filename ), data_( file_.data() ), size_( file_.size() )
   {
-    bool isDefault = ( entry->Attribute( "default" ) && entry->Int64Attribute( "default" ) == 1 && !entry->Attribute( "id" ) );
-    auto id = entry->Attribute( "id" );
-    if ( id || isDefault )
-    {
-      if ( entry->Attribute( "parent" ) && strlen( entry->Attribute( "parent" ) ) > 0 )
-      {
-        string parentId = entry->Attribute( "parent" );
-        if ( units.find( parentId ) == units.end() )
-        {
-          printf( "Skipping unit %s because it has a parent that has not been parsed yet\r\n", id );
-          notFoundCount++;
-          entry = entry->NextSiblingElement( "CUnit" );
-          continue;
-        }
-        else if ( units.find( id ) == units.end() )
-        {
-          // copy base data from parent before parsing this descendant
-          // if it does not exist yet
-          printf( "Copying unit %s from parent %s because it does not exist yet\r\n", id, parentId.c_str() );
-          const Unit& parent = units[parentId];
-          units[id] = parent;
-        }
-      }
+    printf_s( "[r] %s: %llu bytes\r\n", filename_.c_str(), static_cast<unsigned long long>( size_ ) );
+    scan();
+  }
 
-      if ( !isDefault && units.find( id ) == units.end() )
-        units[id] = defaultUnit;
-
-      Unit& unit = ( isDefault ? defaultUnit : units[id] );
-
-      if ( !isDefault )
-      {
-        unit.name = id;
-        printf_s( "[+] unit: %s\r\n", unit.name.c_str() );
-      }
-
-      size_t cardctr = 0; // index of current CardLayouts subitem
-      auto field = entry->FirstChildElement();
-      while ( field )
-      {
-        if ( _strcmpi( field->Name(), "Race" ) == 0 )
-          unit.race = raceToEnum( field->Attribute( "value" ) );
-        else if ( _stricmp( field->Name(), "LifeStart" ) == 0 )
-          unit.lifeStart = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "LifeMax" ) == 0 )
-          unit.lifeMax = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Speed" ) == 0 )
-          unit.speed = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Acceleration" ) == 0 )
-          unit.acceleration = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Food" ) == 0 )
-          unit.food = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Sight" ) == 0 )
-          unit.sight = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "ScoreMake" ) == 0 )
-          unit.scoreMake = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "ScoreKill" ) == 0 )
-          unit.scoreKill = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "AIEvaluateAlias" ) == 0 )
-          unit.aiEvaluateAlias = field->Attribute( "value" );
-        else if ( _stricmp( field->Name(), "AttackTargetPriority" ) == 0 )
-          unit.attackTargetPriority = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "StationaryTurningRate" ) == 0 )
-          unit.stationaryTurningRate = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "LateralAcceleration" ) == 0 )
-          unit.lateralAcceleration = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "AIEvalFactor" ) == 0 )
-          unit.aiEvalFactor = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Attributes" ) == 0 )
-        {
-          if ( _stricmp( field->Attribute( "index" ), "Light" ) == 0 )
-            unit.light = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Biological" ) == 0 )
-            unit.biological = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Mechanical" ) == 0 )
-            unit.mechanical = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Armored" ) == 0 )
-            unit.armored = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Structure" ) == 0 )
-            unit.structure = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Psionic" ) == 0 )
-            unit.psionic = boolValue( field );
-          else if ( _stricmp( field->Attribute( "index" ), "Massive" ) == 0 )
-            unit.massive = boolValue( field );
-        }
-        else if ( _stricmp( field->Name(), "ResourceType" ) == 0 )
-          unit.resourceType = resourceToEnum( field->Attribute( "value" ) );
-        else if ( _stricmp( field->Name(), "ResourceState" ) == 0 && field->Attribute( "value" ) )
-          unit.resourceHarvestable = ( _stricmp( field->Attribute( "value" ), "Harvestable" ) == 0 );
-        else if ( _stricmp( field->Name(), "CargoSize" ) == 0 )
-          unit.cargoSize = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "ShieldsStart" ) == 0 )
-          unit.shieldsStart = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "ShieldsMax" ) == 0 )
-          unit.shieldsMax = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "TurningRate" ) == 0 )
-          unit.turningRate = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "LifeRegenRate" ) == 0 )
-          unit.lifeRegenRate = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "EnergyStart" ) == 0 )
-          unit.energyStart = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "EnergyMax" ) == 0 )
-          unit.energyMax = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "EnergyRegenRate" ) == 0 )
-          unit.energyRegenRate = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "Radius" ) == 0 )
-          unit.radius = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "LifeArmor" ) == 0 )
-          unit.lifeArmor = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "SpeedMultiplierCreep" ) == 0 )
-          unit.speedMultiplierCreep = field->DoubleAttribute( "value" );
-        else if ( _stricmp( field->Name(), "CostResource" ) == 0 )
-        {
-          if ( _stricmp( field->Attribute( "index" ), "Minerals" ) == 0 )
-            unit.mineralCost = field->Int64Attribute( "value" );
-          else if ( _stricmp( field->Attribute( "index" ), "Vespene" ) == 0 )
-            unit.vespeneCost = field->Int64Attribute( "value" );
-        }
-        else if ( _stricmp( field->Name(), "CardLayouts" ) == 0 )
-        {
-          size_t cardidx = ( field->Attribute( "index" ) ? field->UnsignedAttribute( "index" ) : cardctr );
-          auto& card = unit.abilityCardsMap[cardidx];
-          if ( field->Attribute( "CardId" ) )
-            card.name = field->Attribute( "CardId" );
-          if ( field->Attribute( "removed" ) && field->Int64Attribute( "removed" ) > 0 )
-            card.removed = true;
-          else
-            card.removed = false;
-          auto sub = field->FirstChildElement( "LayoutButtons" );
-          size_t ctr = card.indexCtr; // ctr = 0;
-          while ( sub )
-          {
-            /*if ( boost::iequals( unit.name, "Baneling" ) && sub->Attribute( "AbilCmd" ) && _stricmp(  sub->Attribute("AbilCmd"), "BurrowBanelingDown,Execute" ) == 0 )
-            {
-              char asd[512];
-              sprintf_s( asd, 512, "Baneling ability: %s\r\n", sub->Attribute( "AbilCmd" ) );
-              OutputDebugStringA( asd );
-              printf( asd );
-            }*/
-            int64_t originalCtr = ctr;
-            bool overriding = sub->Attribute( "index" ) ? true : false;
-            if ( overriding )
-            {
-              ctr = sub->Int64Attribute( "index" );
-              auto itr = unit.abilityRowCo.begin();
-              while ( itr != unit.abilityRowCo.end() )
-              {
-                if ( ( *itr ).second == ctr )
-                  itr = unit.abilityRowCo.erase( itr );
-                else
-                  itr++;
-              }
-            }
-            if ( ( sub->Attribute( "removed" ) && sub->Int64Attribute( "removed" ) > 0 ) || ( sub->Attribute( "Type" ) && _stricmp( sub->Attribute( "Type" ), "Undefined" ) == 0 ) )
-              card.commands.erase( ctr );
-            else if ( sub->Attribute( "AbilCmd" ) )
-            {
-              card.commands[ctr] = sub->Attribute( "AbilCmd" );
-              if ( sub->Attribute( "Row" ) && sub->Attribute( "Column" ) )
-              {
-                auto row = sub->IntAttribute( "Row" );
-                auto col = sub->IntAttribute( "Column" );
-                unit.abilityRowCo[encodeRowCol( row, col )] = ctr;
-              }
-            }
+  const string& filename() const
+  {
+    return filename_;
+  }
 
-            sub = sub->NextSiblingElement( "LayoutButtons" );
-            ctr = ( overriding ? originalCtr : ctr + 1 );
-          }
-          card.indexCtr = ctr;
-          cardctr++;
-        }
-        else if ( _strcmpi( field->Name(), "TechAliasArray" ) == 0 && field->Attribute( "value" ) )
-        {
-          g_aliases[field->Attribute( "value" )].insert( unit.name );
-          unit.techAliases.insert( field->Attribute( "value" ) );
-        }
-        else if ( _stricmp( field->Name(), "Mover" ) == 0 && field->Attribute( "value" ) )
-          unit.mover = field->Attribute( "value" );
-        else if ( _stricmp( field->Name(), "GlossaryAlias" ) == 0 && field->Attribute( "value" ) )
-          unit.glossaryAlias = field->Attribute( "value" );
-        else if ( _stricmp( field->Name(), "ShieldRegenDelay" ) == 0 && field->Attribute( "value" ) )
-          unit.shieldRegenDelay = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "ShieldRegenRate" ) == 0 && field->Attribute( "value" ) )
-          unit.shieldRegenRate = field->Int64Attribute( "value" );
-        else if ( _stricmp( field->Name(), "WeaponArray" ) == 0 && field->Attribute( "Link" ) )
-          unit.weapons.insert( field->Attribute( "Link" ) );
-        else if ( _strcmpi( field->Name(), "FlagArray" ) == 0 && field->Attribute( "index" ) && field->Attribute( "value" ) )
-        {
-          if ( _stricmp( field->Attribute( "index" ), "Invulnerable" ) == 0 )
-            unit.invulnerable = ( field->IntAttribute( "value" ) > 0 ? true : false );
-        }
-        else if ( _stricmp( field->Name(), "Footprint" ) == 0 && field->Attribute( "value" ) )
-          unit.footprint = field->Attribute( "value" );
-        else if ( _stricmp( field->Name(), "EditorCategories" ) == 0 && field->Attribute( "value" ) )
-        {
-          string editorCategories = field->Attribute( "value" );
-          if ( editorCategories.find( "ObjectFamily:Campaign" ) != string::npos )
-            unit.campaign = true;
-        }
-        else if ( _strcmpi( field->Name(), "PlaneArray" ) == 0 && field->Attribute( "index" ) )
-        {
-          if ( field->Attribute( "value" ) && field->IntAttribute( "value" ) > 0 )
-            unit.planeArray.insert( field->Attribute( "index" ) );
-          else if ( field->Attribute( "removed" ) || ( field->Attribute( "value" ) && field->IntAttribute( "value" ) < 1 ) )
-            unit.planeArray.erase( field->Attribute( "index" ) );
-        }
-        else if ( _strcmpi( field->Name(), "Collide" ) == 0 && field->Attribute( "index" ) )
-        {
-          if ( field->Attribute( "value" ) && field->IntAttribute( "value" ) > 0 )
-            unit.collides.insert( field->Attribute( "index" ) );
-          else if ( field->Attribute( "removed" ) || ( field->Attribute( "value" ) && field->IntAttribute( "value" ) < 1 ) )
-            unit.collides.erase( field->Attribute( "index" ) );
-        }
-        /*else if ( _stricmp( field->Name(), "AbilArray" ) == 0 && field->Attribute( "Link" ) )
-          unit.abilities.insert( field->Attribute( "Link" ) );*/
+  size_t size() const
+  {
+    return size_;
+  }
 
-        field = field->NextSiblingElement();
-      }
-      /*if ( boost::iequals( unit.name, "Baneling" ) )
-      {
-        DebugBreak();
-      }*/
-    }
-    entry = entry->NextSiblingElement( "CUnit" );
+  // reads the whole file, which has to consist of a single <Catalog> element
+  void read( CatalogHandler& handler ) const
+  {
+    dispatch( 0, tags_.size(), handler );
   }
-}
 
-struct Requirement {
-  string id;
-  string useNodeName;
-  string showNodeName;
-  Requirement( const string& id_ = "" ):
-      id( id_ ) {}
-};
+  // reads one catalog entry again, given the tags reported for its start and end
+  void replay( size_t begin, size_t end, CatalogHandler& handler ) const
+  {
+    dispatch( begin, end + 1, handler );
+  }
 
-using RequirementMap = std::map<string, Requirement>;
+private:
+  struct Tag {
+    uint32_t firstAttribute; // into attributes_
+    uint16_t attributeCount;
+    uint16_t name; // into names_
+    uint16_t depth;
+    bool end;
+  };
 
-enum RequirementNodeType {
-  ReqNode_Unknown,
-  ReqNode_CountUpgrade,
-  ReqNode_CountUnit,
-  ReqNode_LogicAnd,
-  ReqNode_LogicOr,
-  ReqNode_LogicEq,
-  ReqNode_LogicNot,
-};
+  struct TagAttribute {
+    uint32_t valueBegin; // the value, still quoted and encoded, in the mapping
+    uint32_t valueEnd;
+    uint16_t name; // into names_
+    bool entities; // whether the value has to be decoded
+  };
 
-inline RequirementNodeType reqNodeTypeToEnum( const char* str )
-{
-  if ( _strcmpi( str, "CRequirementCountUpgrade" ) == 0 )
-    return ReqNode_CountUpgrade;
-  else if ( _strcmpi( str, "CRequirementCountUnit" ) == 0 )
-    return ReqNode_CountUnit;
-  else if ( _strcmpi( str, "CRequirementAnd" ) == 0 )
-    return ReqNode_LogicAnd;
-  else if ( _strcmpi( str, "CRequirementOr" ) == 0 )
-    return ReqNode_LogicOr;
-  else if ( _strcmpi( str, "CRequirementEq" ) == 0 )
-    return ReqNode_LogicEq;
-  else if ( _strcmpi( str, "CRequirementNot" ) == 0 )
-    return ReqNode_LogicNot;
-  else
-    return ReqNode_Unknown;
-}
+  string filename_;
+  MappedFile file_;
+  const char* data_;
+  size_t size_;
+  vector<string> names_;
+  vector<Tag> tags_;
+  vector<TagAttribute> attributes_;
 
-struct RequirementNode {
-  string id;
-  RequirementNodeType type;
-  string countLink; // countUpgrade, countUnit
-  string countState; // countUpgrade, countUnit
-  std::map<size_t, string> operands; // and, or, eq, not
-  RequirementNode( const string& id_ = "" ):
-      id( id_ ), type( ReqNode_Unknown ) {}
-};
+  [[noreturn]] void fail( size_t pos, const string& what ) const
+  {
+    auto line = 1 + std::count( data_, data_ + std::min( pos, size_ ), '\n' );
+    throw runtime_error( "Could not parse XML file " + filename_ + " (line " + std::to_string( line ) + "): " + what );
+  }
 
-using RequirementNodeMap = std::map<string, RequirementNode>;
+  bool startsWith( size_t pos, size_t end, const char* literal ) const
+  {
+    auto len = strlen( literal );
+    return ( end - pos >= len && memcmp( data_ + pos, literal, len ) == 0 );
+  }
 
-void parseRequirementData( const string& datafilename, const string& nodedatafilename, RequirementMap& requirements, RequirementNodeMap& nodes )
-{
-  tinyxml2::XMLDocument datadoc;
-  if ( datadoc.LoadFile( datafilename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( "Could not load RequirementData XML file" );
+  // position of c in [pos, end), or end
+  size_t find( char c, size_t pos, size_t end ) const
+  {
+    auto found = static_cast<const char*>( memchr( data_ + pos, c, end - pos ) );
+    return ( found ? found - data_ : end );
+  }
 
-  tinyxml2::XMLDocument nodedatadoc;
-  if ( nodedatadoc.LoadFile( nodedatafilename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( "Could not load RequirementNodeData XML file" );
+  size_t skipPast( size_t pos, size_t end, const char* terminator ) const
+  {
+    auto len = strlen( terminator );
+    auto it = std::search( data_ + pos, data_ + end, terminator, terminator + len );
+    if ( it == data_ + end )
+      fail( pos, string( "missing " ) + terminator );
+    return ( it - data_ ) + len;
+  }
 
-  // RequirementData.xml
-  auto catalog = datadoc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement( "CRequirement" );
-  while ( entry )
+  static bool isSpace( char c )
+  {
+    return ( c == ' ' || c == '\t' || c == '\r' || c == '\n' );
+  }
+
+  static bool isNameEnd( char c )
+  {
+    return ( isSpace( c ) || c == '/' || c == '>' || c == '=' );
+  }
+
+  static void appendUtf8( string& out, unsigned long cp )
   {
-    auto id = entry->Attribute( "id" );
-    if ( id )
+    if ( cp < 0x80 )
+      out += static_cast<char>( cp );
+    else if ( cp < 0x800 )
+    {
+      out += static_cast<char>( 0xC0 | ( cp >> 6 ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
+    }
+    else if ( cp < 0x10000 )
     {
-      if ( requirements.find( id ) == requirements.end() )
-        requirements[id] = Requirement( id );
+      out += static_cast<char>( 0xE0 | ( cp >> 12 ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
+    }
+    else
+    {
+      out += static_cast<char>( 0xF0 | ( cp >> 18 ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
+    }
+  }
 
-      Requirement& requirement = requirements[id];
-      auto child = entry->FirstChildElement();
-      while ( child )
+  // appends an attribute value with entities decoded; unknown entities are kept as they are
+  void appendValue( string& out, size_t begin, size_t end ) const
+  {
+    for ( size_t i = begin; i < end; i++ )
+    {
+      if ( data_[i] != '&' )
       {
-        if ( _stricmp( child->Name(), "NodeArray" ) == 0 && child->Attribute( "index" ) && child->Attribute( "Link" ) )
-        {
-          if ( _stricmp( child->Attribute( "index" ), "Use" ) == 0 )
-            requirement.useNodeName = child->Attribute( "Link" );
-          if ( _stricmp( child->Attribute( "index" ), "Show" ) == 0 )
-            requirement.showNodeName = child->Attribute( "Link" );
-        }
-        child = child->NextSiblingElement();
+        out += data_[i];
+        continue;
+      }
+      auto semi = find( ';', i, end );
+      if ( semi == end )
+      {
+        out += data_[i];
+        continue;
+      }
+      string entity( data_ + i + 1, semi - i - 1 );
+      if ( entity == "lt" )
+        out += '<';
+      else if ( entity == "gt" )
+        out += '>';
+      else if ( entity == "amp" )
+        out += '&';
+      else if ( entity == "quot" )
+        out += '"';
+      else if ( entity == "apos" )
+        out += '\'';
+      else if ( entity.size() > 1 && entity[0] == '#' )
+      {
+        bool hex = ( entity[1] == 'x' || entity[1] == 'X' );
+        appendUtf8( out, strtoul( entity.c_str() + ( hex ? 2 : 1 ), nullptr, hex ? 16 : 10 ) );
+      }
+      else
+      {
+        out += data_[i];
+        continue;
       }
+      i = semi;
     }
-    entry = entry->NextSiblingElement( "CRequirement" );
   }
 
-  // RequirementNodeData.xml
-  catalog = nodedatadoc.FirstChildElement( "Catalog" );
-  entry = catalog->FirstChildElement();
-  while ( entry )
+  uint16_t intern( std::unordered_map<string, uint16_t>& ids, string& key, size_t begin, size_t end )
   {
-    auto id = entry->Attribute( "id" );
-    if ( id )
+    key.assign( data_ + begin, end - begin );
+    auto it = ids.find( key );
+    if ( it != ids.end() )
+      return it->second;
+    if ( names_.size() > UINT16_MAX )
+      fail( begin, "too many distinct names" );
+    auto id = static_cast<uint16_t>( names_.size() );
+    names_.push_back( key );
+    ids.emplace( key, id );
+    return id;
+  }
+
+  void scan()
+  {
+    if ( size_ > UINT32_MAX )
+      fail( 0, "file too large" );
+    std::unordered_map<string, uint16_t> ids;
+    string key;
+    vector<uint16_t> open; // names of the currently open elements
+    size_t pos = ( startsWith( 0, size_, "\xEF\xBB\xBF" ) ? 3 : 0 );
+    size_t end = size_;
+
+    while ( true )
     {
-      if ( nodes.find( id ) == nodes.end() )
-        nodes[id] = RequirementNode( id );
+      pos = find( '<', pos, end );
+      if ( pos == end )
+        break;
 
-      RequirementNode& node = nodes[id];
-      node.type = reqNodeTypeToEnum( entry->Name() );
-      if ( node.type == ReqNode_LogicAnd || node.type == ReqNode_LogicOr || node.type == ReqNode_LogicEq || node.type == ReqNode_LogicNot )
-        node.operands.clear();
+      if ( startsWith( pos, end, "<?" ) )
+      {
+        pos = skipPast( pos, end, "?>" );
+        continue;
+      }
+      if ( startsWith( pos, end, "<!--" ) )
+      {
+        pos = skipPast( pos, end, "-->" );
+        continue;
+      }
+      if ( startsWith( pos, end, "<![CDATA[" ) )
+      {
+        pos = skipPast( pos, end, "]]>" );
+        continue;
+      }
+      if ( startsWith( pos, end, "<!" ) )
+      {
+        pos = skipPast( pos, end, ">" );
+        continue;
+      }
 
-      auto child = entry->FirstChildElement();
-      while ( child )
+      Tag tag;
+      tag.firstAttribute = static_cast<uint32_t>( attributes_.size() );
+      tag.attributeCount = 0;
+
+      if ( startsWith( pos, end, "</" ) )
+      {
+        size_t nameBegin = pos + 2;
+        size_t p = nameBegin;
+        while ( p < end && !isNameEnd( data_[p] ) )
+          p++;
+        if ( open.empty() || names_[open.back()].compare( 0, string::npos, data_ + nameBegin, p - nameBegin ) != 0 )
+          fail( pos, "unexpected end tag </" + string( data_ + nameBegin, p - nameBegin ) + ">" );
+        while ( p < end && isSpace( data_[p] ) )
+          p++;
+        if ( p >= end || data_[p] != '>' )
+          fail( pos, "malformed end tag" );
+        pos = p + 1;
+        tag.name = open.back();
+        open.pop_back();
+        tag.depth = static_cast<uint16_t>( open.size() );
+        tag.end = true;
+        tags_.push_back( tag );
+        continue;
+      }
+
+      // start tag
+      size_t tagBegin = pos;
+      size_t p = pos + 1;
+      while ( p < end && !isNameEnd( data_[p] ) )
+        p++;
+      if ( p == pos + 1 )
+        fail( pos, "missing element name" );
+      if ( open.size() >= UINT16_MAX )
+        fail( pos, "elements nested too deeply" );
+      tag.name = intern( ids, key, pos + 1, p );
+      tag.depth = static_cast<uint16_t>( open.size() );
+      tag.end = false;
+
+      bool selfClosing = false;
+      while ( true )
       {
-        if ( _stricmp( child->Name(), "Count" ) == 0 )
+        while ( p < end && isSpace( data_[p] ) )
+          p++;
+        if ( p >= end )
+          fail( tagBegin, "unterminated start tag" );
+        if ( data_[p] == '>' )
         {
-          if ( child->Attribute( "Link" ) )
-            node.countLink = child->Attribute( "Link" );
-          if ( child->Attribute( "State" ) )
-            node.countState = child->Attribute( "State" );
+          p++;
+          break;
         }
-        else if ( _stricmp( child->Name(), "OperandArray" ) == 0 && child->Attribute( "value" ) )
+        if ( data_[p] == '/' )
         {
-          size_t opIndex = child->UnsignedAttribute( "index", node.operands.size() );
-          node.operands[opIndex] = child->Attribute( "value" );
+          if ( p + 1 >= end || data_[p + 1] != '>' )
+            fail( p, "malformed empty element tag" );
+          selfClosing = true;
+          p += 2;
+          break;
         }
-        child = child->NextSiblingElement();
+        size_t attrBegin = p;
+        while ( p < end && !isNameEnd( data_[p] ) )
+          p++;
+        if ( p == attrBegin )
+          fail( p, "missing attribute name" );
+        TagAttribute attr;
+        attr.name = intern( ids, key, attrBegin, p );
+        while ( p < end && isSpace( data_[p] ) )
+          p++;
+        if ( p >= end || data_[p] != '=' )
+          fail( p, "expected '=' after attribute name" );
+        p++;
+        while ( p < end && isSpace( data_[p] ) )
+          p++;
+        if ( p >= end || ( data_[p] != '"' && data_[p] != '\'' ) )
+          fail( p, "expected quoted attribute value" );
+        auto quote = find( data_[p], p + 1, end );
+        if ( quote == end )
+          fail( p, "unterminated attribute value" );
+        if ( tag.attributeCount == UINT16_MAX )
+          fail( tagBegin, "too many attributes" );
+        attr.valueBegin = static_cast<uint32_t>( p + 1 );
+        attr.valueEnd = static_cast<uint32_t>( quote );
+        attr.entities = ( find( '&', p + 1, quote ) != quote );
+        attributes_.push_back( attr );
+        tag.attributeCount++;
+        p = quote + 1;
+      }
+      pos = p;
+
+      if ( tag.depth == 0 && names_[tag.name] != "Catalog" )
+        fail( tagBegin, "expected <Catalog>, got <" + names_[tag.name] + ">" );
+      tags_.push_back( tag );
+
+      if ( selfClosing )
+      {
+        tag.firstAttribute = static_cast<uint32_t>( attributes_.size() );
+        tag.attributeCount = 0;
+        tag.end = true;
+        tags_.push_back( tag );
+        continue;
       }
+      open.push_back( tag.name );
     }
-    entry = entry->NextSiblingElement();
+
+    if ( !open.empty() )
+      fail( end, "<" + names_[open.back()] + "> is never closed" );
+    tags_.shrink_to_fit();
+    attributes_.shrink_to_fit();
   }
-}
 
-struct OffsetPoint {
-  double x, y;
-  OffsetPoint( double x_, double y_ ): x( x_ ), y( y_ ) {}
-};
+  void dispatch( size_t begin, size_t end, CatalogHandler& handler ) const
+  {
+    CatalogElement element;
+    string scratch; // NUL-separated values of the current tag
+    vector<size_t> offsets; // into scratch, one per attribute
 
-struct FootprintShapeBorder {
-  size_t offset1;
-  size_t offset2;
-  int type;
-  FootprintShapeBorder( unsigned long o1, unsigned long o2, int t_ ): offset1( o1 ), offset2( o2 ), type( t_ ) {}
-};
-
-using FootprintShapeBucket = vector<size_t>;
-using FootprintShapeBucketVector = vector<FootprintShapeBucket>;
-
-struct Point2DI {
-  int x, y;
-  Point2DI( int x_, int y_ ): x( x_ ), y( y_ ) {}
-};
-
-using Polygon = vector<Point2DI>;
-using PolygonVector = vector<Polygon>;
+    for ( size_t i = begin; i < end; i++ )
+    {
+      auto& tag = tags_[i];
+      element.name = names_[tag.name].c_str();
+      element.depth = tag.depth;
+      element.tag = i;
+      element.attributes.clear();
+      if ( tag.end )
+      {
+        handler.elementEnd( element );
+        continue;
+      }
 
-struct FootprintShape {
-  double radius;
-  PolygonVector unpathablePolys;
-  PolygonVector buildingPolys;
-  FootprintShape(): radius( 0.0 ) {}
+      scratch.clear();
+      offsets.clear();
+      for ( size_t a = tag.firstAttribute; a < tag.firstAttribute + tag.attributeCount; a++ )
+      {
+        auto& attr = attributes_[a];
+        offsets.push_back( scratch.size() );
+        if ( attr.entities )
+          appendValue( scratch, attr.valueBegin, attr.valueEnd );
+        else
+          scratch.append( data_ + attr.valueBegin, attr.valueEnd - attr.valueBegin );
+        scratch += '\0';
+      }
+      for ( size_t a = 0; a < tag.attributeCount; a++ )
+        element.attributes.emplace_back( names_[attributes_[tag.firstAttribute + a].name].c_str(), scratch.c_str() + offsets[a] );
+      handler.elementStart( element );
+    }
+  }
 };
 
-struct Footprint {
-  string id;
-  int x;
-  int y;
-  int w;
-  int h;
-  bool removed;
-  bool hasCreep;
-  bool hasNearResources;
-  char creepChar;
-  char nearResourcesChar;
-  vector<char> placement;
-  vector<char> creep;
-  vector<char> nearResources;
-  FootprintShape shape;
-  Footprint():
-      x( 0 ), y( 0 ), w( 0 ), h( 0 ), removed( false ), hasCreep( false ), hasNearResources( false ) {}
-};
+// Feeds catalog entries to another handler in parent-before-child order. An entry
+// whose parent is neither known yet (from an earlier mod or an earlier entry) is held
+// back and replayed from the reader as soon as that parent has been applied, so each
+// entry is parsed exactly once. Entries still waiting at the end of the file either
+// form a cycle or point at a parent that is never defined.
+class ParentOrderHandler : public CatalogHandler
+{
+public:
+  using IsKnown = std::function<bool( const char* )>;
 
-using FootprintMap = std::map<string, Footprint>;
+  ParentOrderHandler( const CatalogReader& reader, const char* entryName, IsKnown isKnown, CatalogHandler& target ):
+      reader_( reader ), entryName_( entryName ), isKnown_( isKnown ), target_( target ), deferring_( false ) {}
 
-void parseFootprintShapes( vector<OffsetPoint>& offsets, vector<FootprintShapeBorder>& borders, int type, PolygonVector& out )
-{
-  out.clear();
+  void elementStart( const CatalogElement& element ) override
+  {
+    if ( deferring_ )
+      return;
+    if ( element.Depth() == 1 )
+    {
+      bool matches = ( !entryName_ || strcmp( element.Name(), entryName_ ) == 0 );
+      auto id = element.Attribute( "id" );
+      auto parent = element.Attribute( "parent" );
+      if ( matches && parent && strlen( parent ) > 0 && !isKnown_( parent ) )
+      {
+        deferring_ = true;
+        deferred_.id = ( id ? id : "" );
+        deferred_.parent = parent;
+        deferred_.begin = element.tag;
+        return;
+      }
+      currentId_ = ( matches && id ? id : "" );
+    }
+    target_.elementStart( element );
+  }
 
-  FootprintShapeBucketVector buckets;
-  for ( auto& border : borders )
+  void elementEnd( const CatalogElement& element ) override
   {
-    if ( border.type != type ) // 0 = unpathable terrain, 1 = ground, 2 = building, 3 = cliff
-      continue;
-    bool newBucket = true;
-    for ( auto& bucket : buckets )
+    if ( deferring_ )
     {
-      auto it2 = std::find( bucket.begin(), bucket.end(), border.offset2 );
-      if ( it2 == bucket.begin() && !bucket.empty() )
+      if ( element.Depth() == 1 )
       {
-        FootprintShapeBucket prepend;
-        for ( auto& srcBucket : buckets )
-        {
-          auto it1 = std::find( srcBucket.begin(), srcBucket.end(), border.offset1 );
-          if ( it1 != srcBucket.end() && std::next( it1 ) == srcBucket.end() && &srcBucket != &bucket )
-          {
-            prepend.swap( srcBucket );
-            break;
-          }
-        }
-        if ( prepend.empty() )
-        {
-          bucket.insert( it2, border.offset1 );
-        }
-        else
-        {
-          for ( auto& roundRobin : buckets )
-          {
-            if ( !roundRobin.empty() && roundRobin.front() == border.offset2 && roundRobin.back() == prepend.front() )
-            {
-              roundRobin.insert( roundRobin.begin(), std::begin( prepend ), std::end( prepend ) );
-              goto nextloop;
-            }
-          }
-          bucket.insert( it2, std::begin( prepend ), std::end( prepend ) );
-        }
-        goto nextloop;
+        deferred_.end = element.tag;
+        waiting_[deferred_.parent].push_back( deferred_ );
+        deferring_ = false;
       }
+      return;
     }
-    if ( newBucket )
+    target_.elementEnd( element );
+    if ( element.Depth() == 1 && !currentId_.empty() )
     {
-      FootprintShapeBucket bucket;
-      bucket.push_back( border.offset1 );
-      bucket.push_back( border.offset2 );
-      buckets.push_back( bucket );
+      string id = currentId_;
+      auto it = waiting_.find( id );
+      if ( it == waiting_.end() )
+        return;
+      auto children = it->second;
+      waiting_.erase( it );
+      for ( auto& child : children )
+        reader_.replay( child.begin, child.end, *this );
     }
-nextloop:;
   }
-  FootprintShapeBucketVector outBuckets;
-  while ( !buckets.empty() )
+
+  // call after the whole file has been read
+  void finish() const
   {
-    auto it = buckets.begin();
-    while ( it != buckets.end() )
+    if ( waiting_.empty() )
+      return;
+
+    // walk up from any waiting entry until we hit a parent nobody defines or come back around
+    std::map<string, string> parentOf;
+    for ( auto& w : waiting_ )
+      for ( auto& child : w.second )
+        parentOf[child.id] = w.first;
+
+    auto& first = *waiting_.begin();
+    string current = first.second.front().id;
+    string next = first.first;
+    vector<string> chain( 1, current );
+    while ( std::find( chain.begin(), chain.end(), next ) == chain.end() )
     {
-      if ( ( *it ).empty() )
-        it = buckets.erase( it );
-      else if ( ( *it ).front() == ( *it ).back() )
-      {
-        outBuckets.push_back( ( *it ) );
-        it = buckets.erase( it );
-      } else
-        it++;
+      chain.push_back( next );
+      auto it = parentOf.find( next );
+      if ( it == parentOf.end() )
+        throw runtime_error( "Entry " + current + " in " + reader_.filename() + " has parent " + next + " which is never defined" );
+      current = next;
+      next = it->second;
     }
-    it = buckets.begin();
-    if ( it != buckets.end() )
+    chain.erase( chain.begin(), std::find( chain.begin(), chain.end(), next ) );
+    chain.push_back( next );
+    throw runtime_error( "Parent cycle in " + reader_.filename() + ": " + boost::join( chain, " -> " ) );
+  }
+
+private:
+  struct Deferred {
+    string id;
+    string parent;
+    size_t begin;
+    size_t end;
+  };
+
+  const CatalogReader& reader_;
+  const char* entryName_;
+  IsKnown isKnown_;
+  CatalogHandler& target_;
+  bool deferring_;
+  Deferred deferred_;
+  string currentId_;
+  std::map<string, vector<Deferred>> waiting_; // parent id -> entries waiting for it
+};
+
+inline bool boolValue( const CatalogElement& element )
+{
+  return ( element.IntAttribute( "value" ) > 0 ? true : false );
+}
+
+// FNV-1a over the lowercased name, so that it agrees with CaseInsensitiveEqual.
+struct CaseInsensitiveHash {
+  size_t operator()( const char* str ) const
+  {
+    uint32_t hash = 2166136261u;
+    for ( ; *str; str++ )
+      hash = ( hash ^ static_cast<uint32_t>( tolower( static_cast<unsigned char>( *str ) ) ) ) * 16777619u;
+    return hash;
+  }
+};
+
+struct CaseInsensitiveEqual {
+  bool operator()( const char* a, const char* b ) const
+  {
+    return _stricmp( a, b ) == 0;
+  }
+};
+
+// Maps the names of the fields of a catalog entry to the code that applies them to
+// Target, so a handler does one hash lookup per field instead of walking a chain of
+// _stricmp calls. Simple fields use the typed setters below, e.g.
+//   { "LifeMax", &Fields::real<&Unit::lifeMax> },
+// anything that needs the handler's state or several attributes is a lambda.
+// Field names are matched case-insensitively and must be string literals.
+template <class Handler, class Target>
+class FieldTable
+{
+public:
+  using Apply = void ( * )( Handler& handler, Target& target, const CatalogElement& field );
+  struct Entry {
+    const char* name;
+    Apply apply;
+  };
+
+  FieldTable( std::initializer_list<Entry> entries )
+  {
+    table_.reserve( entries.size() );
+    for ( auto& entry : entries )
+      table_[entry.name] = entry.apply;
+  }
+
+  // returns false if the field is not in the table
+  bool apply( Handler& handler, Target& target, const CatalogElement& field ) const
+  {
+    auto it = table_.find( field.Name() );
+    if ( it == table_.end() )
+      return false;
+    it->second( handler, target, field );
+    return true;
+  }
+
+  template <double Target::*member>
+  static void real( Handler&, Target& target, const CatalogElement& field )
+  {
+    target.*member = field.DoubleAttribute( "value" );
+  }
+
+  template <int64_t Target::*member>
+  static void integer( Handler&, Target& target, const CatalogElement& field )
+  {
+    target.*member = field.Int64Attribute( "value" );
+  }
+
+  template <string Target::*member>
+  static void text( Handler&, Target& target, const CatalogElement& field )
+  {
+    if ( field.Attribute( "value" ) )
+      target.*member = field.Attribute( "value" );
+  }
+
+  // a reference to another catalog entry
+  template <Symbol Target::*member>
+  static void link( Handler&, Target& target, const CatalogElement& field )
+  {
+    if ( field.Attribute( "value" ) )
+      target.*member = Symbol( field.Attribute( "value" ) );
+  }
+
+  // <Field index="X" value="1"/> adds X, value="0" or removed="1" takes it away
+  template <CopyOnWrite<ArenaSet<string>> Target::*member>
+  static void indexSet( Handler&, Target& target, const CatalogElement& field )
+  {
+    if ( !field.Attribute( "index" ) )
+      return;
+    if ( field.Attribute( "value" ) && field.IntAttribute( "value" ) > 0 )
+      ( target.*member ).write().insert( field.Attribute( "index" ) );
+    else if ( field.Attribute( "removed" ) || ( field.Attribute( "value" ) && field.IntAttribute( "value" ) < 1 ) )
+      ( target.*member ).write().erase( field.Attribute( "index" ) );
+  }
+
+  template <CopyOnWrite<FilterSet> Target::*requires, CopyOnWrite<FilterSet> Target::*excludes>
+  static void filters( Handler&, Target& target, const CatalogElement& field )
+  {
+    if ( field.Attribute( "value" ) )
+      parseFilters( field.Attribute( "value" ), ( target.*requires ).write(), ( target.*excludes ).write() );
+  }
+
+private:
+  std::unordered_map<const char*, Apply, CaseInsensitiveHash, CaseInsensitiveEqual> table_;
+};
+
+struct Weapon {
+  Symbol name;
+  double range;
+  double period; // time between attacks
+  Symbol effect;
+  double arc;
+  double damagePoint;
+  double backSwing;
+  double rangeSlop;
+  double arcSlop;
+  double minScanRange;
+  double randomDelayMin;
+  double randomDelayMax;
+  bool melee;
+  bool hidden;
+  bool disabled;
+  bool suicide;
+  CopyOnWrite<FilterSet> targetRequire;
+  CopyOnWrite<FilterSet> targetExclude;
+  Weapon():
+      range( 0.0 ), period( 0.0 ), arc( 0.0 ), damagePoint( 0.0 ), backSwing( 0.0 ),
+      rangeSlop( 0.0 ), arcSlop( 0.0 ), minScanRange( 0.0 ), randomDelayMin( 0.0 ), randomDelayMax( 0.0 ),
+      melee( false ), hidden( false ), disabled( false ), suicide( false ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, Weapon& weapon )
+{
+  ar( weapon.name, weapon.range, weapon.period, weapon.effect, weapon.arc, weapon.damagePoint, weapon.backSwing );
+  ar( weapon.rangeSlop, weapon.arcSlop, weapon.minScanRange, weapon.randomDelayMin, weapon.randomDelayMax );
+  ar( weapon.melee, weapon.hidden, weapon.disabled, weapon.suicide, weapon.targetRequire, weapon.targetExclude );
+}
+
+using WeaponMap = SymbolMap<Weapon>;
+
+struct WeaponDataHandler : CatalogHandler {
+  using Fields = FieldTable<WeaponDataHandler, Weapon>;
+  WeaponMap& weapons;
+  Weapon& defaultWeapon;
+  Weapon* weapon; // entry being parsed, null while skipping one
+  WeaponDataHandler( WeaponMap& weapons_, Weapon& defaultWeapon_ ):
+      weapons( weapons_ ), defaultWeapon( defaultWeapon_ ), weapon( nullptr ) {}
+
+  void elementStart( const CatalogElement& field ) override
+  {
+    if ( field.Depth() == 1 )
+      entryStart( field );
+    else if ( field.Depth() == 2 && weapon )
+      fieldStart( field );
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    weapon = nullptr;
+    bool isDefault = ( entry.Attribute( "default" ) && entry.Int64Attribute( "default" ) == 1 && !entry.Attribute( "id" ) );
+    auto id = entry.Attribute( "id" );
+    if ( !id && !isDefault )
+      return;
+
+    Symbol key( id );
+    if ( !isDefault && weapons.find( key ) == weapons.end() )
+      weapons[key] = defaultWeapon;
+
+    Weapon& wpn = ( isDefault ? defaultWeapon : weapons[key] );
+    if ( !isDefault )
     {
-      for ( auto& bucket : buckets )
-      {
-        if ( bucket.size() < 2 )
-          continue;
-        if ( ( *it ).back() == bucket.front() && &( *it ) != &bucket )
-        {
-          ( *it ).insert( ( *it ).end(), std::next( bucket.begin() ), bucket.end() );
-          bucket.clear();
-          break;
-        }
-      }
+      wpn.name = key;
+      printf_s( "[+] weapon: %s\r\n", wpn.name.c_str() );
     }
+    weapon = &wpn;
   }
-  for ( auto& bucket : outBuckets )
+
+  void fieldStart( const CatalogElement& field )
   {
-    Polygon poly;
-    for ( auto idx : bucket )
+    static const Fields fields = {
+      { "Range", &Fields::real<&Weapon::range> },
+      { "Period", &Fields::real<&Weapon::period> },
+      { "Arc", &Fields::real<&Weapon::arc> },
+      { "DamagePoint", &Fields::real<&Weapon::damagePoint> },
+      { "BackSwing", &Fields::real<&Weapon::backSwing> },
+      { "RangeSlop", &Fields::real<&Weapon::rangeSlop> },
+      { "ArcSlop", &Fields::real<&Weapon::arcSlop> },
+      { "MinScanRange", &Fields::real<&Weapon::minScanRange> },
+      { "RandomDelayMin", &Fields::real<&Weapon::randomDelayMin> },
+      { "RandomDelayMax", &Fields::real<&Weapon::randomDelayMax> },
+      { "TargetFilters", &Fields::filters<&Weapon::targetRequire, &Weapon::targetExclude> },
+      { "Options", []( WeaponDataHandler&, Weapon& wpn, const CatalogElement& field ) {
+         if ( !field.Attribute( "index" ) || !field.Attribute( "value" ) )
+           return;
+         if ( _stricmp( field.Attribute( "index" ), "Melee" ) == 0 )
+           wpn.melee = boolValue( field );
+         else if ( _stricmp( field.Attribute( "index" ), "Hidden" ) == 0 )
+           wpn.hidden = boolValue( field );
+         else if ( _stricmp( field.Attribute( "index" ), "Disabled" ) == 0 )
+           wpn.disabled = boolValue( field );
+       } },
+      { "Effect", &Fields::link<&Weapon::effect> },
+    };
+    fields.apply( *this, *weapon, field );
+  }
+};
+
+void parseWeaponData( const CatalogReader& reader, WeaponMap& weapons, Weapon& defaultWeapon )
+{
+  WeaponDataHandler handler( weapons, defaultWeapon );
+  reader.read( handler );
+}
+
+struct EffectBonus {
+  double value;
+};
+
+struct EffectSplash {
+  double radius;
+  double fraction;
+  string enumAreaEffect;
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, EffectBonus& bonus )
+{
+  ar( bonus.value );
+}
+
+template <class Archive>
+void snapshotFields( Archive& ar, EffectSplash& splash )
+{
+  ar( splash.radius, splash.fraction, splash.enumAreaEffect );
+}
+
+struct Effect {
+  enum Type {
+    Effect_Missile,
+    Effect_Damage,
+    Effect_CreateUnit,
+    Effect_CreateHealer,
+    Effect_Set,
+    // Effect_Suicide, this is figured out for json export in EffectGraph::write()
+    Effect_Persistent, // like lurker's spike
+    Effect_EnumArea,
+    Effect_Other,
+  } type;
+  enum ImpactLocation {
+    Impact_Undefined,
+    Impact_SourceUnit,
+    Impact_TargetPoint,
+    Impact_TargetUnitOrPoint,
+    Impact_TargetUnit,
+    Impact_CasterUnit,
+    Impact_CasterPoint,
+  };
+  Symbol name;
+  Symbol impactEffect; // for missile
+  CopyOnWrite<ArenaMap<string, EffectBonus>> attributeBonuses;
+  CopyOnWrite<ArenaMap<size_t, EffectSplash>> splashArea;
+  double damageAmount;
+  double damageArmorReduction;
+  string damageKind;
+  ImpactLocation impactLocation;
+  bool flagKill;
+  CopyOnWrite<ArenaMap<size_t, Symbol>> setSubEffects;
+  CopyOnWrite<FilterSet> searchRequires;
+  CopyOnWrite<FilterSet> searchExcludes;
+  CopyOnWrite<SymbolSet> persistentEffects;
+  CopyOnWrite<ArenaVector<double>> persistentPeriods;
+  size_t periodCount;
+  Effect():
+      type( Effect_Other ), damageAmount( 0.0 ), damageArmorReduction( 0.0 ), impactLocation( Impact_Undefined ), flagKill( false ), periodCount( 0 ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, Effect& effect )
+{
+  ar( effect.type, effect.name, effect.impactEffect, effect.attributeBonuses, effect.splashArea );
+  ar( effect.damageAmount, effect.damageArmorReduction, effect.damageKind, effect.impactLocation, effect.flagKill );
+  ar( effect.setSubEffects, effect.searchRequires, effect.searchExcludes, effect.persistentEffects, effect.persistentPeriods, effect.periodCount );
+}
+
+using EffectMap = SymbolMap<Effect>;
+
+struct EffectDataHandler : CatalogHandler {
+  using Fields = FieldTable<EffectDataHandler, Effect>;
+  EffectMap& effects;
+  Effect* effect; // entry being parsed, null while skipping one
+  size_t areaArrayCtr;
+  size_t fxArrayCtr;
+  EffectDataHandler( EffectMap& effects_ ):
+      effects( effects_ ), effect( nullptr ), areaArrayCtr( 0 ), fxArrayCtr( 0 ) {}
+
+  void elementStart( const CatalogElement& field ) override
+  {
+    if ( field.Depth() == 1 )
+      entryStart( field );
+    else if ( field.Depth() == 2 && effect )
+      fieldStart( field );
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    effect = nullptr;
+    auto id = entry.Attribute( "id" );
+    if ( !id )
+      return;
+
+    Symbol key( id );
+    if ( entry.Attribute( "parent" ) && strlen( entry.Attribute( "parent" ) ) > 0 && effects.find( key ) == effects.end() )
+    {
+      const Effect& parent = effects[Symbol( entry.Attribute( "parent" ) )];
+      effects[key] = parent;
+    }
+
+    effect = &effects[key];
+    effect->name = key;
+
+    printf_s( "[+] effect: %s\r\n", effect->name.c_str() );
+
+    if ( _stricmp( entry.Name(), "CEffectDamage" ) == 0 )
+      effect->type = Effect::Effect_Damage;
+    else if ( _stricmp( entry.Name(), "CEffectLaunchMissile" ) == 0 )
+      effect->type = Effect::Effect_Missile;
+    else if ( _stricmp( entry.Name(), "CEffectCreateUnit" ) == 0 )
+      effect->type = Effect::Effect_CreateUnit;
+    else if ( _stricmp( entry.Name(), "CEffectCreateHealer" ) == 0 )
+      effect->type = Effect::Effect_CreateHealer;
+    else if ( _stricmp( entry.Name(), "CEffectSet" ) == 0 )
+      effect->type = Effect::Effect_Set;
+    else if ( _stricmp( entry.Name(), "CEffectCreatePersistent" ) == 0 )
+      effect->type = Effect::Effect_Persistent;
+    else if ( _stricmp( entry.Name(), "CEffectEnumArea" ) == 0 )
+      effect->type = Effect::Effect_EnumArea;
+    else
+      effect->type = Effect::Effect_Other;
+
+    areaArrayCtr = 0;
+    fxArrayCtr = 0;
+  }
+
+  void fieldStart( const CatalogElement& field )
+  {
+    static const Fields fields = {
+      { "ArmorReduction", &Fields::real<&Effect::damageArmorReduction> },
+      { "Amount", &Fields::real<&Effect::damageAmount> },
+      { "ImpactEffect", &Fields::link<&Effect::impactEffect> },
+      { "Kind", &Fields::text<&Effect::damageKind> },
+      { "Flags", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         if ( field.Attribute( "index" ) && field.Attribute( "value" ) && boost::iequals( field.Attribute( "index" ), "Kill" ) )
+           effect.flagKill = field.IntAttribute( "value" ) > 0;
+       } },
+      { "ImpactLocation", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         auto value = field.Attribute( "Value" );
+         if ( !value )
+           return;
+         if ( boost::iequals( value, "SourceUnit" ) )
+           effect.impactLocation = Effect::Impact_SourceUnit;
+         else if ( boost::iequals( value, "TargetPoint" ) )
+           effect.impactLocation = Effect::Impact_TargetPoint;
+         else if ( boost::iequals( value, "TargetUnitOrPoint" ) )
+           effect.impactLocation = Effect::Impact_TargetUnitOrPoint;
+         else if ( boost::iequals( value, "TargetUnit" ) )
+           effect.impactLocation = Effect::Impact_TargetUnit;
+         else if ( boost::iequals( value, "CasterPoint" ) )
+           effect.impactLocation = Effect::Impact_CasterPoint;
+         else if ( boost::iequals( value, "CasterUnit" ) )
+           effect.impactLocation = Effect::Impact_CasterUnit;
+       } },
+      { "SearchFilters", &Fields::filters<&Effect::searchRequires, &Effect::searchExcludes> },
+      { "AreaArray", []( EffectDataHandler& handler, Effect& effect, const CatalogElement& field ) {
+         auto& ctr = handler.areaArrayCtr;
+         ctr = ( field.Attribute( "index" ) ? field.UnsignedAttribute( "index" ) : ctr );
+         auto& area = effect.splashArea.write()[ctr];
+         if ( field.Attribute( "Radius" ) )
+           area.radius = field.DoubleAttribute( "Radius" );
+         if ( field.Attribute( "Fraction" ) )
+           area.fraction = field.DoubleAttribute( "Fraction" );
+         if ( field.Attribute( "Effect" ) )
+           area.enumAreaEffect = field.Attribute( "Effect" );
+         ctr++;
+       } },
+      // Array of effects, usually one, that will run after each period.
+      { "PeriodicEffectArray", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           effect.persistentEffects.write().insert( Symbol( field.Attribute( "value" ) ) );
+       } },
+      // Array of waiting periods between each effect of this periodic set. If less than PeriodCount, loops around.
+      { "PeriodicPeriodArray", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           effect.persistentPeriods.write().push_back( field.DoubleAttribute( "value" ) );
+       } },
+      // Count of periods this effect lasts. If not specified, using the size of PeriodicPeriodArray (?)
+      { "PeriodCount", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           effect.periodCount = field.UnsignedAttribute( "value" );
+       } },
+      { "AttributeBonus", []( EffectDataHandler&, Effect& effect, const CatalogElement& field ) {
+         if ( field.Attribute( "index" ) && field.Attribute( "value" ) )
+           effect.attributeBonuses.write()[field.Attribute( "index" )].value = field.DoubleAttribute( "value" );
+       } },
+      { "EffectArray", []( EffectDataHandler& handler, Effect& effect, const CatalogElement& field ) {
+         auto& ctr = handler.fxArrayCtr;
+         ctr = ( field.Attribute( "index" ) ? field.UnsignedAttribute( "index" ) : ctr );
+         if ( field.Attribute( "value" ) )
+           effect.setSubEffects.write()[ctr] = Symbol( field.Attribute( "value" ) );
+         ctr++;
+       } },
+    };
+    fields.apply( *this, *effect, field );
+  }
+};
+
+void parseEffectData( const CatalogReader& reader, EffectMap& effects )
+{
+  EffectDataHandler handler( effects );
+  auto isKnown = [&effects]( const char* parentId ) { return effects.find( Symbol::lookup( parentId ) ) != effects.end(); };
+  ParentOrderHandler ordered( reader, nullptr, isKnown, handler );
+  reader.read( ordered );
+  ordered.finish();
+}
+
+inline size_t encodeRowCol( int row, int col )
+{
+  return ( ( (size_t)row * 100 ) + (size_t)col );
+}
+
+struct UnitDataHandler : CatalogHandler {
+  using Fields = FieldTable<UnitDataHandler, Unit>;
+  UnitMap& units;
+  Unit& defaultUnit;
+  Unit* unit; // entry being parsed, null while skipping one
+  size_t cardctr; // index of current CardLayouts subitem
+  UnitAbilityCard* card; // CardLayouts being parsed
+  size_t ctr; // LayoutButtons counter within the current card
+  UnitDataHandler( UnitMap& units_, Unit& defaultUnit_ ):
+      units( units_ ), defaultUnit( defaultUnit_ ), unit( nullptr ), cardctr( 0 ), card( nullptr ), ctr( 0 ) {}
+
+  void elementStart( const CatalogElement& field ) override
+  {
+    if ( field.Depth() == 1 )
+      entryStart( field );
+    else if ( field.Depth() == 2 && unit )
+      fieldStart( field );
+    else if ( field.Depth() == 3 && card && strcmp( field.Name(), "LayoutButtons" ) == 0 )
+      layoutButton( field );
+  }
+
+  void elementEnd( const CatalogElement& field ) override
+  {
+    if ( field.Depth() == 2 && card )
+    {
+      card->indexCtr = ctr;
+      cardctr++;
+      card = nullptr;
+    }
+    /*else if ( field.Depth() == 1 && unit && boost::iequals( unit->name, "Baneling" ) )
+    {
+      DebugBreak();
+    }*/
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    unit = nullptr;
+    if ( strcmp( entry.Name(), "CUnit" ) != 0 )
+      return;
+
+    bool isDefault = ( entry.Attribute( "default" ) && entry.Int64Attribute( "default" ) == 1 && !entry.Attribute( "id" ) );
+    auto id = entry.Attribute( "id" );
+    if ( !id && !isDefault )
+      return;
+
+    Symbol key( id );
+    if ( entry.Attribute( "parent" ) && strlen( entry.Attribute( "parent" ) ) > 0 )
+    {
+      Symbol parentId( entry.Attribute( "parent" ) );
+      if ( units.find( key ) == units.end() )
+      {
+        // copy base data from parent before parsing this descendant
+        // if it does not exist yet
+        printf( "Copying unit %s from parent %s because it does not exist yet\r\n", id, parentId.c_str() );
+        const Unit& parent = units[parentId];
+        units[key] = parent;
+      }
+    }
+
+    if ( !isDefault && units.find( key ) == units.end() )
+      units[key] = defaultUnit;
+
+    unit = ( isDefault ? &defaultUnit : &units[key] );
+
+    if ( !isDefault )
+    {
+      unit->name = key;
+      printf_s( "[+] unit: %s\r\n", unit->name.c_str() );
+    }
+
+    cardctr = 0;
+  }
+
+  void fieldStart( const CatalogElement& field )
+  {
+    static const Fields fields = {
+      { "Race", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         unit.race = raceToEnum( field.Attribute( "value" ) );
+       } },
+      { "LifeStart", &Fields::real<&Unit::lifeStart> },
+      { "LifeMax", &Fields::real<&Unit::lifeMax> },
+      { "Speed", &Fields::real<&Unit::speed> },
+      { "Acceleration", &Fields::real<&Unit::acceleration> },
+      { "Food", &Fields::real<&Unit::food> },
+      { "Sight", &Fields::real<&Unit::sight> },
+      { "ScoreMake", &Fields::integer<&Unit::scoreMake> },
+      { "ScoreKill", &Fields::integer<&Unit::scoreKill> },
+      { "AIEvaluateAlias", &Fields::text<&Unit::aiEvaluateAlias> },
+      { "AttackTargetPriority", &Fields::real<&Unit::attackTargetPriority> },
+      { "StationaryTurningRate", &Fields::real<&Unit::stationaryTurningRate> },
+      { "LateralAcceleration", &Fields::real<&Unit::lateralAcceleration> },
+      { "AIEvalFactor", &Fields::real<&Unit::aiEvalFactor> },
+      { "Attributes", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         auto index = field.Attribute( "index" );
+         if ( !index )
+           return;
+         if ( _stricmp( index, "Light" ) == 0 )
+           unit.light = boolValue( field );
+         else if ( _stricmp( index, "Biological" ) == 0 )
+           unit.biological = boolValue( field );
+         else if ( _stricmp( index, "Mechanical" ) == 0 )
+           unit.mechanical = boolValue( field );
+         else if ( _stricmp( index, "Armored" ) == 0 )
+           unit.armored = boolValue( field );
+         else if ( _stricmp( index, "Structure" ) == 0 )
+           unit.structure = boolValue( field );
+         else if ( _stricmp( index, "Psionic" ) == 0 )
+           unit.psionic = boolValue( field );
+         else if ( _stricmp( index, "Massive" ) == 0 )
+           unit.massive = boolValue( field );
+       } },
+      { "ResourceType", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         unit.resourceType = resourceToEnum( field.Attribute( "value" ) );
+       } },
+      { "ResourceState", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           unit.resourceHarvestable = ( _stricmp( field.Attribute( "value" ), "Harvestable" ) == 0 );
+       } },
+      { "CargoSize", &Fields::integer<&Unit::cargoSize> },
+      { "ShieldsStart", &Fields::real<&Unit::shieldsStart> },
+      { "ShieldsMax", &Fields::real<&Unit::shieldsMax> },
+      { "TurningRate", &Fields::real<&Unit::turningRate> },
+      { "LifeRegenRate", &Fields::real<&Unit::lifeRegenRate> },
+      { "EnergyStart", &Fields::real<&Unit::energyStart> },
+      { "EnergyMax", &Fields::real<&Unit::energyMax> },
+      { "EnergyRegenRate", &Fields::real<&Unit::energyRegenRate> },
+      { "Radius", &Fields::real<&Unit::radius> },
+      { "LifeArmor", &Fields::integer<&Unit::lifeArmor> },
+      { "SpeedMultiplierCreep", &Fields::real<&Unit::speedMultiplierCreep> },
+      { "CostResource", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         auto index = field.Attribute( "index" );
+         if ( !index )
+           return;
+         if ( _stricmp( index, "Minerals" ) == 0 )
+           unit.mineralCost = field.Int64Attribute( "value" );
+         else if ( _stricmp( index, "Vespene" ) == 0 )
+           unit.vespeneCost = field.Int64Attribute( "value" );
+       } },
+      { "CardLayouts", []( UnitDataHandler& handler, Unit& unit, const CatalogElement& field ) {
+         size_t cardidx = ( field.Attribute( "index" ) ? field.UnsignedAttribute( "index" ) : handler.cardctr );
+         auto card = &unit.abilityCardsMap.write()[cardidx];
+         if ( field.Attribute( "CardId" ) )
+           card->name = field.Attribute( "CardId" );
+         if ( field.Attribute( "removed" ) && field.Int64Attribute( "removed" ) > 0 )
+           card->removed = true;
+         else
+           card->removed = false;
+         handler.card = card;
+         handler.ctr = card->indexCtr; // ctr = 0;
+         // LayoutButtons children are handled by layoutButton(), the card is closed in elementEnd()
+       } },
+      { "TechAliasArray", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( !field.Attribute( "value" ) )
+           return;
+         Symbol alias( field.Attribute( "value" ) );
+         g_aliases[alias].insert( unit.name );
+         unit.techAliases.write().insert( alias );
+       } },
+      { "Mover", &Fields::text<&Unit::mover> },
+      { "GlossaryAlias", &Fields::text<&Unit::glossaryAlias> },
+      { "ShieldRegenDelay", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           unit.shieldRegenDelay = field.Int64Attribute( "value" );
+       } },
+      { "ShieldRegenRate", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) )
+           unit.shieldRegenRate = field.Int64Attribute( "value" );
+       } },
+      { "WeaponArray", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "Link" ) )
+           unit.weapons.write().insert( Symbol( field.Attribute( "Link" ) ) );
+       } },
+      { "FlagArray", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "index" ) && field.Attribute( "value" ) && _stricmp( field.Attribute( "index" ), "Invulnerable" ) == 0 )
+           unit.invulnerable = ( field.IntAttribute( "value" ) > 0 ? true : false );
+       } },
+      { "Footprint", &Fields::link<&Unit::footprint> },
+      { "EditorCategories", []( UnitDataHandler&, Unit& unit, const CatalogElement& field ) {
+         if ( field.Attribute( "value" ) && strstr( field.Attribute( "value" ), "ObjectFamily:Campaign" ) )
+           unit.campaign = true;
+       } },
+      { "PlaneArray", &Fields::indexSet<&Unit::planeArray> },
+      { "Collide", &Fields::indexSet<&Unit::collides> },
+      // { "AbilArray", ... unit->abilities },
+    };
+    fields.apply( *this, *unit, field );
+  }
+
+  void layoutButton( const CatalogElement& sub )
+  {
+    /*if ( boost::iequals( unit->name, "Baneling" ) && sub.Attribute( "AbilCmd" ) && _stricmp(  sub.Attribute("AbilCmd"), "BurrowBanelingDown,Execute" ) == 0 )
+    {
+      char asd[512];
+      sprintf_s( asd, 512, "Baneling ability: %s\r\n", sub.Attribute( "AbilCmd" ) );
+      OutputDebugStringA( asd );
+      printf( asd );
+    }*/
+    int64_t originalCtr = ctr;
+    bool overriding = sub.Attribute( "index" ) ? true : false;
+    if ( overriding )
+    {
+      ctr = sub.Int64Attribute( "index" );
+      auto& rowCo = unit->abilityRowCo.write();
+      auto itr = rowCo.begin();
+      while ( itr != rowCo.end() )
+      {
+        if ( ( *itr ).second == ctr )
+          itr = rowCo.erase( itr );
+        else
+          itr++;
+      }
+    }
+    if ( ( sub.Attribute( "removed" ) && sub.Int64Attribute( "removed" ) > 0 ) || ( sub.Attribute( "Type" ) && _stricmp( sub.Attribute( "Type" ), "Undefined" ) == 0 ) )
+      card->commands.erase( ctr );
+    else if ( sub.Attribute( "AbilCmd" ) )
+    {
+      card->commands[ctr] = Symbol( sub.Attribute( "AbilCmd" ) );
+      if ( sub.Attribute( "Row" ) && sub.Attribute( "Column" ) )
+      {
+        auto row = sub.IntAttribute( "Row" );
+        auto col = sub.IntAttribute( "Column" );
+        unit->abilityRowCo.write()[encodeRowCol( row, col )] = ctr;
+      }
+    }
+
+    ctr = ( overriding ? originalCtr : ctr + 1 );
+  }
+};
+
+void parseUnitData( const CatalogReader& reader, UnitMap& units, Unit& defaultUnit )
+{
+  UnitDataHandler handler( units, defaultUnit );
+  auto isKnown = [&units]( const char* parentId ) { return units.find( Symbol::lookup( parentId ) ) != units.end(); };
+  ParentOrderHandler ordered( reader, "CUnit", isKnown, handler );
+  reader.read( ordered );
+  ordered.finish();
+}
+
+struct Requirement {
+  Symbol id;
+  Symbol useNodeName;
+  Symbol showNodeName;
+  Requirement( Symbol id_ = Symbol() ):
+      id( id_ ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, Requirement& req )
+{
+  ar( req.id, req.useNodeName, req.showNodeName );
+}
+
+using RequirementMap = SymbolMap<Requirement>;
+
+enum RequirementNodeType {
+  ReqNode_Unknown,
+  ReqNode_CountUpgrade,
+  ReqNode_CountUnit,
+  ReqNode_LogicAnd,
+  ReqNode_LogicOr,
+  ReqNode_LogicEq,
+  ReqNode_LogicNot,
+};
+
+inline RequirementNodeType reqNodeTypeToEnum( const char* str )
+{
+  if ( _strcmpi( str, "CRequirementCountUpgrade" ) == 0 )
+    return ReqNode_CountUpgrade;
+  else if ( _strcmpi( str, "CRequirementCountUnit" ) == 0 )
+    return ReqNode_CountUnit;
+  else if ( _strcmpi( str, "CRequirementAnd" ) == 0 )
+    return ReqNode_LogicAnd;
+  else if ( _strcmpi( str, "CRequirementOr" ) == 0 )
+    return ReqNode_LogicOr;
+  else if ( _strcmpi( str, "CRequirementEq" ) == 0 )
+    return ReqNode_LogicEq;
+  else if ( _strcmpi( str, "CRequirementNot" ) == 0 )
+    return ReqNode_LogicNot;
+  else
+    return ReqNode_Unknown;
+}
+
+struct RequirementNode {
+  Symbol id;
+  RequirementNodeType type;
+  Symbol countLink; // countUpgrade, countUnit
+  string countState; // countUpgrade, countUnit
+  ArenaMap<size_t, Symbol> operands; // and, or, eq, not
+  RequirementNode( Symbol id_ = Symbol() ):
+      id( id_ ), type( ReqNode_Unknown ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, RequirementNode& node )
+{
+  ar( node.id, node.type, node.countLink, node.countState, node.operands );
+}
+
+using RequirementNodeMap = SymbolMap<RequirementNode>;
+
+struct RequirementDataHandler : CatalogHandler {
+  RequirementMap& requirements;
+  Requirement* requirement; // entry being parsed, null while skipping one
+  RequirementDataHandler( RequirementMap& requirements_ ):
+      requirements( requirements_ ), requirement( nullptr ) {}
+
+  void elementStart( const CatalogElement& element ) override
+  {
+    if ( element.Depth() == 1 )
+    {
+      requirement = nullptr;
+      auto id = element.Attribute( "id" );
+      if ( strcmp( element.Name(), "CRequirement" ) != 0 || !id )
+        return;
+
+      Symbol key( id );
+      if ( requirements.find( key ) == requirements.end() )
+        requirements[key] = Requirement( key );
+
+      requirement = &requirements[key];
+    }
+    else if ( element.Depth() == 2 && requirement )
+    {
+      auto& child = element;
+      if ( _stricmp( child.Name(), "NodeArray" ) == 0 && child.Attribute( "index" ) && child.Attribute( "Link" ) )
+      {
+        if ( _stricmp( child.Attribute( "index" ), "Use" ) == 0 )
+          requirement->useNodeName = Symbol( child.Attribute( "Link" ) );
+        if ( _stricmp( child.Attribute( "index" ), "Show" ) == 0 )
+          requirement->showNodeName = Symbol( child.Attribute( "Link" ) );
+      }
+    }
+  }
+};
+
+struct RequirementNodeDataHandler : CatalogHandler {
+  RequirementNodeMap& nodes;
+  RequirementNode* node; // entry being parsed, null while skipping one
+  RequirementNodeDataHandler( RequirementNodeMap& nodes_ ):
+      nodes( nodes_ ), node( nullptr ) {}
+
+  void elementStart( const CatalogElement& element ) override
+  {
+    if ( element.Depth() == 1 )
+    {
+      node = nullptr;
+      auto id = element.Attribute( "id" );
+      if ( !id )
+        return;
+
+      Symbol key( id );
+      if ( nodes.find( key ) == nodes.end() )
+        nodes[key] = RequirementNode( key );
+
+      node = &nodes[key];
+      node->type = reqNodeTypeToEnum( element.Name() );
+      if ( node->type == ReqNode_LogicAnd || node->type == ReqNode_LogicOr || node->type == ReqNode_LogicEq || node->type == ReqNode_LogicNot )
+        node->operands.clear();
+    }
+    else if ( element.Depth() == 2 && node )
+    {
+      auto& child = element;
+      if ( _stricmp( child.Name(), "Count" ) == 0 )
+      {
+        if ( child.Attribute( "Link" ) )
+          node->countLink = Symbol( child.Attribute( "Link" ) );
+        if ( child.Attribute( "State" ) )
+          node->countState = child.Attribute( "State" );
+      }
+      else if ( _stricmp( child.Name(), "OperandArray" ) == 0 && child.Attribute( "value" ) )
+      {
+        size_t opIndex = child.UnsignedAttribute( "index", static_cast<unsigned>( node->operands.size() ) );
+        node->operands[opIndex] = Symbol( child.Attribute( "value" ) );
+      }
+    }
+  }
+};
+
+void parseRequirementData( const CatalogReader& datareader, const CatalogReader& nodedatareader, RequirementMap& requirements, RequirementNodeMap& nodes )
+{
+  // RequirementData.xml
+  RequirementDataHandler datahandler( requirements );
+  datareader.read( datahandler );
+
+  // RequirementNodeData.xml
+  RequirementNodeDataHandler nodedatahandler( nodes );
+  nodedatareader.read( nodedatahandler );
+}
+
+struct OffsetPoint {
+  double x, y;
+  OffsetPoint( double x_, double y_ ): x( x_ ), y( y_ ) {}
+};
+
+struct FootprintShapeBorder {
+  size_t offset1;
+  size_t offset2;
+  int type;
+  FootprintShapeBorder( unsigned long o1, unsigned long o2, int t_ ): offset1( o1 ), offset2( o2 ), type( t_ ) {}
+};
+
+using FootprintShapeBucket = vector<size_t>;
+using FootprintShapeBucketVector = vector<FootprintShapeBucket>;
+
+struct Point2DI {
+  int x, y;
+  Point2DI(): x( 0 ), y( 0 ) {}
+  Point2DI( int x_, int y_ ): x( x_ ), y( y_ ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, Point2DI& pt )
+{
+  ar( pt.x, pt.y );
+}
+
+using Polygon = vector<Point2DI>;
+using PolygonVector = vector<Polygon>;
+
+struct FootprintShape {
+  double radius;
+  CopyOnWrite<PolygonVector> unpathablePolys;
+  CopyOnWrite<PolygonVector> buildingPolys;
+  FootprintShape(): radius( 0.0 ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, FootprintShape& shape )
+{
+  ar( shape.radius, shape.unpathablePolys, shape.buildingPolys );
+}
+
+struct Footprint {
+  Symbol id;
+  int x;
+  int y;
+  int w;
+  int h;
+  bool removed;
+  bool hasCreep;
+  bool hasNearResources;
+  char creepChar;
+  char nearResourcesChar;
+  CopyOnWrite<ArenaVector<char>> placement;
+  CopyOnWrite<ArenaVector<char>> creep;
+  CopyOnWrite<ArenaVector<char>> nearResources;
+  FootprintShape shape;
+  Footprint():
+      x( 0 ), y( 0 ), w( 0 ), h( 0 ), removed( false ), hasCreep( false ), hasNearResources( false ), creepChar( 0 ), nearResourcesChar( 0 ) {}
+};
+
+template <class Archive>
+void snapshotFields( Archive& ar, Footprint& fp )
+{
+  ar( fp.id, fp.x, fp.y, fp.w, fp.h, fp.removed, fp.hasCreep, fp.hasNearResources, fp.creepChar, fp.nearResourcesChar );
+  ar( fp.placement, fp.creep, fp.nearResources, fp.shape );
+}
+
+using FootprintMap = SymbolMap<Footprint>;
+
+void parseFootprintShapes( vector<OffsetPoint>& offsets, vector<FootprintShapeBorder>& borders, int type, PolygonVector& out )
+{
+  out.clear();
+
+  FootprintShapeBucketVector buckets;
+  for ( auto& border : borders )
+  {
+    if ( border.type != type ) // 0 = unpathable terrain, 1 = ground, 2 = building, 3 = cliff
+      continue;
+    bool newBucket = true;
+    for ( auto& bucket : buckets )
+    {
+      auto it2 = std::find( bucket.begin(), bucket.end(), border.offset2 );
+      if ( it2 == bucket.begin() && !bucket.empty() )
+      {
+        FootprintShapeBucket prepend;
+        for ( auto& srcBucket : buckets )
+        {
+          auto it1 = std::find( srcBucket.begin(), srcBucket.end(), border.offset1 );
+          if ( it1 != srcBucket.end() && std::next( it1 ) == srcBucket.end() && &srcBucket != &bucket )
+          {
+            prepend.swap( srcBucket );
+            break;
+          }
+        }
+        if ( prepend.empty() )
+        {
+          bucket.insert( it2, border.offset1 );
+        }
+        else
+        {
+          for ( auto& roundRobin : buckets )
+          {
+            if ( !roundRobin.empty() && roundRobin.front() == border.offset2 && roundRobin.back() == prepend.front() )
+            {
+              roundRobin.insert( roundRobin.begin(), std::begin( prepend ), std::end( prepend ) );
+              goto nextloop;
+            }
+          }
+          bucket.insert( it2, std::begin( prepend ), std::end( prepend ) );
+        }
+        goto nextloop;
+      }
+    }
+    if ( newBucket )
+    {
+      FootprintShapeBucket bucket;
+      bucket.push_back( border.offset1 );
+      bucket.push_back( border.offset2 );
+      buckets.push_back( bucket );
+    }
+nextloop:;
+  }
+  FootprintShapeBucketVector outBuckets;
+  while ( !buckets.empty() )
+  {
+    auto it = buckets.begin();
+    while ( it != buckets.end() )
+    {
+      if ( ( *it ).empty() )
+        it = buckets.erase( it );
+      else if ( ( *it ).front() == ( *it ).back() )
+      {
+        outBuckets.push_back( ( *it ) );
+        it = buckets.erase( it );
+      } else
+        it++;
+    }
+    it = buckets.begin();
+    if ( it != buckets.end() )
+    {
+      for ( auto& bucket : buckets )
+      {
+        if ( bucket.size() < 2 )
+          continue;
+        if ( ( *it ).back() == bucket.front() && &( *it ) != &bucket )
+        {
+          ( *it ).insert( ( *it ).end(), std::next( bucket.begin() ), bucket.end() );
+          bucket.clear();
+          break;
+        }
+      }
+    }
+  }
+  for ( auto& bucket : outBuckets )
+  {
+    Polygon poly;
+    for ( auto idx : bucket )
     {
       poly.emplace_back( (int)( offsets[idx].x * 1000.0 ), (int)( offsets[idx].y * 1000.0 ) );
     }
-    out.push_back( poly );
+    out.push_back( poly );
+  }
+}
+
+struct FootprintDataHandler : CatalogHandler {
+  FootprintMap& footprints;
+  Footprint& defaultFootprint;
+  Footprint* fp; // entry being parsed, null while skipping one
+  vector<OffsetPoint> offsets;
+  vector<FootprintShapeBorder> borders;
+  bool inShape;
+  bool inPlaceLayer; // inside a Layers index="Place" that is not removed
+  char setCharacter; // Character of the Sets being parsed, 0 if it has none or we already saw its Positive
+  bool rowsSeen;
+  bool rowsRemoved; // first Rows of the layer is marked removed
+  bool rowsMissingValue;
+  vector<string> rows;
+  FootprintDataHandler( FootprintMap& footprints_, Footprint& defaultFootprint_ ):
+      footprints( footprints_ ), defaultFootprint( defaultFootprint_ ), fp( nullptr ), inShape( false ), inPlaceLayer( false ),
+      setCharacter( 0 ), rowsSeen( false ), rowsRemoved( false ), rowsMissingValue( false ) {}
+
+  void elementStart( const CatalogElement& element ) override
+  {
+    if ( element.Depth() == 1 )
+      entryStart( element );
+    else if ( !fp )
+      return;
+    else if ( element.Depth() == 2 && strcmp( element.Name(), "Shape" ) == 0 )
+      inShape = true;
+    else if ( element.Depth() == 2 && strcmp( element.Name(), "Layers" ) == 0 )
+      layerStart( element );
+    else if ( element.Depth() == 3 && inShape )
+      shapeField( element );
+    else if ( element.Depth() == 3 && inPlaceLayer )
+      layerField( element );
+    else if ( element.Depth() == 4 && setCharacter && strcmp( element.Name(), "Positive" ) == 0 )
+    {
+      auto& positive = element;
+      if ( positive.Attribute( "index" ) && ( !positive.Attribute( "value" ) || positive.IntAttribute( "value" ) == 1 ) )
+      {
+        if ( boost::iequals( positive.Attribute( "index" ), "Creep" ) )
+        {
+          fp->hasCreep = true;
+          fp->creepChar = setCharacter;
+        }
+        else if ( boost::iequals( positive.Attribute( "index" ), "NearResources" ) )
+        {
+          fp->hasNearResources = true;
+          fp->nearResourcesChar = setCharacter;
+        }
+      }
+      setCharacter = 0; // only the first Positive of a set counts
+    }
+  }
+
+  void elementEnd( const CatalogElement& element ) override
+  {
+    if ( !fp )
+      return;
+    if ( element.Depth() == 1 )
+    {
+      // 0 = unpathable terrain, 1 = ground, 2 = building, 3 = cliff
+      PolygonVector polys;
+      parseFootprintShapes( offsets, borders, 0, polys );
+      fp->shape.unpathablePolys = std::move( polys );
+      parseFootprintShapes( offsets, borders, 2, polys );
+      fp->shape.buildingPolys = std::move( polys );
+      fp = nullptr;
+    }
+    else if ( element.Depth() == 2 )
+    {
+      if ( inPlaceLayer )
+        layerEnd();
+      inShape = false;
+      inPlaceLayer = false;
+    }
+    else if ( element.Depth() == 3 )
+      setCharacter = 0;
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    fp = nullptr;
+    if ( strcmp( entry.Name(), "CFootprint" ) != 0 )
+      return;
+
+    bool isDefault = ( entry.Attribute( "default" ) && entry.Int64Attribute( "default" ) == 1 && !entry.Attribute( "id" ) );
+    auto id = entry.Attribute( "id" );
+    if ( !id && !isDefault )
+      return;
+
+    Symbol key( id );
+    if ( entry.Attribute( "parent" ) && strlen( entry.Attribute( "parent" ) ) > 0 )
+    {
+      if ( footprints.find( key ) == footprints.end() )
+      {
+        const Footprint& parent = footprints[Symbol( entry.Attribute( "parent" ) )];
+        footprints[key] = parent;
+      }
+    }
+    else if ( !isDefault && footprints.find( key ) == footprints.end() )
+      footprints[key] = defaultFootprint;
+
+    fp = ( isDefault ? &defaultFootprint : &footprints[key] );
+
+    if ( !isDefault )
+    {
+      fp->id = key;
+      printf_s( "[+] footprint: %s\r\n", fp->id.c_str() );
+    }
+
+    offsets.clear();
+    borders.clear();
+  }
+
+  void shapeField( const CatalogElement& field )
+  {
+    if ( _strcmpi( field.Name(), "Radius" ) == 0 && field.Attribute( "value" ) )
+      fp->shape.radius = field.DoubleAttribute( "value" );
+    else if ( _strcmpi( field.Name(), "Offsets" ) == 0 && field.Attribute( "value" ) )
+    {
+      offsets.clear();
+      string data = field.Attribute( "value" );
+      vector<string> offsetstrs;
+      boost::split( offsetstrs, data, boost::is_any_of( ";" ) );
+      for ( auto& offsetstr : offsetstrs )
+      {
+        vector<string> parts;
+        boost::split( parts, offsetstr, boost::is_any_of( "," ) );
+        if ( parts.size() != 2 )
+          throw runtime_error( "CFootprint::Shape::Offsets has a non-pair entry" );
+        offsets.emplace_back( std::stod( parts[0] ), std::stod( parts[1] ) );
+      }
+    }
+    else if ( _strcmpi( field.Name(), "Borders" ) == 0 && field.Attribute( "value" ) )
+    {
+      borders.clear();
+      string data = field.Attribute( "value" );
+      vector<string> borderstrs;
+      boost::split( borderstrs, data, boost::is_any_of( ";" ) );
+      for ( auto& borderstr : borderstrs )
+      {
+        vector<string> parts;
+        boost::split( parts, borderstr, boost::is_any_of( "," ) );
+        if ( parts.size() != 3 )
+          throw runtime_error( "CFootprint::Shape::Borders has an entry with != 3 members" );
+        borders.emplace_back( std::stoul( parts[0] ), std::stoul( parts[1] ), std::stoi( parts[2] ) );
+      }
+    }
+  }
+
+  void layerStart( const CatalogElement& layer )
+  {
+    if ( !layer.Attribute( "index" ) || !boost::iequals( layer.Attribute( "index" ), "Place" ) )
+      return;
+
+    if ( layer.IntAttribute( "removed", 0 ) == 1 )
+    {
+      fp->removed = true;
+      return;
+    }
+
+    fp->removed = false;
+    inPlaceLayer = true;
+    rowsSeen = false;
+    rowsRemoved = false;
+    rowsMissingValue = false;
+    rows.clear();
+
+    if ( layer.Attribute( "Area" ) )
+    {
+      string area = layer.Attribute( "Area" );
+      vector<string> parts;
+      boost::split( parts, area, boost::is_any_of( "," ) );
+      if ( parts.size() != 4 )
+        throw runtime_error( "bad Area attribute for CFootprint::Layers" );
+
+      fp->x = atoi( parts[0].c_str() );
+      fp->y = atoi( parts[1].c_str() );
+      int rx = atoi( parts[2].c_str() );
+      int ry = atoi( parts[3].c_str() );
+      fp->w = ( rx - fp->x );
+      fp->h = ( ry - fp->y );
+    }
+  }
+
+  void layerField( const CatalogElement& field )
+  {
+    if ( strcmp( field.Name(), "Sets" ) == 0 )
+    {
+      if ( field.Attribute( "Character" ) && strlen( field.Attribute( "Character" ) ) == 1 )
+        setCharacter = field.Attribute( "Character" )[0];
+    }
+    else if ( strcmp( field.Name(), "Rows" ) == 0 )
+    {
+      if ( !rowsSeen )
+        rowsRemoved = ( field.Attribute( "removed" ) && field.IntAttribute( "removed" ) != 0 );
+      rowsSeen = true;
+      if ( field.Attribute( "value" ) )
+        rows.emplace_back( field.Attribute( "value" ) );
+      else
+      {
+        rows.emplace_back();
+        rowsMissingValue = true;
+      }
+    }
+  }
+
+  // Rows are only laid out once the whole layer is known, after all of its Sets
+  void layerEnd()
+  {
+    if ( !rowsSeen || rowsRemoved )
+      return;
+
+    // jesus christ
+    int rowcount = 0;
+    int rowwidth = 0;
+    for ( auto& row : rows )
+    {
+      if ( static_cast<int>( row.length() ) > rowwidth )
+        rowwidth = static_cast<int>( row.length() );
+      rowcount++;
+    }
+
+    if ( rowcount > fp->h )
+      fp->h = rowcount;
+    if ( rowwidth > fp->w )
+      fp->w = rowwidth;
+
+    ArenaVector<char> placement( fp->w * fp->h, 0 );
+    ArenaVector<char> creep( fp->w * fp->h, 0 );
+    ArenaVector<char> nearResources( fp->w * fp->h, 0 );
+    if ( rowsMissingValue )
+      throw runtime_error( "CFootprint::Layers::Rows without value attribute" );
+    size_t index = 0;
+    for ( auto& value : rows )
+    {
+      if ( static_cast<int>( value.length() ) > fp->w )
+        fp->w = static_cast<int>( value.length() );
+      for ( size_t c = 0; c < value.length(); c++ )
+        if ( value[c] == 'x' )
+          placement[index * fp->w + c] = 1;
+        else if ( fp->hasCreep && value[c] == fp->creepChar )
+          creep[index * fp->w + c] = 1;
+        else if ( fp->hasNearResources && value[c] == fp->nearResourcesChar )
+          nearResources[index * fp->w + c] = 1;
+      index++;
+    }
+    fp->placement = std::move( placement );
+    fp->creep = std::move( creep );
+    fp->nearResources = std::move( nearResources );
+  }
+};
+
+void parseFootprintData( const CatalogReader& reader, FootprintMap& footprints, Footprint& defaultFootprint )
+{
+  FootprintDataHandler handler( footprints, defaultFootprint );
+  auto isKnown = [&footprints]( const char* parentId ) { return footprints.find( Symbol::lookup( parentId ) ) != footprints.end(); };
+  ParentOrderHandler ordered( reader, "CFootprint", isKnown, handler );
+  reader.read( ordered );
+  ordered.finish();
+}
+
+struct AbilityDataHandler : CatalogHandler {
+  using Fields = FieldTable<AbilityDataHandler, Ability>;
+  enum InfoKind {
+    Info_None,
+    Info_TrainBuild, // CAbilTrain & CAbilBuild InfoArray
+    Info_Morph, // CAbilMorph InfoArray
+    Info_Research, // CAbilResearch InfoArray
+    Info_Merge, // CAbilMerge Info
+  };
+  AbilityMap& abilities;
+  Ability* abil; // entry being parsed, null while skipping one
+  InfoKind info; // kind of the InfoArray/Info field being parsed
+  AbilityCommand* cmd; // command the current InfoArray/Info writes to
+  bool unitsCleared; // Unit children replace the whole unit list, once per InfoArray
+  bool actorSection; // inside a SectionArray index="Actor" whose first DurationArray we have not seen yet
+  AbilityDataHandler( AbilityMap& abilities_ ):
+      abilities( abilities_ ), abil( nullptr ), info( Info_None ), cmd( nullptr ), unitsCleared( false ), actorSection( false ) {}
+
+  void elementStart( const CatalogElement& element ) override
+  {
+    if ( element.Depth() == 1 )
+      entryStart( element );
+    else if ( !abil )
+      return;
+    else if ( element.Depth() == 2 )
+      fieldStart( element );
+    else if ( element.Depth() == 3 && info != Info_None )
+      infoChild( element );
+    else if ( element.Depth() == 4 && actorSection && strcmp( element.Name(), "DurationArray" ) == 0 )
+    {
+      auto& dur = element;
+      if ( dur.Attribute( "index" ) && _stricmp( dur.Attribute( "index" ), "Delay" ) == 0 && dur.Attribute( "value" ) )
+        cmd->time = dur.DoubleAttribute( "value" );
+      actorSection = false;
+    }
+  }
+
+  void elementEnd( const CatalogElement& element ) override
+  {
+    if ( element.Depth() == 2 )
+      info = Info_None;
+    else if ( element.Depth() == 3 )
+      actorSection = false;
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    abil = nullptr;
+    auto id = entry.Attribute( "id" );
+    if ( !id )
+      return;
+
+    Symbol key( id );
+    abil = &abilities[key];
+    abil->name = key;
+    if ( _stricmp( entry.Name(), "CAbilTrain" ) == 0 )
+      abil->type = AbilType_Train;
+    else if ( _stricmp( entry.Name(), "CAbilWarpTrain" ) == 0 )
+    {
+      abil->type = AbilType_Train;
+      abil->warp = true;
+    }
+    else if ( _stricmp( entry.Name(), "CAbilMorph" ) == 0 )
+      abil->type = AbilType_Morph;
+    else if ( _stricmp( entry.Name(), "CAbilMorphPlacement" ) == 0 )
+      abil->type = AbilType_MorphPlacement;
+    else if ( _stricmp( entry.Name(), "CAbilBuild" ) == 0 )
+      abil->type = AbilType_Build;
+    else if ( _stricmp( entry.Name(), "CAbilMerge" ) == 0 )
+      abil->type = AbilType_Merge;
+    else if ( _stricmp( entry.Name(), "CAbilResearch" ) == 0 )
+      abil->type = AbilType_Research;
+
+    printf_s( "[+] ability: %s\r\n", abil->name.c_str() );
+  }
+
+  void fieldStart( const CatalogElement& field )
+  {
+    static const Fields fields = {
+      { "MorphUnit", &Fields::link<&Ability::morphUnit> },
+      { "Effect", &Fields::link<&Ability::effect> },
+      { "FlagArray", []( AbilityDataHandler&, Ability& abil, const CatalogElement& field ) { // CAbilBuild has these
+         if ( !field.Attribute( "index" ) || !field.Attribute( "value" ) )
+           return;
+         if ( _stricmp( field.Attribute( "index" ), "PeonKillFinish" ) == 0 )
+           abil.buildFinishKillsPeon = ( field.IntAttribute( "value" ) > 0 );
+         else if ( _stricmp( field.Attribute( "index" ), "Interruptible" ) == 0 )
+           abil.buildInterruptible = ( field.IntAttribute( "value" ) > 0 );
+       } },
+      { "Flags", []( AbilityDataHandler&, Ability& abil, const CatalogElement& field ) { // CAbilTrain has these
+         if ( !field.Attribute( "index" ) || !field.Attribute( "value" ) )
+           return;
+         if ( _stricmp( field.Attribute( "index" ), "KillOnFinish" ) == 0 )
+           abil.trainFinishKills = ( field.IntAttribute( "value" ) > 0 );
+         else if ( _stricmp( field.Attribute( "index" ), "KillOnCancel" ) == 0 )
+           abil.trainCancelKills = ( field.IntAttribute( "value" ) > 0 );
+       } },
+      { "InfoArray", []( AbilityDataHandler& handler, Ability&, const CatalogElement& field ) {
+         handler.infoArray( field );
+       } },
+      { "CmdButtonArray", []( AbilityDataHandler&, Ability& abil, const CatalogElement& field ) {
+         if ( abil.type != AbilType_Morph && abil.type != AbilType_MorphPlacement )
+           return;
+         if ( !field.Attribute( "index" ) || _stricmp( field.Attribute( "index" ), "Execute" ) != 0 || !field.Attribute( "Requirements" ) )
+           return;
+         if ( abil.commands.find( "Execute" ) == abil.commands.end() )
+           abil.commands["Execute"] = AbilityCommand( "Execute" );
+         abil.commands["Execute"].requirements = Symbol( field.Attribute( "Requirements" ) );
+       } },
+      { "Info", []( AbilityDataHandler& handler, Ability& abil, const CatalogElement& field ) {
+         if ( abil.type == AbilType_Merge )
+           handler.mergeInfo( field );
+       } },
+    };
+    info = Info_None;
+    fields.apply( *this, *abil, field );
+  }
+
+  void infoArray( const CatalogElement& field )
+  {
+    auto idx = field.Attribute( "index" );
+    if ( ( abil->type == AbilType_Train || abil->type == AbilType_Build ) && idx ) // for CAbilTrain & CAbilBuild
+    {
+      if ( abil->commands.find( idx ) == abil->commands.end() )
+        abil->commands[idx] = AbilityCommand( idx );
+
+      cmd = &abil->commands[idx];
+      if ( field.Attribute( "Time" ) )
+        cmd->time = field.DoubleAttribute( "Time" );
+
+      auto unit = field.Attribute( "Unit" );
+      if ( unit )
+        cmd->units.emplace_back( unit );
+
+      // Unit/Button children are handled by infoChild()
+      info = Info_TrainBuild;
+      unitsCleared = false;
+    }
+    else if ( ( abil->type == AbilType_Morph || abil->type == AbilType_MorphPlacement ) && field.Attribute( "Unit" ) ) // for CAbilMorph
+    {
+      // Note: current implementation misses CAbilMorphs and others that descend from a "parent" (attribute in AbilData.xml)
+      // this includes at least TerranBuildingLiftOff, DisguiseChangeling and such
+      if ( abil->commands.find( "Execute" ) == abil->commands.end() )
+        abil->commands["Execute"] = AbilityCommand( "Execute" );
+
+      cmd = &abil->commands["Execute"];
+      cmd->units.emplace_back( field.Attribute( "Unit" ) );
+
+      // SectionArray children are handled by infoChild()
+      info = Info_Morph;
+    }
+    else if ( abil->type == AbilType_Research && field.Attribute( "Upgrade" ) ) // for CAbilResearch
+    {
+      if ( strlen( field.Attribute( "Upgrade" ) ) < 1 )
+      {
+        auto it = abil->commands.find( idx );
+        if ( it != abil->commands.end() )
+          abil->commands.erase( it );
+      }
+      else
+      {
+        if ( abil->commands.find( idx ) == abil->commands.end() )
+          abil->commands[idx] = AbilityCommand( idx );
+
+        cmd = &abil->commands[idx];
+        if ( field.Attribute( "Time" ) )
+          cmd->time = field.DoubleAttribute( "Time" );
+
+        cmd->isUpgrade = true;
+        cmd->upgrade = Symbol( field.Attribute( "Upgrade" ) );
+
+        // Resource/Button children are handled by infoChild()
+        info = Info_Research;
+      }
+    }
+  }
+
+  void mergeInfo( const CatalogElement& field )
+  {
+    // archon merge, kinda hardcoded hack
+
+    if ( abil->commands.find( "SelectedUnits" ) == abil->commands.end() )
+      abil->commands["SelectedUnits"] = AbilityCommand( "SelectedUnits" );
+
+    cmd = &abil->commands["SelectedUnits"];
+
+    // Resource/Button children are handled by infoChild()
+    info = Info_Merge;
+
+    if ( field.Attribute( "Unit" ) )
+    {
+      cmd->units.emplace_back( field.Attribute( "Unit" ) );
+      abil->morphUnit = Symbol( field.Attribute( "Unit" ) );
+    }
+    if ( field.Attribute( "Time" ) )
+      cmd->time = field.DoubleAttribute( "Time" );
+  }
+
+  void infoChild( const CatalogElement& sub )
+  {
+    if ( info == Info_TrainBuild )
+    {
+      if ( strcmp( sub.Name(), "Unit" ) == 0 && !unitsCleared )
+      {
+        cmd->units.clear();
+        unitsCleared = true;
+      }
+      if ( _strcmpi( sub.Name(), "Unit" ) == 0 && sub.Attribute( "value" ) )
+        cmd->units.emplace_back( sub.Attribute( "value" ) );
+      else if ( _strcmpi( sub.Name(), "Button" ) == 0 && sub.Attribute( "Requirements" ) )
+        cmd->requirements = Symbol( sub.Attribute( "Requirements" ) );
+    }
+    else if ( info == Info_Morph )
+    {
+      if ( strcmp( sub.Name(), "SectionArray" ) == 0 && sub.Attribute( "index" ) && _stricmp( sub.Attribute( "index" ), "Actor" ) == 0 )
+        actorSection = true;
+    }
+    else if ( info == Info_Research || info == Info_Merge )
+    {
+      if ( _strcmpi( sub.Name(), "Resource" ) == 0 && sub.Attribute( "index" ) && _stricmp( sub.Attribute( "index" ), "Minerals" ) == 0 && sub.Attribute( "value" ) )
+        cmd->mineralCost = sub.Int64Attribute( "value" );
+      else if ( _strcmpi( sub.Name(), "Resource" ) == 0 && sub.Attribute( "index" ) && _stricmp( sub.Attribute( "index" ), "Vespene" ) == 0 && sub.Attribute( "value" ) )
+        cmd->vespeneCost = sub.Int64Attribute( "value" );
+      else if ( _strcmpi( sub.Name(), "Button" ) == 0 && sub.Attribute( "Requirements" ) )
+        cmd->requirements = Symbol( sub.Attribute( "Requirements" ) );
+    }
+  }
+};
+
+void parseAbilityData( const CatalogReader& reader, AbilityMap& abilities )
+{
+  AbilityDataHandler handler( abilities );
+  reader.read( handler );
+}
+
+struct UpgradeDataHandler : CatalogHandler {
+  UpgradeMap& upgrades;
+  Upgrade& defaultUpgrade;
+  Upgrade* upgrade; // entry being parsed, null while skipping one
+  UpgradeDataHandler( UpgradeMap& upgrades_, Upgrade& defaultUpgrade_ ):
+      upgrades( upgrades_ ), defaultUpgrade( defaultUpgrade_ ), upgrade( nullptr ) {}
+
+  void elementStart( const CatalogElement& field ) override
+  {
+    if ( field.Depth() == 1 )
+      entryStart( field );
+    else if ( field.Depth() == 2 && upgrade )
+      fieldStart( field );
+  }
+
+  void entryStart( const CatalogElement& entry )
+  {
+    upgrade = nullptr;
+    bool isDefault = ( entry.Attribute( "default" ) && entry.Int64Attribute( "default" ) == 1 && !entry.Attribute( "id" ) );
+    auto id = entry.Attribute( "id" );
+    if ( !id && !isDefault )
+      return;
+
+    Symbol key( id );
+    if ( !isDefault && upgrades.find( key ) == upgrades.end() )
+      upgrades[key] = defaultUpgrade;
+
+    upgrade = ( isDefault ? &defaultUpgrade : &upgrades[key] );
+    if ( !isDefault )
+    {
+      upgrade->name = key;
+      printf_s( "[+] upgrade: %s\r\n", upgrade->name.c_str() );
+    }
+  }
+
+  void fieldStart( const CatalogElement& field )
+  {
+    if ( _strcmpi( field.Name(), "Race" ) == 0 )
+      upgrade->race = raceToEnum( field.Attribute( "value" ) );
+    else if ( _strcmpi( field.Name(), "EffectArray" ) == 0 )
+    {
+      EffectArrayEntry entry;
+      auto operation = field.Attribute( "Operation" );
+      if ( operation )
+        entry.operation = operation;
+      else
+        entry.operation = "Add";
+      auto reference = field.Attribute( "Reference" );
+      if ( !reference )
+        return;
+      string referenceStr( reference );
+      vector<string> referenceParts;
+      boost::split( referenceParts, referenceStr, boost::is_any_of( "," ) );
+      if ( referenceParts.size() != 3 )
+        return;
+      entry.referenceType = referenceParts[0];
+      entry.referenceId = referenceParts[1];
+      entry.referenceAttribute = referenceParts[2];
+      auto value = field.Attribute( "Value" );
+      if ( !value )
+        return;
+      entry.value = value;
+      upgrade->effectArray.push_back( entry );
+    }
+  }
+};
+
+void parseUpgradeData( const CatalogReader& reader, UpgradeMap& upgrades, Upgrade& defaultUpgrade )
+{
+  UpgradeDataHandler handler( upgrades, defaultUpgrade );
+  reader.read( handler );
+}
+
+const char* raceStr( Race race )
+{
+  if ( race == Race_Terran )
+    return "terran";
+  else if ( race == Race_Zerg )
+    return "zerg";
+  else if ( race == Race_Protoss )
+    return "protoss";
+  else
+    return "neutral";
+}
+
+const char* resourceStr( ResourceType type )
+{
+  if ( type == Resource_Minerals )
+    return "minerals";
+  else if ( type == Resource_Vespene )
+    return "vespene";
+  else if ( type == Resource_Terrazine )
+    return "terrazine";
+  else if ( type == Resource_Custom )
+    return "custom";
+  else
+    return "";
+}
+
+const char* abilTypeStr( AbilType type )
+{
+  if ( type == AbilType_Build )
+    return "build";
+  else if ( type == AbilType_Morph || type == AbilType_MorphPlacement )
+    return "morph";
+  else if ( type == AbilType_Train )
+    return "train";
+  else if ( type == AbilType_Research )
+    return "research";
+  else
+    return "";
+}
+
+// Writes JSON laid out byte for byte like Json::StreamWriterBuilder with two-space
+// indentation and no comments, without building a Json::Value tree first. An object is
+// held as text until it ends, because its members come out sorted by key and a later
+// member replaces an earlier one with the same key, as in a Json::Value. A streamed object
+// writes each member out as soon as it is complete instead; its members have to be given
+// in key order, and that is what keeps a dump down to about one entity in memory.
+class JsonWriter
+{
+public:
+  explicit JsonWriter( std::ostream& out ):
+      out_( out ) {}
+
+  // names the next value; only inside objects
+  JsonWriter& key( const string& name )
+  {
+    key_ = name;
+    return *this;
+  }
+
+  void beginObject()
+  {
+    push( Frame_Object );
+  }
+
+  void beginArray()
+  {
+    push( Frame_Array );
+  }
+
+  // Only at the top or inside another streamed object. An empty streamed root is written
+  // as null, like the Json::Value root that was never assigned to.
+  void beginStream()
+  {
+    push( Frame_Stream );
+  }
+
+  void end()
+  {
+    Frame frame = std::move( frames_.back() );
+    frames_.pop_back();
+    if ( frame.type == Frame_Stream )
+    {
+      if ( frame.written > 0 )
+        out_ << '\n' << indent( frame.depth ) << '}';
+      else if ( frames_.empty() )
+        out_ << "null";
+      else
+      {
+        key_ = frame.key;
+        add( "{}", false, false );
+      }
+    }
+    else if ( frame.members.empty() )
+    {
+      key_ = frame.key;
+      add( frame.type == Frame_Object ? "{}" : "[]", false, false );
+    }
+    else if ( frame.type == Frame_Object )
+    {
+      auto& members = frame.members;
+      std::stable_sort( members.begin(), members.end(), []( const Member& a, const Member& b ) { return a.key < b.key; } );
+      string text = "{";
+      for ( size_t i = 0; i < members.size(); i++ )
+      {
+        if ( i + 1 < members.size() && members[i + 1].key == members[i].key )
+          continue;
+        if ( text.size() > 1 )
+          text += ',';
+        text += '\n' + indent( frame.depth + 1 ) + Json::valueToQuotedString( members[i].key.c_str() ) + " : ";
+        if ( members[i].ownLine )
+          text += '\n' + indent( frame.depth + 1 );
+        text += members[i].text;
+      }
+      text += '\n' + indent( frame.depth ) + '}';
+      key_ = frame.key;
+      add( text, true, true );
+    }
+    else
+    {
+      auto& members = frame.members;
+      bool multiline = members.size() * 3 >= rightMargin;
+      size_t length = 4 + ( members.size() - 1 ) * 2;
+      for ( auto& member : members )
+      {
+        multiline = multiline || member.container;
+        length += member.text.size();
+      }
+      string text;
+      if ( multiline || length >= rightMargin )
+      {
+        text = "[";
+        for ( size_t i = 0; i < members.size(); i++ )
+          text += ( i > 0 ? ",\n" : "\n" ) + indent( frame.depth + 1 ) + members[i].text;
+        text += '\n' + indent( frame.depth ) + ']';
+        multiline = true;
+      }
+      else
+      {
+        text = "[ ";
+        for ( size_t i = 0; i < members.size(); i++ )
+          text += ( i > 0 ? ", " : "" ) + members[i].text;
+        text += " ]";
+      }
+      key_ = frame.key;
+      add( text, true, multiline );
+    }
+  }
+
+  // the scalar types a Json::Value told apart
+  void value( const string& text )
+  {
+    add( Json::valueToQuotedString( text.c_str() ), false, false );
+  }
+
+  void value( const char* text )
+  {
+    add( Json::valueToQuotedString( text ), false, false );
+  }
+
+  void value( double number )
+  {
+    add( Json::valueToString( number ), false, false );
+  }
+
+  void value( int number )
+  {
+    add( Json::valueToString( static_cast<Json::LargestInt>( number ) ), false, false );
+  }
+
+  void value( Json::UInt64 number )
+  {
+    add( Json::valueToString( static_cast<Json::LargestUInt>( number ) ), false, false );
+  }
+
+  void value( bool flag )
+  {
+    add( Json::valueToString( flag ), false, false );
+  }
+
+private:
+  static const size_t rightMargin = 74; // as in jsoncpp, past which an array of scalars is split into lines
+
+  enum FrameType {
+    Frame_Object,
+    Frame_Array,
+    Frame_Stream
+  };
+
+  struct Member {
+    string key;
+    string text;
+    bool container; // non-empty object or array
+    bool ownLine; // starts on a line of its own after its key
+  };
+
+  struct Frame {
+    FrameType type;
+    string key; // in the enclosing object
+    size_t depth;
+    vector<Member> members;
+    size_t written; // members of a streamed object written out so far
+  };
+
+  static string indent( size_t depth )
+  {
+    return string( depth * 2, ' ' );
+  }
+
+  void push( FrameType type )
+  {
+    frames_.push_back( Frame{ type, key_, frames_.size(), {}, 0 } );
+    key_.clear();
+  }
+
+  void add( const string& text, bool container, bool ownLine )
+  {
+    if ( frames_.empty() )
+      out_ << text;
+    else if ( frames_.back().type == Frame_Stream )
+      stream( frames_.size() - 1, key_, text, ownLine );
+    else
+      frames_.back().members.push_back( Member{ key_, text, container, ownLine } );
+    key_.clear();
+  }
+
+  // writes out the opening of a streamed object and of the streamed objects around it
+  void open( size_t index )
+  {
+    auto& frame = frames_[index];
+    if ( frame.written > 0 )
+      return;
+    if ( index == 0 )
+      out_ << '{';
+    else
+    {
+      head( index - 1, frame.key );
+      out_ << '\n' << indent( frame.depth ) << '{';
+    }
+  }
+
+  // writes out the key of the next member of a streamed object
+  void head( size_t index, const string& name )
+  {
+    open( index );
+    auto& frame = frames_[index];
+    if ( frame.written++ > 0 )
+      out_ << ',';
+    out_ << '\n' << indent( frame.depth + 1 ) << Json::valueToQuotedString( name.c_str() ) << " : ";
+  }
+
+  void stream( size_t index, const string& name, const string& text, bool ownLine )
+  {
+    head( index, name );
+    if ( ownLine )
+      out_ << '\n' << indent( frames_[index].depth + 1 );
+    out_ << text;
+  }
+
+  std::ostream& out_;
+  vector<Frame> frames_;
+  string key_;
+};
+
+void jsonPolyvecWrite( const PolygonVector& polyvec, JsonWriter& out )
+{
+  out.beginArray();
+  for ( auto& poly : polyvec )
+  {
+    out.beginArray();
+    for ( auto& pt : poly )
+    {
+      out.beginArray();
+      out.value( pt.x );
+      out.value( pt.y );
+      out.end();
+    }
+    out.end();
+  }
+  out.end();
+}
+
+void resolveFootprint( Symbol name, FootprintMap& footprints, JsonWriter& out )
+{
+  out.beginObject();
+  auto it = footprints.find( name );
+  if ( name.empty() || it == footprints.end() )
+  {
+    out.end();
+    return;
+  }
+
+  auto& fp = it->second;
+
+  out.key( "name" ).value( fp.id.str() );
+
+  out.key( "shape" ).beginObject();
+  out.key( "radius" ).value( fp.shape.radius );
+  jsonPolyvecWrite( fp.shape.unpathablePolys, out.key( "unpathable" ) );
+  jsonPolyvecWrite( fp.shape.buildingPolys, out.key( "building" ) );
+  out.end();
+
+  out.key( "offset" ).beginArray();
+  out.value( fp.x );
+  out.value( fp.y );
+  out.end();
+
+  out.key( "dimensions" ).beginArray();
+  out.value( fp.w );
+  out.value( fp.h );
+  out.end();
+
+  string data;
+  for ( int y = 0; y < fp.h; y++ )
+    for ( int x = 0; x < fp.w; x++ )
+    {
+      auto idx = y * fp.w + x;
+      data.append( ( fp.placement[idx] ? "x" : fp.creep[idx] ? "o" : fp.nearResources[idx] ? "n" : "." ) );
+    }
+  out.key( "data" ).value( data );
+  out.end();
+}
+
+void dumpUnits( UnitMap& units, FootprintMap& footprints )
+{
+  printf_s( "[d] dumping units...\r\n" );
+
+  ofstream out;
+  out.open( "units.json" );
+
+  // keyed by id, so a later unit with the same id replaces an earlier one
+  std::map<string, const UnitMap::value_type*> rows;
+  for ( auto entry : byName( units ) )
+    if ( entry->second.lifeStart != 0 || entry->second.lifeMax != 0 )
+      rows[std::to_string( stableID( g_unitMapping, entry->second.name ) )] = entry;
+
+  JsonWriter json( out );
+  json.beginStream();
+  for ( auto& row : rows )
+  {
+    auto& unit = *row.second;
+
+    json.key( row.first ).beginObject();
+    json.key( "name" ).value( unit.second.name.str() );
+
+    json.key( "race" ).value( raceStr( unit.second.race ) );
+    json.key( "food" ).value( unit.second.food );
+
+    json.key( "mineralCost" ).value( static_cast<Json::UInt64>( unit.second.mineralCost ) );
+    json.key( "vespeneCost" ).value( static_cast<Json::UInt64>( unit.second.vespeneCost ) );
+
+    json.key( "speed" ).value( unit.second.speed );
+    json.key( "acceleration" ).value( unit.second.acceleration );
+    json.key( "speedMultiplierCreep" ).value( unit.second.speedMultiplierCreep );
+
+    json.key( "radius" ).value( unit.second.radius );
+    json.key( "sight" ).value( unit.second.sight );
+
+    json.key( "lifeStart" ).value( unit.second.lifeStart );
+    json.key( "lifeMax" ).value( unit.second.lifeMax );
+    json.key( "lifeRegenRate" ).value( unit.second.lifeRegenRate );
+    json.key( "lifeArmor" ).value( static_cast<Json::UInt64>( unit.second.lifeArmor ) );
+    json.key( "shieldsStart" ).value( unit.second.shieldsStart );
+    json.key( "shieldsMax" ).value( unit.second.shieldsMax );
+
+    json.key( "energyStart" ).value( unit.second.energyStart );
+    json.key( "energyMax" ).value( unit.second.energyMax );
+    json.key( "energyRegenRate" ).value( unit.second.energyRegenRate );
+
+    json.key( "light" ).value( unit.second.light );
+    json.key( "biological" ).value( unit.second.biological );
+    json.key( "mechanical" ).value( unit.second.mechanical );
+    json.key( "armored" ).value( unit.second.armored );
+    json.key( "structure" ).value( unit.second.structure );
+    json.key( "psionic" ).value( unit.second.psionic );
+    json.key( "massive" ).value( unit.second.massive );
+    json.key( "cargoSize" ).value( static_cast<Json::UInt64>( unit.second.cargoSize ) );
+    json.key( "turningRate" ).value( unit.second.turningRate );
+
+    json.key( "shieldRegenDelay" ).value( unit.second.shieldRegenDelay );
+    json.key( "shieldRegenRate" ).value( unit.second.shieldRegenRate );
+    json.key( "mover" ).value( unit.second.mover );
+
+    json.key( "scoreMake" ).value( static_cast<Json::UInt64>( unit.second.scoreMake ) );
+    json.key( "scoreKill" ).value( static_cast<Json::UInt64>( unit.second.scoreKill ) );
+
+    json.key( "collides" ).beginArray();
+    for ( auto& c : unit.second.collides )
+      json.value( c );
+    json.end();
+
+    json.key( "attackTargetPriority" ).value( unit.second.attackTargetPriority );
+    json.key( "stationaryTurningRate" ).value( unit.second.stationaryTurningRate );
+    json.key( "lateralAcceleration" ).value( unit.second.lateralAcceleration );
+
+    json.key( "techAlias" ).beginArray();
+    for ( auto& a : unit.second.techAliases )
+      if ( !a.empty() )
+        json.value( a.str() );
+    json.end();
+
+    json.key( "aiEvalFactor" ).value( unit.second.aiEvalFactor );
+
+    string evalAs = unit.second.aiEvaluateAlias;
+    boost::replace_all( evalAs, "##id##", unit.second.name.str() );
+    if ( !evalAs.empty() )
+    {
+      auto evalid = stableID( g_unitMapping, Symbol::lookup( evalAs ) );
+      if ( evalid != 0 && evalid != stableID( g_unitMapping, unit.second.name ) )
+        json.key( "aiEvaluateAs" ).value( static_cast<Json::UInt64>( evalid ) );
+      if ( !boost::iequals( unit.second.name.str(), evalAs ) )
+        json.key( "aiEvaluateAsName" ).value( evalAs );
+    }
+
+    string glosAl = unit.second.glossaryAlias;
+    boost::replace_all( glosAl, "##id##", unit.second.name.str() );
+    if ( !glosAl.empty() )
+    {
+      auto glosid = stableID( g_unitMapping, Symbol::lookup( glosAl ) );
+      if ( glosid != 0 && glosid != stableID( g_unitMapping, unit.second.name ) )
+        json.key( "glossaryAlias" ).value( static_cast<Json::UInt64>( glosid ) );
+      if ( !boost::iequals( unit.second.name.str(), glosAl ) )
+        json.key( "glossaryAliasName" ).value( glosAl );
+    }
+
+    json.key( "planes" ).beginArray();
+    for ( auto& c : unit.second.planeArray )
+      json.value( c );
+    json.end();
+
+    resolveFootprint( unit.second.footprint, footprints, json.key( "footprint" ) );
+
+    json.key( "resource" ).beginArray();
+    if ( unit.second.resourceType != Resource_None )
+    {
+      json.value( resourceStr( unit.second.resourceType ) );
+      json.value( unit.second.resourceHarvestable ? "harvestable" : "raw" );
+    }
+    json.end();
+    json.key( "invulnerable" ).value( unit.second.invulnerable );
+
+    json.key( "weapons" ).beginArray();
+    for ( auto& weapon : unit.second.weapons )
+      json.value( weapon.str() );
+    json.end();
+
+    json.key( "abilityCommands" ).beginArray();
+    //for ( auto& abil : unit.second.abilityCommands )
+    //  json.value( abil );
+    for ( auto& card : unit.second.abilityCardsMap )
+      if ( !card.second.removed )
+        for ( auto& abil : card.second.commands )
+          if ( !abil.second.empty() )
+            json.value( abil.second.str() );
+    json.end();
+
+    json.end();
+  }
+  json.end();
+
+  out.close();
+}
+
+// Tech aliases as classes of units, for the requirements that count them. Every alias
+// (Alias_SiegeTank, ...) is the class of the units that declare it in TechAliasArray, and
+// every other unit a requirement counts is a class of its own. Aliases overlap (Lair is
+// both an Alias_Hatchery and an Alias_Lair), so a unit can be in more than one class.
+// Built once the catalogs are merged; after that finding the class of a link and the
+// classes of a unit are both an index by symbol id, and members are a run of members_.
+const uint32_t noAliasClass = UINT32_MAX;
+
+class AliasClasses
+{
+public:
+  struct Class {
+    Symbol name;
+    uint32_t first; // into members_, sorted by name
+    uint32_t count;
+  };
+
+  template <class T>
+  struct Run {
+    const T* first;
+    const T* last;
+    const T* begin() const { return first; }
+    const T* end() const { return last; }
+    size_t size() const { return static_cast<size_t>( last - first ); }
+  };
+
+  void build( const AliasMap& aliases, const RequirementNodeMap& nodes )
+  {
+    std::map<Symbol, SymbolSet, SymbolNameLess> sets;
+    for ( auto& alias : aliases )
+      sets[alias.first] = alias.second;
+    for ( auto& node : nodes )
+      if ( node.second.type == ReqNode_CountUnit && !sets.count( node.second.countLink ) )
+        sets[node.second.countLink].insert( node.second.countLink );
+
+    classes_.clear();
+    members_.clear();
+    uint32_t maxSymbol = 0;
+    for ( auto& set : sets )
+    {
+      Class cls = { set.first, static_cast<uint32_t>( members_.size() ), static_cast<uint32_t>( set.second.size() ) };
+      classes_.push_back( cls );
+      maxSymbol = std::max( maxSymbol, set.first.id() );
+      for ( auto member : set.second )
+      {
+        members_.push_back( member );
+        maxSymbol = std::max( maxSymbol, member.id() );
+      }
+    }
+
+    classOf_.assign( maxSymbol + 1, noAliasClass );
+    vector<vector<uint32_t>> memberOf( maxSymbol + 1 );
+    for ( uint32_t i = 0; i < classes_.size(); i++ )
+    {
+      classOf_[classes_[i].name.id()] = i;
+      for ( auto& member : members( i ) )
+        memberOf[member.id()].push_back( i );
+    }
+    unitClasses_.clear();
+    unitBegins_.assign( maxSymbol + 2, 0 );
+    for ( uint32_t id = 0; id <= maxSymbol; id++ )
+    {
+      unitBegins_[id] = static_cast<uint32_t>( unitClasses_.size() );
+      unitClasses_.insert( unitClasses_.end(), memberOf[id].begin(), memberOf[id].end() );
+    }
+    unitBegins_[maxSymbol + 1] = static_cast<uint32_t>( unitClasses_.size() );
+  }
+
+  // the class a CountUnit link counts, noAliasClass for links no requirement has
+  uint32_t find( Symbol link ) const
+  {
+    return ( link.id() < classOf_.size() ? classOf_[link.id()] : noAliasClass );
+  }
+
+  const vector<Class>& classes() const
+  {
+    return classes_;
+  }
+
+  Run<Symbol> members( uint32_t cls ) const
+  {
+    auto first = members_.data() + classes_[cls].first;
+    return { first, first + classes_[cls].count };
+  }
+
+  // the classes unit is counted in
+  Run<uint32_t> classesOf( Symbol unit ) const
+  {
+    if ( unit.id() + 1 >= unitBegins_.size() )
+      return { nullptr, nullptr };
+    auto base = unitClasses_.data();
+    return { base + unitBegins_[unit.id()], base + unitBegins_[unit.id() + 1] };
+  }
+
+private:
+  vector<Class> classes_; // by name
+  vector<Symbol> members_;
+  vector<uint32_t> classOf_; // by symbol id
+  vector<uint32_t> unitBegins_; // by symbol id, into unitClasses_
+  vector<uint32_t> unitClasses_;
+};
+
+AliasClasses g_aliasClasses;
+
+const uint32_t noRequirement = UINT32_MAX;
+
+// Every requirement node the abilities refer to, resolved once and numbered in the order
+// they are first reached, operands before the nodes that use them. Both JSON layouts are
+// written from it: nested, with each tree spelled out wherever it is used, and shared
+// (--shared-requirements), where requirements.json holds every node once and the other
+// outputs refer to the nodes by index. Built once the catalogs are merged, read-only after.
+class RequirementGraph
+{
+public:
+  RequirementGraph():
+      requirements_( nullptr ), nodes_( nullptr ) {}
+
+  struct Node {
+    Symbol name;
+    const RequirementNode* node; // null for numerals
+    vector<uint32_t> operands; // the ones that resolve
+  };
+
+  void build( AbilityMap& abilities, RequirementMap& requirements, RequirementNodeMap& nodes )
+  {
+    requirements_ = &requirements;
+    nodes_ = &nodes;
+    for ( auto abil : byName( abilities ) )
+      for ( auto& cmd : abil->second.commands )
+        for ( auto name : rootNames( cmd.second.requirements ) )
+          resolve( name );
+  }
+
+  // the trees a requirement is made of, its use and show nodes, as indices of nodes()
+  vector<uint32_t> roots( Symbol reqstr ) const
+  {
+    vector<uint32_t> roots;
+    for ( auto name : rootNames( reqstr ) )
+    {
+      auto it = index_.find( name );
+      if ( it != index_.end() && it->second != noRequirement )
+        roots.push_back( it->second );
+    }
+    return roots;
+  }
+
+  const vector<Node>& nodes() const
+  {
+    return resolved_;
+  }
+
+  // one node with its operands written out, or with their indices when shared
+  void write( uint32_t index, JsonWriter& out, bool shared ) const
+  {
+    auto& entry = resolved_[index];
+    out.beginObject();
+    if ( shared )
+      out.key( "name" ).value( entry.name.str() );
+    if ( !entry.node )
+    {
+      out.key( "type" ).value( "value" );
+      out.key( "value" ).value( atoi( entry.name.c_str() ) );
+      out.end();
+      return;
+    }
+    auto& node = *entry.node;
+    if ( isLogic( node ) )
+    {
+      out.key( "type" ).value( node.type == ReqNode_LogicAnd ? "and" : node.type == ReqNode_LogicOr ? "or" : node.type == ReqNode_LogicEq ? "eq" : "not" );
+      out.key( "operands" ).beginArray();
+      for ( auto op : entry.operands )
+        if ( shared )
+          out.value( static_cast<Json::UInt64>( op ) );
+        else
+          write( op, out, false );
+      out.end();
+    }
+    else
+    {
+      out.key( "type" ).value( node.type == ReqNode_CountUnit ? "unitCount" : "upgradeCount" );
+      if ( node.type == ReqNode_CountUnit )
+      {
+        auto aliases = g_aliasClasses.members( g_aliasClasses.find( node.countLink ) );
+        out.key( "unitName" ).beginArray();
+        for ( auto& name : aliases )
+          out.value( name.str() );
+        out.end();
+        out.key( "unit" ).beginArray();
+        for ( auto& name : aliases )
+          out.value( static_cast<Json::UInt64>( stableID( g_unitMapping, name ) ) );
+        out.end();
+      }
+      else
+      {
+        out.key( "upgradeName" ).value( node.countLink.str() );
+        out.key( "upgrade" ).value( static_cast<Json::UInt64>( stableID( g_upgradeMapping, node.countLink ) ) );
+      }
+      if ( !node.countState.empty() )
+        out.key( "state" ).value( node.countState );
+    }
+    out.end();
+  }
+
+private:
+  static bool isLogic( const RequirementNode& node )
+  {
+    return node.type == ReqNode_LogicAnd || node.type == ReqNode_LogicOr || node.type == ReqNode_LogicEq || node.type == ReqNode_LogicNot;
+  }
+
+  vector<Symbol> rootNames( Symbol reqstr ) const
+  {
+    vector<Symbol> names;
+    if ( reqstr.empty() )
+      return names;
+    auto req = requirements_->find( reqstr );
+    if ( req != requirements_->end() )
+    {
+      if ( !req->second.useNodeName.empty() )
+        names.push_back( req->second.useNodeName );
+      if ( !req->second.showNodeName.empty() )
+        names.push_back( req->second.showNodeName );
+    }
+    else
+      names.push_back( reqstr );
+    return names;
+  }
+
+  // noRequirement for nodes that resolve to nothing: unknown types, and logic without operands
+  uint32_t resolve( Symbol name )
+  {
+    auto known = index_.find( name );
+    if ( known != index_.end() )
+      return known->second;
+
+    Node entry = { name, nullptr, {} };
+    auto it = nodes_->find( name );
+    if ( it != nodes_->end() && name.str().size() >= 5 ) // shorter names are numerals
+    {
+      auto& node = it->second;
+      if ( node.type == ReqNode_Unknown || ( isLogic( node ) && node.operands.empty() ) )
+        return index_[name] = noRequirement;
+      entry.node = &node;
+      for ( auto& op : node.operands )
+      {
+        auto opIndex = resolve( op.second );
+        if ( opIndex != noRequirement )
+          entry.operands.push_back( opIndex );
+      }
+    }
+    resolved_.push_back( std::move( entry ) );
+    return index_[name] = static_cast<uint32_t>( resolved_.size() - 1 );
+  }
+
+  RequirementMap* requirements_;
+  RequirementNodeMap* nodes_;
+  SymbolMap<uint32_t> index_;
+  vector<Node> resolved_;
+};
+
+RequirementGraph g_requirementGraph;
+bool g_sharedRequirements = false;
+
+// The slot of an ability command in stableid.json, which numbers them "ability,slot":
+// Execute (morphs) and anything without a number is 0, BuildN, TrainN and ResearchN are
+// N - 1. Commands whose number does not parse get none, so they never resolve.
+const uint32_t noCommandSlot = UINT32_MAX;
+
+inline uint32_t abilityCommandSlot( const string& command )
+{
+  auto numbered = [&command]( const char* prefix, size_t length ) {
+    return command.size() > length && boost::istarts_with( command, prefix );
+  };
+  size_t length = 0;
+  if ( numbered( "Build", 5 ) || numbered( "Train", 5 ) )
+    length = 5;
+  else if ( numbered( "Research", 8 ) )
+    length = 8;
+  else
+    return 0;
+  int number = atoi( command.c_str() + length );
+  return ( number > 0 ? static_cast<uint32_t>( number - 1 ) : noCommandSlot );
+}
+
+// Stable ids of every ability command in the catalog, resolved once so that the outputs
+// look them up by ability symbol and command slot instead of formatting "ability,slot"
+// and hashing it. Each ability owns a run of ids_, one per slot up to its highest, with 0
+// for the slots stableid.json has nothing for; the commands that got 0 are kept in
+// misses() so they can be reported.
+class AbilityCommandTable
+{
+public:
+  void build( AbilityMap& abilities, const NameToIDMapping& mapping )
+  {
+    ids_.clear();
+    misses_.clear();
+    uint32_t maxSymbol = 0;
+    for ( auto& abil : abilities )
+      maxSymbol = std::max( maxSymbol, abil.first.id() );
+    begins_.assign( maxSymbol + 1, 0 );
+    ends_.assign( maxSymbol + 1, 0 );
+
+    string key;
+    for ( auto& abil : byName( abilities ) )
+    {
+      uint32_t slots = 0;
+      for ( auto& cmd : abil->second.commands )
+      {
+        auto slot = abilityCommandSlot( cmd.second.index );
+        if ( slot != noCommandSlot && slot >= slots && slot < maxSlots )
+          slots = slot + 1;
+      }
+      auto begin = static_cast<uint32_t>( ids_.size() );
+      begins_[abil->first.id()] = begin;
+      ids_.resize( begin + slots, 0 );
+
+      for ( auto& cmd : abil->second.commands )
+      {
+        auto slot = abilityCommandSlot( cmd.second.index );
+        if ( slot < slots && ids_[begin + slot] == 0 )
+        {
+          key = abil->first.str();
+          key += ',';
+          key += std::to_string( slot );
+          ids_[begin + slot] = stableID( mapping, Symbol::lookup( key ) );
+        }
+        if ( slot >= slots || ids_[begin + slot] == 0 )
+          misses_.push_back( abil->first.str() + "," + cmd.second.index );
+      }
+      ends_[abil->first.id()] = static_cast<uint32_t>( ids_.size() );
+    }
+  }
+
+  uint32_t resolve( Symbol ability, uint32_t slot ) const
+  {
+    auto id = ability.id();
+    if ( id >= ends_.size() )
+      return 0;
+    auto index = static_cast<uint64_t>( begins_[id] ) + slot;
+    return ( index < ends_[id] ? ids_[static_cast<size_t>( index )] : 0 );
+  }
+
+  uint32_t resolve( Symbol ability, const string& command ) const
+  {
+    return resolve( ability, abilityCommandSlot( command ) );
+  }
+
+  const vector<string>& misses() const
+  {
+    return misses_;
+  }
+
+private:
+  static const uint32_t maxSlots = 256; // nothing in the game comes close
+
+  vector<uint32_t> begins_; // the run of each ability in ids_, by ability symbol id
+  vector<uint32_t> ends_;
+  vector<uint32_t> ids_;
+  vector<string> misses_;
+};
+
+AbilityCommandTable g_abilityCommands;
+
+void filtersToJSON( const FilterSet& attribs, JsonWriter& out )
+{
+  out.beginArray();
+  for ( const auto& tk : attribs )
+  {
+    if ( tk == Search_Ground )
+      out.value( "ground" );
+    if ( tk == Search_Structure )
+      out.value( "structure" );
+    if ( tk == Search_Self )
+      out.value( "self" );
+    if ( tk == Search_Player )
+      out.value( "player" );
+    if ( tk == Search_Ally )
+      out.value( "ally" );
+    if ( tk == Search_Air )
+      out.value( "air" );
+    if ( tk == Search_Stasis )
+      out.value( "stasis" );
+  }
+  out.end();
+};
+
+const uint32_t noEffect = UINT32_MAX;
+
+// Every effect the weapons lead to, resolved once into a table of nodes with the links
+// between them as edges. An effect link may contain ##id##, which stands for the effect
+// (or weapon) that has the link, so links are resolved per (owner, link) pair and each
+// pair only once. The table is filled depth first from the weapons in name order; a
+// link back to an effect that is still being resolved closes a cycle, and is kept out of
+// the edges (and so out of weapons.json) and listed in report() instead. Every other
+// edge points at a node whose depth, the longest chain of effects it starts, is known.
+class EffectGraph
+{
+public:
+  EffectGraph():
+      effects_( nullptr ) {}
+
+  struct Node {
+    const Effect* effect;
+    uint32_t impact; // missiles only
+    vector<uint32_t> children; // set and persistent effects, in order
+    uint32_t depth;
+  };
+
+  void build( WeaponMap& weapons, EffectMap& effects )
+  {
+    effects_ = &effects;
+    for ( auto wpn : byName( weapons ) )
+      weaponEffect_[wpn->first] = resolve( wpn->second.name, wpn->second.effect );
+  }
+
+  // the effect of a weapon, noEffect if it has none
+  uint32_t weaponEffect( Symbol weapon ) const
+  {
+    auto it = weaponEffect_.find( weapon );
+    return ( it == weaponEffect_.end() ? noEffect : it->second );
+  }
+
+  const vector<Node>& nodes() const
+  {
+    return nodes_;
+  }
+
+  // the damage effects one hit through node deals, each with the number of times it does;
+  // persistent effects repeat their children periodCount times, suicides deal nothing
+  void damageEffects( uint32_t index, double times, vector<std::pair<const Effect*, double>>& out ) const
+  {
+    auto& node = nodes_[index];
+    auto& fx = *node.effect;
+    if ( fx.type == Effect::Effect_Damage && !( fx.flagKill && fx.impactLocation == Effect::Impact_SourceUnit ) )
+      out.emplace_back( &fx, times );
+    if ( node.impact != noEffect )
+      damageEffects( node.impact, times, out );
+    double repeat = ( fx.type == Effect::Effect_Persistent && fx.periodCount > 1 ? static_cast<double>( fx.periodCount ) : 1.0 );
+    for ( auto child : node.children )
+      damageEffects( child, times * repeat, out );
+  }
+
+  void report() const
+  {
+    size_t edges = 0;
+    uint32_t depth = 0;
+    for ( auto& node : nodes_ )
+    {
+      edges += node.children.size() + ( node.impact != noEffect ? 1 : 0 );
+      depth = std::max( depth, node.depth );
+    }
+    printf_s( "[e] %llu effects, %llu links, at most %u deep, %llu cycles\r\n", static_cast<unsigned long long>( nodes_.size() ),
+      static_cast<unsigned long long>( edges ), depth, static_cast<unsigned long long>( cycles_.size() ) );
+    for ( auto& cycle : cycles_ )
+      printf_s( "[e] cycle: %s -> %s\r\n", nodes_[cycle.first].effect->name.c_str(), nodes_[cycle.second].effect->name.c_str() );
+  }
+
+  void write( uint32_t index, JsonWriter& eval ) const
+  {
+    auto& node = nodes_[index];
+    auto& fx = *node.effect;
+    bool suicide = ( fx.type == Effect::Effect_Damage && fx.flagKill && fx.impactLocation == Effect::Impact_SourceUnit );
+
+    eval.beginObject();
+    eval.key( "name" ).value( fx.name.str() );
+    if ( fx.type == Effect::Effect_Missile )
+    {
+      eval.key( "type" ).value( "missile" );
+      if ( node.impact != noEffect )
+        write( node.impact, eval.key( "impact" ) );
+    }
+    else if ( fx.type == Effect::Effect_Damage )
+      eval.key( "type" ).value( suicide ? "suicide" : "damage" );
+    else if ( fx.type == Effect::Effect_CreateUnit )
+      eval.key( "type" ).value( "createUnit" );
+    else if ( fx.type == Effect::Effect_CreateHealer )
+      eval.key( "type" ).value( "createHealer" );
+    else if ( fx.type == Effect::Effect_Other )
+      eval.key( "type" ).value( "unknown" );
+    else if ( fx.type == Effect::Effect_Set || fx.type == Effect::Effect_Persistent )
+    {
+      eval.key( "type" ).value( fx.type == Effect::Effect_Set ? "set" : "persistent" );
+      eval.key( "setEffects" ).beginArray();
+      for ( auto child : node.children )
+        write( child, eval );
+      eval.end();
+      if ( fx.type == Effect::Effect_Persistent && fx.periodCount > 0 )
+        eval.key( "persistentCount" ).value( static_cast<Json::UInt64>( fx.periodCount ) );
+      if ( fx.type == Effect::Effect_Persistent && !fx.persistentPeriods.empty() )
+      {
+        eval.key( "persistentPeriods" ).beginArray();
+        for ( auto p : fx.persistentPeriods )
+          eval.value( p );
+        eval.end();
+      }
+    }
+
+    if ( !fx.searchRequires.empty() )
+      filtersToJSON( fx.searchRequires, eval.key( "searchRequires" ) );
+    if ( !fx.searchExcludes.empty() )
+      filtersToJSON( fx.searchExcludes, eval.key( "searchExcludes" ) );
+
+    if ( fx.type == Effect::Effect_Damage && !suicide )
+    {
+      eval.key( "dmgAmount" ).value( fx.damageAmount );
+      eval.key( "dmgArmorReduction" ).value( fx.damageArmorReduction );
+      eval.key( "dmgKind" ).value( fx.damageKind );
+      eval.key( "dmgAttributeBonuses" ).beginObject();
+      for ( auto& attribPair : fx.attributeBonuses )
+        if ( attribPair.second.value != 0.0 )
+          eval.key( attribPair.first ).value( attribPair.second.value );
+      eval.end();
+      eval.key( "dmgSplash" ).beginArray();
+      for ( auto& area : fx.splashArea )
+      {
+        eval.beginObject();
+        eval.key( "fraction" ).value( area.second.fraction );
+        eval.key( "radius" ).value( area.second.radius );
+        eval.end();
+      }
+      eval.end();
+    }
+
+    eval.end();
+  }
+
+private:
+  // noEffect for links to nothing; a node still being resolved when it is linked to again
+  // is returned as it is, and the caller treats the link as closing a cycle
+  uint32_t resolve( Symbol owner, Symbol link )
+  {
+    if ( link.empty() )
+      return noEffect;
+    auto pair = ( static_cast<uint64_t>( owner.id() ) << 32 ) | link.id();
+    auto known = links_.find( pair );
+    if ( known != links_.end() )
+      return known->second;
+
+    Symbol name = link;
+    if ( link.str().find( "##id##" ) != string::npos )
+      name = Symbol::lookup( boost::replace_all_copy( link.str(), "##id##", owner.str() ) );
+    auto it = effects_->find( name );
+    uint32_t index = noEffect;
+    if ( !name.empty() && it != effects_->end() )
+    {
+      auto node = index_.find( name );
+      index = ( node != index_.end() ? node->second : expand( name, it->second ) );
+    }
+    return links_[pair] = index;
+  }
+
+  uint32_t expand( Symbol name, const Effect& fx )
+  {
+    auto index = static_cast<uint32_t>( nodes_.size() );
+    index_[name] = index;
+    nodes_.push_back( Node{ &fx, noEffect, {}, 0 } );
+    active_.push_back( true );
+
+    uint32_t depth = 0;
+    auto follow = [&]( Symbol link ) {
+      auto child = resolve( name, link );
+      if ( child == noEffect )
+        return noEffect;
+      if ( active_[child] )
+      {
+        cycles_.emplace_back( index, child );
+        return noEffect;
+      }
+      depth = std::max( depth, nodes_[child].depth );
+      return child;
+    };
+    if ( fx.type == Effect::Effect_Missile )
+    {
+      auto impact = follow( fx.impactEffect );
+      nodes_[index].impact = impact;
+    }
+    else if ( fx.type == Effect::Effect_Set )
+    {
+      for ( auto& p : fx.setSubEffects )
+      {
+        auto child = follow( p.second );
+        if ( child != noEffect )
+          nodes_[index].children.push_back( child );
+      }
+    }
+    else if ( fx.type == Effect::Effect_Persistent )
+    {
+      for ( auto& p : fx.persistentEffects )
+      {
+        auto child = follow( p );
+        if ( child != noEffect )
+          nodes_[index].children.push_back( child );
+      }
+    }
+
+    nodes_[index].depth = depth + 1;
+    active_[index] = false;
+    return index;
+  }
+
+  EffectMap* effects_;
+  std::unordered_map<uint64_t, uint32_t> links_; // (owner, link) -> node
+  SymbolMap<uint32_t> index_; // effect -> node
+  SymbolMap<uint32_t> weaponEffect_;
+  vector<Node> nodes_;
+  vector<bool> active_; // being expanded, so linking to it closes a cycle
+  vector<std::pair<uint32_t, uint32_t>> cycles_; // from, to
+};
+
+EffectGraph g_effectGraph;
+
+void dumpWeapons( WeaponMap& weapons )
+{
+  printf_s( "[d] dumping weapons...\r\n" );
+
+  ofstream out;
+  out.open( "weapons.json" );
+
+  std::map<string, const WeaponMap::value_type*> rows;
+  for ( auto entry : byName( weapons ) )
+    rows[entry->second.name.str()] = entry;
+
+  JsonWriter json( out );
+  json.beginStream();
+  for ( auto& row : rows )
+  {
+    auto& wpn = *row.second;
+    json.key( row.first ).beginObject();
+    json.key( "name" ).value( wpn.second.name.str() );
+    json.key( "range" ).value( wpn.second.range );
+    json.key( "period" ).value( wpn.second.period );
+    json.key( "arc" ).value( wpn.second.arc );
+    json.key( "damagePoint" ).value( wpn.second.damagePoint );
+    json.key( "backSwing" ).value( wpn.second.backSwing );
+    json.key( "rangeSlop" ).value( wpn.second.rangeSlop );
+    json.key( "arcSlop" ).value( wpn.second.arcSlop );
+    json.key( "minScanRange" ).value( wpn.second.minScanRange );
+    json.key( "randomDelayMin" ).value( wpn.second.randomDelayMin );
+    json.key( "randomDelayMax" ).value( wpn.second.randomDelayMax );
+    json.key( "melee" ).value( wpn.second.melee );
+    json.key( "hidden" ).value( wpn.second.hidden );
+    json.key( "disabled" ).value( wpn.second.disabled );
+
+    filtersToJSON( wpn.second.targetRequire, json.key( "filterRequires" ) );
+    filtersToJSON( wpn.second.targetExclude, json.key( "filterExcludes" ) );
+
+    auto effect = g_effectGraph.weaponEffect( wpn.first );
+    if ( effect != noEffect )
+      g_effectGraph.write( effect, json.key( "effect" ) );
+    else
+    {
+      json.key( "effect" ).beginObject();
+      json.end();
+    }
+
+    json.end();
+  }
+  json.end();
+
+  out.close();
+}
+
+void dumpUpgrades( UpgradeMap& upgrades )
+{
+  printf_s( "[d] dumping upgrades...\r\n" );
+
+  ofstream out;
+  out.open( "upgrades.json" );
+
+  std::map<string, const UpgradeMap::value_type*> rows;
+  for ( auto entry : byName( upgrades ) )
+    rows[entry->second.name.str()] = entry;
+
+  JsonWriter json( out );
+  json.beginStream();
+  for ( auto& row : rows )
+  {
+    auto& upgrade = *row.second;
+    json.key( row.first ).beginObject();
+    json.key( "name" ).value( upgrade.second.name.str() );
+    json.key( "race" ).value( raceStr( upgrade.second.race ) );
+
+    json.key( "effectArray" ).beginArray();
+    for ( auto& entry : upgrade.second.effectArray )
+    {
+      json.beginObject();
+      json.key( "operation" ).value( entry.operation );
+      json.key( "referenceType" ).value( entry.referenceType );
+      json.key( "referenceId" ).value( entry.referenceId );
+      json.key( "referenceAttribute" ).value( entry.referenceAttribute );
+      json.key( "value" ).value( entry.value );
+      json.end();
+    }
+    json.end();
+
+    json.end();
+  }
+  json.end();
+
+  out.close();
+}
+
+// the requirement trees of a requirement, as a "requires" member of out
+void dumpRequirementsJSON( Symbol reqstr, JsonWriter& out )
+{
+  if ( reqstr.empty() )
+    return;
+  out.key( "requires" ).beginArray();
+  for ( auto root : g_requirementGraph.roots( reqstr ) )
+    if ( g_sharedRequirements )
+      out.value( static_cast<Json::UInt64>( root ) );
+    else
+      g_requirementGraph.write( root, out, false );
+  out.end();
+}
+
+// the nodes that techtree.json and abilities.json refer to with --shared-requirements
+void dumpRequirements()
+{
+  printf_s( "[d] dumping requirements...\r\n" );
+
+  ofstream out;
+  out.open( "requirements.json" );
+
+  JsonWriter json( out );
+  json.beginArray();
+  for ( uint32_t i = 0; i < g_requirementGraph.nodes().size(); i++ )
+    g_requirementGraph.write( i, json, true );
+  json.end();
+
+  out.close();
+}
+
+void dumpAbilities( AbilityMap& abils )
+{
+  printf_s( "[d] dumping abilities...\r\n" );
+
+  ofstream out;
+  out.open( "abilities.json" );
+
+  std::map<string, const AbilityMap::value_type*> rows;
+  for ( auto entry : byName( abils ) )
+    if ( entry->second.type != AbilType_Other )
+      rows[entry->second.name.str()] = entry;
+
+  JsonWriter json( out );
+  json.beginStream();
+  for ( auto& row : rows )
+  {
+    auto& abil = *row.second;
+
+    json.key( row.first ).beginObject();
+    json.key( "name" ).value( abil.second.name.str() );
+    json.key( "type" ).value( abilTypeStr( abil.second.type ) );
+    if ( !abil.second.morphUnit.empty() )
+      json.key( "morphUnit" ).value( abil.second.morphUnit.str() );
+
+    json.key( "commands" ).beginObject();
+    for ( auto& cmd : abil.second.commands )
+    {
+      if ( abil.second.type == AbilType_Train && cmd.second.units.empty() )
+        continue;
+
+      json.key( cmd.second.index ).beginObject();
+      json.key( "index" ).value( static_cast<Json::UInt64>( g_abilityCommands.resolve( abil.second.name, cmd.second.index ) ) );
+      json.key( "time" ).value( cmd.second.time );
+      dumpRequirementsJSON( cmd.second.requirements, json );
+
+      if ( !cmd.second.units.empty() )
+      {
+        json.key( "units" ).beginArray();
+        for ( auto& unit : cmd.second.units )
+          if ( !unit.empty() )
+            json.value( unit.str() );
+        json.end();
+      }
+
+      json.end();
+    }
+    json.end();
+
+    json.end();
+  }
+  json.end();
+
+  out.close();
+}
+
+struct TechTreeBuildEntry {
+  Symbol unit;
+  int unitCount;
+  Symbol ability;
+  string command;
+  uint32_t commandSlot;
+  double time;
+  Symbol requirements;
+  bool buildInterruptible;
+  bool finishKillsPeon;
+  bool trainFinishKills;
+  bool trainCancelKills;
+  TechTreeBuildEntry():
+      commandSlot( 0 ), buildInterruptible( false ), finishKillsPeon( false ), trainFinishKills( false ), trainCancelKills( false ) {}
+};
+
+struct TechTreeResearchEntry {
+  Symbol upgrade;
+  Symbol ability;
+  string command;
+  uint32_t commandSlot;
+  double time;
+  Symbol requirements;
+  int64_t minerals;
+  int64_t vespene;
+};
+
+struct TechTreeEntry {
+  Symbol id;
+  vector<TechTreeBuildEntry> builds;
+  vector<TechTreeBuildEntry> morphs;
+  vector<TechTreeBuildEntry> merges;
+  vector<TechTreeResearchEntry> researches;
+};
+
+using TechTree = vector<TechTreeEntry>;
+
+using TechMap = std::map<Race, TechTree>;
+
+void generateTechTree( UnitMap& units, AbilityMap& abilities, Race race, TechTree& tree )
+{
+  UnitMap buildings;
+  for ( auto sorted : byName( units ) )
+  {
+    auto& unit = *sorted;
+    if ( unit.second.race != race )
+      continue;
+
+    // some cleanup
+    auto& name = unit.second.name.str();
+    if ( boost::iequals( name.substr( 0, 7 ), "XelNaga" ) && !boost::iequals( name, "XelNagaTower" ) )
+      continue;
+    if ( boost::iequals( name.substr( 0, 4 ), "Aiur" ) || boost::iequals( name.substr( 0, 8 ), "PortCity" ) || boost::iequals( name.substr( 0, 8 ), "Shakuras" ) || boost::iequals( name.substr( 0, 19 ), "SnowRefinery_Terran" ) || boost::iequals( name.substr( 0, 15 ), "ExtendingBridge" ) )
+      continue;
+
+    // hardcode to get rid of mothership core; i think blizzard screwed up in their cmdcard XML regarding this. it might even be possible to still build one in a melee game.
+    if ( boost::iequals( name, "MothershipCore" ) )
+      continue;
+
+    TechTreeEntry entry;
+    entry.id = unit.second.name;
+
+    // for ( auto& name : unit.second.abilityCommands )
+    for ( auto& card : unit.second.abilityCardsMap )
+      if ( !card.second.removed )
+        for ( auto& cmdpair : card.second.commands )
+        {
+          if ( cmdpair.second.empty() )
+            continue;
+
+          // "Ability,Command"
+          vector<string> parts;
+          boost::split( parts, cmdpair.second.str(), boost::is_any_of( "," ) );
+          if ( parts.size() != 2 )
+            continue;
+
+          auto abilityIt = abilities.find( Symbol::lookup( parts[0] ) );
+          if ( abilityIt == abilities.end() )
+            continue;
+          auto& ability = abilityIt->second;
+          if ( ability.type == AbilType_Train || ability.type == AbilType_Build || ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement || ability.type == AbilType_Merge )
+          {
+            auto cmdIt = ability.commands.find( parts[1] );
+            if ( cmdIt == ability.commands.end() )
+              continue;
+            auto& cmd = cmdIt->second;
+
+            if ( cmd.units.empty() || cmd.isUpgrade )
+              continue;
+
+            TechTreeBuildEntry bentry;
+            // training zergling has ["zergling", "zergling"] for example, so this simplification seems reasonable
+            // but skip cocoons and eggs, we don't care
+            for ( auto& u : cmd.units )
+            {
+              if ( u.str().find( "Cocoon" ) != std::string::npos )
+                continue;
+              if ( u.str().find( "Egg" ) != std::string::npos )
+                continue;
+              bentry.unit = u;
+              break;
+            }
+
+            // cannot morph to myself. this might happen eg ObserverSiegeMode descends from Observer but doesn't override the morph skill.
+            if ( ( ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement ) && boost::iequals( bentry.unit.str(), name ) )
+              continue;
+
+            // hardcode to get rid of mothership core
+            if ( boost::iequals( bentry.unit.str(), "MothershipCore" ) )
+              continue;
+
+            if ( bentry.unit.empty() )
+            {
+              bentry.unit = cmd.units[cmd.units.size() - 1]; // else just choose the last one which is usually better than first
+            }
+            bentry.unitCount = ( bentry.unit.empty() ? 0 : 1 );
+            // hardcode hack to fix zerglings, literally the only unit that's built 2 at a time
+            if ( ability.type == AbilType_Train && boost::iequals( bentry.unit.str(), "Zergling" ) )
+            {
+              bentry.unitCount = 2;
+            }
+            bentry.ability = ability.name;
+            bentry.time = cmd.time;
+            bentry.command = cmd.index;
+            bentry.commandSlot = abilityCommandSlot( cmd.index );
+            bentry.requirements = cmd.requirements;
+
+            if ( ability.type == AbilType_Build )
+            {
+              bentry.buildInterruptible = ability.buildInterruptible;
+              bentry.finishKillsPeon = ability.buildFinishKillsPeon;
+            }
+            else if ( ability.type == AbilType_Train )
+            {
+              bentry.trainFinishKills = ability.trainFinishKills;
+              bentry.trainCancelKills = ability.trainCancelKills;
+            }
+
+            // separate morphs from other types as morph consumes existing unit
+            if ( ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement )
+              entry.morphs.push_back( bentry );
+            else if ( ability.type == AbilType_Merge )
+              entry.merges.push_back( bentry );
+            else
+              entry.builds.push_back( bentry );
+          }
+          else if ( ability.type == AbilType_Research )
+          {
+            auto cmdIt = ability.commands.find( parts[1] );
+            if ( cmdIt == ability.commands.end() || !cmdIt->second.isUpgrade )
+              continue;
+            auto& cmd = cmdIt->second;
+
+            TechTreeResearchEntry res;
+            res.upgrade = cmd.upgrade;
+            res.ability = ability.name;
+            res.time = cmd.time;
+            res.command = cmd.index;
+            res.commandSlot = abilityCommandSlot( cmd.index );
+            res.requirements = cmd.requirements;
+            res.minerals = cmd.mineralCost;
+            res.vespene = cmd.vespeneCost;
+            entry.researches.push_back( res );
+          }
+        }
+
+    tree.push_back( entry );
+
+    buildings[unit.second.name] = unit.second;
   }
 }
 
-void parseFootprintData( const string& filename, FootprintMap& footprints, Footprint& defaultFootprint, size_t& notFoundCount )
+void dumpTechTree( TechMap& techtree )
 {
-  notFoundCount = 0;
+  printf_s( "[d] dumping tech tree...\r\n" );
+
+  ofstream out;
+  out.open( "techtree.json" );
 
-  tinyxml2::XMLDocument doc;
-  if ( doc.LoadFile( filename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( "Could not load FootprintData XML file" );
+  std::map<string, const TechTree*> races;
+  for ( auto& entry : techtree )
+    races[raceStr( entry.first )] = &entry.second;
 
-  // FootprintData.xml
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement( "CFootprint" );
-  while ( entry )
+  JsonWriter json( out );
+  json.beginStream();
+  for ( auto& race : races )
   {
-    bool isDefault = ( entry->Attribute( "default" ) && entry->Int64Attribute( "default" ) == 1 && !entry->Attribute( "id" ) );
-    auto id = entry->Attribute( "id" );
-    if ( id || isDefault )
+    std::map<string, const TechTreeEntry*> rows;
+    for ( auto& asd : *race.second )
+      if ( !asd.builds.empty() || !asd.morphs.empty() || !asd.researches.empty() )
+        rows[std::to_string( stableID( g_unitMapping, asd.id ) )] = &asd;
+
+    json.key( race.first ).beginStream();
+    for ( auto& row : rows )
     {
-      if ( entry->Attribute( "parent" ) && strlen( entry->Attribute( "parent" ) ) > 0 )
+      auto& asd = *row.second;
+
+      json.key( row.first ).beginObject();
+      json.key( "name" ).value( asd.id.str() );
+
+      if ( !asd.builds.empty() )
       {
-        string parentId = entry->Attribute( "parent" );
-        if ( footprints.find( parentId ) == footprints.end() )
-        {
-          notFoundCount++;
-          entry = entry->NextSiblingElement();
-          continue;
-        }
-        else if ( footprints.find( id ) == footprints.end() )
+        json.key( "builds" ).beginArray();
+        for ( auto& build : asd.builds )
         {
-          const Footprint& parent = footprints[parentId];
-          footprints[id] = parent;
-        }
-      }
-      else if ( !isDefault && footprints.find( id ) == footprints.end() )
-        footprints[id] = defaultFootprint;
+          auto abilityCmdIndex = g_abilityCommands.resolve( build.ability, build.commandSlot );
 
-      Footprint& fp = ( isDefault ? defaultFootprint : footprints[id] );
+          json.beginObject();
+          json.key( "unit" ).value( static_cast<Json::UInt64>( stableID( g_unitMapping, build.unit ) ) );
+          json.key( "unitName" ).value( build.unit.str() );
 
-      if ( !isDefault )
-      {
-        fp.id = id;
-        printf_s( "[+] footprint: %s\r\n", fp.id.c_str() );
-      }
+          if ( build.unitCount > 1 )
+            json.key( "unitCount" ).value( build.unitCount );
 
-      vector<OffsetPoint> offsets;
-      vector<FootprintShapeBorder> borders;
+          json.key( "abilityName" ).value( build.ability.str() + "," + build.command );
+          json.key( "ability" ).value( static_cast<Json::UInt64>( abilityCmdIndex ) );
+          json.key( "time" ).value( build.time );
 
-      auto shape = entry->FirstChildElement( "Shape" );
-      while ( shape )
-      {
-        auto field = shape->FirstChildElement();
-        while ( field )
-        {
-          if ( _strcmpi( field->Name(), "Radius" ) == 0 && field->Attribute( "value" ) )
-            fp.shape.radius = field->DoubleAttribute( "value" );
-          else if ( _strcmpi( field->Name(), "Offsets" ) == 0 && field->Attribute( "value" ) )
-          {
-            offsets.clear();
-            string data = field->Attribute( "value" );
-            vector<string> offsetstrs;
-            boost::split( offsetstrs, data, boost::is_any_of( ";" ) );
-            for ( auto& offsetstr : offsetstrs )
-            {
-              vector<string> parts;
-              boost::split( parts, offsetstr, boost::is_any_of( "," ) );
-              if ( parts.size() != 2 )
-                throw runtime_error( "CFootprint::Shape::Offsets has a non-pair entry" );
-              offsets.emplace_back( std::stod( parts[0] ), std::stod( parts[1] ) );
-            }
-          }
-          else if ( _strcmpi( field->Name(), "Borders" ) == 0 && field->Attribute( "value" ) )
-          {
-            borders.clear();
-            string data = field->Attribute( "value" );
-            vector<string> borderstrs;
-            boost::split( borderstrs, data, boost::is_any_of( ";" ) );
-            for ( auto& borderstr : borderstrs )
-            {
-              vector<string> parts;
-              boost::split( parts, borderstr, boost::is_any_of( "," ) );
-              if ( parts.size() != 3 )
-                throw runtime_error( "CFootprint::Shape::Borders has an entry with != 3 members" );
-              borders.emplace_back( std::stoul( parts[0] ), std::stoul( parts[1] ), std::stoi( parts[2] ) );
-            }
-          }
-          field = field->NextSiblingElement();
+          if ( build.buildInterruptible ) // terran scv -> building; CAbilBuild
+            json.key( "interruptible" ).value( true );
+          if ( build.finishKillsPeon ) // terran scv -> building; CAbilBuild
+            json.key( "finishKillsWorker" ).value( true );
+          if ( build.trainFinishKills ) // zerg larva -> *; CAbilTrain
+            json.key( "finishKillsSource" ).value( true );
+          if ( build.trainCancelKills ) // zerg larva -> *; CAbilTrain
+            json.key( "cancelKillsSource" ).value( true );
+
+          dumpRequirementsJSON( build.requirements, json );
+
+          json.end();
         }
-        shape = shape->NextSiblingElement( "Shape" );
+        json.end();
       }
 
-      // 0 = unpathable terrain, 1 = ground, 2 = building, 3 = cliff
-      parseFootprintShapes( offsets, borders, 0, fp.shape.unpathablePolys );
-      parseFootprintShapes( offsets, borders, 2, fp.shape.buildingPolys );
-
-      auto layer = entry->FirstChildElement( "Layers" );
-      while ( layer )
+      if ( !asd.morphs.empty() )
       {
-        if ( layer->Attribute( "index" ) && boost::iequals( layer->Attribute( "index" ), "Place" ) )
+        json.key( "morphs" ).beginArray();
+        for ( auto& morph : asd.morphs )
         {
-          if ( layer->IntAttribute( "removed", 0 ) == 1 )
-          {
-            fp.removed = true;
-            layer = layer->NextSiblingElement( "Layers" );
-            continue;
-          }
+          auto abilityCmdIndex = g_abilityCommands.resolve( morph.ability, morph.commandSlot );
 
-          fp.removed = false;
+          json.beginObject();
+          json.key( "unit" ).value( static_cast<Json::UInt64>( stableID( g_unitMapping, morph.unit ) ) );
+          json.key( "unitName" ).value( morph.unit.str() );
 
-          if ( layer->Attribute( "Area" ) )
-          {
-            string area = layer->Attribute( "Area" );
-            vector<string> parts;
-            boost::split( parts, area, boost::is_any_of( "," ) );
-            if ( parts.size() != 4 )
-              throw runtime_error( "bad Area attribute for CFootprint::Layers" );
-
-            fp.x = atoi( parts[0].c_str() );
-            fp.y = atoi( parts[1].c_str() );
-            int rx = atoi( parts[2].c_str() );
-            int ry = atoi( parts[3].c_str() );
-            fp.w = ( rx - fp.x );
-            fp.h = ( ry - fp.y );
-          }
+          if ( morph.unitCount > 1 )
+            json.key( "unitCount" ).value( morph.unitCount );
 
-          auto sets = layer->FirstChildElement( "Sets" );
-          while ( sets )
-          {
-            if ( sets->Attribute( "Character" ) && strlen( sets->Attribute( "Character" ) ) == 1 )
-            {
-              auto positive = sets->FirstChildElement( "Positive" );
-              if ( positive && positive->Attribute( "index" ) && ( !positive->Attribute( "value" ) || positive->IntAttribute( "value" ) == 1 ) )
-              {
-                if ( boost::iequals( positive->Attribute( "index" ), "Creep" ) )
-                {
-                  fp.hasCreep = true;
-                  fp.creepChar = sets->Attribute( "Character" )[0];
-                }
-                else if ( boost::iequals( positive->Attribute( "index" ), "NearResources" ) )
-                {
-                  fp.hasNearResources = true;
-                  fp.nearResourcesChar = sets->Attribute( "Character" )[0];
-                }
-              }
-            }
-            sets = sets->NextSiblingElement( "Sets" );
-          }
+          json.key( "abilityName" ).value( morph.ability.str() + "," + morph.command );
+          json.key( "ability" ).value( static_cast<Json::UInt64>( abilityCmdIndex ) );
+          json.key( "time" ).value( morph.time );
 
-          if ( layer->FirstChildElement( "Rows" ) && ( !layer->FirstChildElement( "Rows" )->Attribute( "removed" ) || layer->FirstChildElement( "Rows" )->IntAttribute( "removed" ) == 0 ) )
-          {
-            // jesus christ
-            int rowcount = 0;
-            int rowwidth = 0;
-            auto ctr = layer->FirstChildElement( "Rows" );
-            while ( ctr )
-            {
-              size_t val = ( ctr->Attribute( "value" ) ? strlen( ctr->Attribute( "value" ) ) : 0 );
-              if ( static_cast<int>( val ) > rowwidth )
-                rowwidth = static_cast<int>( val );
-              rowcount++;
-              ctr = ctr->NextSiblingElement( "Rows" );
-            }
+          dumpRequirementsJSON( morph.requirements, json );
 
-            if ( rowcount > fp.h )
-              fp.h = rowcount;
-            if ( rowwidth > fp.w )
-              fp.w = rowwidth;
-
-            fp.placement.clear();
-            fp.placement.resize( fp.w * fp.h, 0 );
-            fp.creep.clear();
-            fp.creep.resize( fp.w * fp.h, 0 );
-            fp.nearResources.clear();
-            fp.nearResources.resize( fp.w * fp.h, 0 );
-            size_t index = 0;
-            auto row = layer->FirstChildElement( "Rows" );
-            while ( row )
-            {
-              if ( !row->Attribute( "value" ) )
-                throw runtime_error( "CFootprint::Layers::Rows without value attribute" );
-              string value = row->Attribute( "value" );
-              if ( static_cast<int>( value.length() ) > fp.w )
-                fp.w = static_cast<int>( value.length() );
-              for ( size_t c = 0; c < value.length(); c++ )
-                if ( value[c] == 'x' )
-                  fp.placement[index * fp.w + c] = 1;
-                else if ( fp.hasCreep && value[c] == fp.creepChar )
-                  fp.creep[index * fp.w + c] = 1;
-                else if ( fp.hasNearResources && value[c] == fp.nearResourcesChar )
-                  fp.nearResources[index * fp.w + c] = 1;
-              index++;
-              row = row->NextSiblingElement( "Rows" );
-            }
-          }
+          json.end();
         }
-        layer = layer->NextSiblingElement( "Layers" );
+        json.end();
       }
-    }
-    entry = entry->NextSiblingElement( "CFootprint" );
-  }
-}
-
-void parseAbilityData( const string& filename, AbilityMap& abilities )
-{
-  string abilstr;
 
-  ifstream in;
-  in.open( filename, std::ifstream::in );
-  if ( !in.is_open() )
-    throw runtime_error( string( "Could not load XML file " ) + filename );
-  in.seekg( 0, std::ios::end );
-  abilstr.reserve( in.tellg() );
-  in.seekg( 0, std::ios::beg );
-  abilstr.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
-  in.close();
-
-  boost::replace_all( abilstr, R"(<?token id="unit"?>)", "" );
-
-  tinyxml2::XMLDocument doc;
-  auto ret = doc.Parse( abilstr.c_str() );
-  if ( ret != tinyxml2::XML_SUCCESS )
-  {
-    doc.PrintError();
-    throw runtime_error( "Could not parse XML file" );
-  }
-
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  auto entry = catalog->FirstChildElement();
-  while ( entry )
-  {
-    auto id = entry->Attribute( "id" );
-    if ( id )
-    {
-      Ability& abil = abilities[id];
-      abil.name = id;
-      if ( _stricmp( entry->Name(), "CAbilTrain" ) == 0 )
-        abil.type = AbilType_Train;
-      else if ( _stricmp( entry->Name(), "CAbilWarpTrain" ) == 0 )
-      {
-        abil.type = AbilType_Train;
-        abil.warp = true;
-      }
-      else if ( _stricmp( entry->Name(), "CAbilMorph" ) == 0 )
-        abil.type = AbilType_Morph;
-      else if ( _stricmp( entry->Name(), "CAbilMorphPlacement" ) == 0 )
-        abil.type = AbilType_MorphPlacement;
-      else if ( _stricmp( entry->Name(), "CAbilBuild" ) == 0 )
-        abil.type = AbilType_Build;
-      else if ( _stricmp( entry->Name(), "CAbilMerge" ) == 0 )
-        abil.type = AbilType_Merge;
-      else if ( _stricmp( entry->Name(), "CAbilResearch" ) == 0 )
-        abil.type = AbilType_Research;
-
-      printf_s( "[+] ability: %s\r\n", abil.name.c_str() );
-
-      auto field = entry->FirstChildElement();
-      while ( field )
-      {
-        if ( _strcmpi( field->Name(), "MorphUnit" ) == 0 && field->Attribute( "value" ) )
-          abil.morphUnit = field->Attribute( "value" );
-        else if ( _strcmpi( field->Name(), "Effect" ) == 0 && field->Attribute( "value" ) )
-          abil.effect = field->Attribute( "value" );
-        else if ( _strcmpi( field->Name(), "FlagArray" ) == 0 ) // CAbilBuild has these
-        {
-          if ( field->Attribute( "index" ) && field->Attribute( "value" ) )
-          {
-            if ( _stricmp( field->Attribute( "index" ), "PeonKillFinish" ) == 0 )
-              abil.buildFinishKillsPeon = ( field->IntAttribute( "value" ) > 0 );
-            else if ( _stricmp( field->Attribute( "index" ), "Interruptible" ) == 0 )
-              abil.buildInterruptible = ( field->IntAttribute( "value" ) > 0 );
-          }
-        }
-        else if ( _strcmpi( field->Name(), "Flags" ) == 0 ) // CAbilTrain has these
-        {
-          if ( field->Attribute( "index" ) && field->Attribute( "value" ) )
-          {
-            if ( _stricmp( field->Attribute( "index" ), "KillOnFinish" ) == 0 )
-              abil.trainFinishKills = ( field->IntAttribute( "value" ) > 0 );
-            else if ( _stricmp( field->Attribute( "index" ), "KillOnCancel" ) == 0 )
-              abil.trainCancelKills = ( field->IntAttribute( "value" ) > 0 );
-          }
-        }
-        else if ( _strcmpi( field->Name(), "InfoArray" ) == 0 )
+      if ( !asd.merges.empty() )
+      {
+        json.key( "merges" ).beginArray();
+        for ( auto& merge : asd.merges )
         {
-          auto idx = field->Attribute( "index" );
-          if ( ( abil.type == AbilType_Train || abil.type == AbilType_Build ) && idx ) // for CAbilTrain & CAbilBuild
-          {
-            if ( abil.commands.find( idx ) == abil.commands.end() )
-              abil.commands[idx] = AbilityCommand( idx );
+          auto abilityCmdIndex = g_abilityCommands.resolve( merge.ability, merge.commandSlot );
 
-            AbilityCommand& cmd = abil.commands[idx];
-            if ( field->Attribute( "Time" ) )
-              cmd.time = field->DoubleAttribute( "Time" );
+          json.beginObject();
+          json.key( "unit" ).value( static_cast<Json::UInt64>( stableID( g_unitMapping, merge.unit ) ) );
+          json.key( "unitName" ).value( merge.unit.str() );
 
-            auto unit = field->Attribute( "Unit" );
-            if ( unit )
-              cmd.units.emplace_back( unit );
+          if ( merge.unitCount > 1 )
+            json.key( "unitCount" ).value( merge.unitCount );
 
-            if ( field->FirstChildElement( "Unit" ) )
-              cmd.units.clear();
-            auto sub = field->FirstChildElement();
-            while ( sub )
-            {
-              if ( _strcmpi( sub->Name(), "Unit" ) == 0 && sub->Attribute( "value" ) )
-                cmd.units.emplace_back( sub->Attribute( "value" ) );
-              else if ( _strcmpi( sub->Name(), "Button" ) == 0 && sub->Attribute( "Requirements" ) )
-                cmd.requirements = sub->Attribute( "Requirements" );
-              sub = sub->NextSiblingElement();
-            }
-          }
-          else if ( ( abil.type == AbilType_Morph || abil.type == AbilType_MorphPlacement ) && field->Attribute( "Unit" ) ) // for CAbilMorph
-          {
-            // Note: current implementation misses CAbilMorphs and others that descend from a "parent" (attribute in AbilData.xml)
-            // this includes at least TerranBuildingLiftOff, DisguiseChangeling and such
-            if ( abil.commands.find( "Execute" ) == abil.commands.end() )
-              abil.commands["Execute"] = AbilityCommand( "Execute" );
+          json.key( "abilityName" ).value( merge.ability.str() + "," + merge.command );
+          json.key( "ability" ).value( static_cast<Json::UInt64>( abilityCmdIndex ) );
+          json.key( "time" ).value( merge.time );
 
-            AbilityCommand& cmd = abil.commands["Execute"];
-            cmd.units.emplace_back( field->Attribute( "Unit" ) );
+          dumpRequirementsJSON( merge.requirements, json );
 
-            auto sect = field->FirstChildElement( "SectionArray" );
-            while ( sect )
-            {
-              if ( sect->Attribute( "index" ) && _stricmp( sect->Attribute( "index" ), "Actor" ) == 0 )
-              {
-                auto dur = sect->FirstChildElement( "DurationArray" );
-                if ( dur && dur->Attribute( "index" ) && _stricmp( dur->Attribute( "index" ), "Delay" ) == 0 && dur->Attribute( "value" ) )
-                  cmd.time = dur->DoubleAttribute( "value" );
-              }
-              sect = sect->NextSiblingElement( "SectionArray" );
-            }
-          }
-          else if ( abil.type == AbilType_Research && field->Attribute( "Upgrade" ) ) // for CAbilResearch
-          {
-            if ( strlen( field->Attribute( "Upgrade" ) ) < 1 )
-            {
-              auto it = abil.commands.find( idx );
-              if ( it != abil.commands.end() )
-                abil.commands.erase( it );
-            }
-            else
-            {
-              if ( abil.commands.find( idx ) == abil.commands.end() )
-                abil.commands[idx] = AbilityCommand( idx );
-
-              AbilityCommand& cmd = abil.commands[idx];
-              if ( field->Attribute( "Time" ) )
-                cmd.time = field->DoubleAttribute( "Time" );
-
-              cmd.isUpgrade = true;
-              cmd.upgrade = field->Attribute( "Upgrade" );
-              auto sub = field->FirstChildElement();
-              while ( sub )
-              {
-                if ( _strcmpi( sub->Name(), "Resource" ) == 0 && sub->Attribute( "index" ) && _stricmp( sub->Attribute( "index" ), "Minerals" ) == 0 && sub->Attribute( "value" ) )
-                  cmd.mineralCost = sub->Int64Attribute( "value" );
-                else if ( _strcmpi( sub->Name(), "Resource" ) == 0 && sub->Attribute( "index" ) && _stricmp( sub->Attribute( "index" ), "Vespene" ) == 0 && sub->Attribute( "value" ) )
-                  cmd.vespeneCost = sub->Int64Attribute( "value" );
-                else if ( _strcmpi( sub->Name(), "Button" ) == 0 && sub->Attribute( "Requirements" ) )
-                  cmd.requirements = sub->Attribute( "Requirements" );
-                sub = sub->NextSiblingElement();
-              }
-            }
-          }
-        }
-        else if ( ( abil.type == AbilType_Morph || abil.type == AbilType_MorphPlacement ) && _strcmpi( field->Name(), "CmdButtonArray" ) == 0 && field->Attribute( "index" ) && _stricmp( field->Attribute( "index" ), "Execute" ) == 0 && field->Attribute( "Requirements" ) )
-        {
-          if ( abil.commands.find( "Execute" ) == abil.commands.end() )
-            abil.commands["Execute"] = AbilityCommand( "Execute" );
-          abil.commands["Execute"].requirements = field->Attribute( "Requirements" );
+          json.end();
         }
-        else if ( abil.type == AbilType_Merge && _strcmpi( field->Name(), "Info" ) == 0 )
+        json.end();
+      }
+
+      if ( !asd.researches.empty() )
+      {
+        json.key( "researches" ).beginArray();
+        for ( auto& res : asd.researches )
         {
-          // archon merge, kinda hardcoded hack
+          if ( res.upgrade.str().size() < 2 )
+            continue;
 
-          if ( abil.commands.find( "SelectedUnits" ) == abil.commands.end() )
-            abil.commands["SelectedUnits"] = AbilityCommand( "SelectedUnits" );
+          auto abilityCmdIndex = g_abilityCommands.resolve( res.ability, res.commandSlot );
 
-          AbilityCommand& cmd = abil.commands["SelectedUnits"];
+          json.beginObject();
+          json.key( "upgrade" ).value( static_cast<Json::UInt64>( stableID( g_upgradeMapping, res.upgrade ) ) );
+          json.key( "upgradeName" ).value( res.upgrade.str() );
+          json.key( "abilityName" ).value( res.ability.str() + "," + res.command );
+          json.key( "ability" ).value( static_cast<Json::UInt64>( abilityCmdIndex ) );
+          json.key( "time" ).value( res.time );
+          json.key( "minerals" ).value( static_cast<Json::UInt64>( res.minerals ) );
+          json.key( "vespene" ).value( static_cast<Json::UInt64>( res.vespene ) );
 
-          auto sub = field->FirstChildElement();
-          while ( sub )
-          {
-            if ( _strcmpi( sub->Name(), "Resource" ) == 0 && sub->Attribute( "index" ) && _stricmp( sub->Attribute( "index" ), "Minerals" ) == 0 && sub->Attribute( "value" ) )
-              cmd.mineralCost = sub->Int64Attribute( "value" );
-            else if ( _strcmpi( sub->Name(), "Resource" ) == 0 && sub->Attribute( "index" ) && _stricmp( sub->Attribute( "index" ), "Vespene" ) == 0 && sub->Attribute( "value" ) )
-              cmd.vespeneCost = sub->Int64Attribute( "value" );
-            else if ( _strcmpi( sub->Name(), "Button" ) == 0 && sub->Attribute( "Requirements" ) )
-              cmd.requirements = sub->Attribute( "Requirements" );
-            sub = sub->NextSiblingElement();
-          }
+          dumpRequirementsJSON( res.requirements, json );
 
-          if ( field->Attribute( "Unit" ) )
-          {
-            cmd.units.emplace_back( field->Attribute( "Unit" ) );
-            abil.morphUnit = field->Attribute( "Unit" );
-          }
-          if ( field->Attribute( "Time" ) )
-            cmd.time = field->DoubleAttribute( "Time" );
+          json.end();
         }
-        field = field->NextSiblingElement();
+        json.end();
       }
+
+      json.end();
     }
-    entry = entry->NextSiblingElement();
+    json.end();
   }
+  json.end();
+
+  out.close();
 }
 
-void parseUpgradeData( const string& filename, UpgradeMap& upgrades, Upgrade& defaultUpgrade )
+// Runs a set of tasks on a pool of threads, starting each task only once the tasks
+// it depends on have finished. A task that throws cancels its dependents, and run()
+// rethrows the exception of the failed task that was added first.
+class TaskGraph
 {
-  tinyxml2::XMLDocument doc;
-  if ( doc.LoadFile( filename.c_str() ) != tinyxml2::XML_SUCCESS )
-    throw runtime_error( "Could not load XML file " + filename );
+public:
+  using TaskId = size_t;
 
-  auto catalog = doc.FirstChildElement( "Catalog" );
-  for ( auto entry = catalog->FirstChildElement(); entry; entry = entry->NextSiblingElement() )
+  TaskId add( std::function<void()> fn, const vector<TaskId>& deps = vector<TaskId>() )
   {
-    bool isDefault = ( entry->Attribute( "default" ) && entry->Int64Attribute( "default" ) == 1 && !entry->Attribute( "id" ) );
-    auto id = entry->Attribute( "id" );
-    if ( id || isDefault )
+    TaskId id = tasks_.size();
+    tasks_.emplace_back();
+    tasks_[id].fn = std::move( fn );
+    for ( auto dep : deps )
     {
-      if ( !isDefault && upgrades.find( id ) == upgrades.end() )
-        upgrades[id] = defaultUpgrade;
+      if ( dep >= id )
+        throw runtime_error( "TaskGraph: task depends on a task added after it" );
+      tasks_[dep].dependents.push_back( id );
+      tasks_[id].waitingFor++;
+    }
+    return id;
+  }
+
+  void run( size_t threadCount = std::thread::hardware_concurrency() )
+  {
+    for ( TaskId id = 0; id < tasks_.size(); id++ )
+      if ( tasks_[id].waitingFor == 0 )
+        ready_.push_back( id );
+    pending_ = tasks_.size();
+
+    threadCount = std::max<size_t>( 1, std::min( threadCount, tasks_.size() ) );
+    vector<std::thread> workers;
+    for ( size_t i = 1; i < threadCount; i++ )
+      workers.emplace_back( &TaskGraph::work, this );
+    work();
+    for ( auto& worker : workers )
+      worker.join();
+
+    for ( auto& task : tasks_ )
+      if ( task.error )
+        std::rethrow_exception( task.error );
+  }
+
+private:
+  struct Task {
+    std::function<void()> fn;
+    vector<TaskId> dependents;
+    size_t waitingFor;
+    std::exception_ptr error;
+    Task():
+        waitingFor( 0 ) {}
+  };
 
-      Upgrade& upgrade = ( isDefault ? defaultUpgrade : upgrades[id] );
-      if ( !isDefault )
+  void work()
+  {
+    std::unique_lock<std::mutex> lock( mutex_ );
+    while ( true )
+    {
+      wake_.wait( lock, [this] { return !ready_.empty() || pending_ == 0; } );
+      if ( ready_.empty() )
+        return;
+      TaskId id = ready_.back();
+      ready_.pop_back();
+
+      lock.unlock();
+      try
       {
-        upgrade.name = id;
-        printf_s( "[+] upgrade: %s\r\n", upgrade.name.c_str() );
+        tasks_[id].fn();
       }
-
-      for ( auto field = entry->FirstChildElement(); field; field = field->NextSiblingElement() )
+      catch ( ... )
       {
-        if ( _strcmpi( field->Name(), "Race" ) == 0 )
-          upgrade.race = raceToEnum( field->Attribute( "value" ) );
-        else if ( _strcmpi( field->Name(), "EffectArray" ) == 0 )
-        {
-          EffectArrayEntry entry;
-          auto operation = field->Attribute( "Operation" );
-          if ( operation )
-            entry.operation = operation;
-          else
-            entry.operation = "Add";
-          auto reference = field->Attribute( "Reference" );
-          if ( !reference )
-            continue;
-          string referenceStr( reference );
-          vector<string> referenceParts;
-          boost::split( referenceParts, referenceStr, boost::is_any_of( "," ) );
-          if ( referenceParts.size() != 3 )
-            continue;
-          entry.referenceType = referenceParts[0];
-          entry.referenceId = referenceParts[1];
-          entry.referenceAttribute = referenceParts[2];
-          auto value = field->Attribute( "Value" );
-          if ( !value )
-            continue;
-          entry.value = value;
-          upgrade.effectArray.push_back( entry );
-        }
+        tasks_[id].error = std::current_exception();
       }
+      lock.lock();
+
+      finish( id, !tasks_[id].error );
+      wake_.notify_all();
     }
   }
-}
 
-const char* raceStr( Race race )
-{
-  if ( race == Race_Terran )
-    return "terran";
-  else if ( race == Race_Zerg )
-    return "zerg";
-  else if ( race == Race_Protoss )
-    return "protoss";
-  else
-    return "neutral";
-}
+  // called with mutex_ held
+  void finish( TaskId id, bool succeeded )
+  {
+    pending_--;
+    for ( auto dep : tasks_[id].dependents )
+    {
+      if ( --tasks_[dep].waitingFor > 0 )
+        continue;
+      if ( succeeded )
+        ready_.push_back( dep );
+      else
+        finish( dep, false );
+    }
+  }
 
-const char* resourceStr( ResourceType type )
-{
-  if ( type == Resource_Minerals )
-    return "minerals";
-  else if ( type == Resource_Vespene )
-    return "vespene";
-  else if ( type == Resource_Terrazine )
-    return "terrazine";
-  else if ( type == Resource_Custom )
-    return "custom";
-  else
-    return "";
-}
+  vector<Task> tasks_;
+  vector<TaskId> ready_;
+  size_t pending_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+};
 
-const char* abilTypeStr( AbilType type )
-{
-  if ( type == AbilType_Build )
-    return "build";
-  else if ( type == AbilType_Morph || type == AbilType_MorphPlacement )
-    return "morph";
-  else if ( type == AbilType_Train )
-    return "train";
-  else if ( type == AbilType_Research )
-    return "research";
-  else
-    return "";
-}
+// Everything the mods' catalogs are merged into, apart from g_aliases.
+struct GameData {
+  UnitMap units;
+  Unit defaultUnit;
+  AbilityMap abilities;
+  RequirementMap requirements;
+  RequirementNodeMap nodes;
+  FootprintMap footprints;
+  Footprint defaultFootprint;
+  WeaponMap weapons;
+  Weapon defaultWeapon;
+  EffectMap effects;
+  UpgradeMap upgrades;
+  Upgrade defaultUpgrade;
+};
+
+// Snapshots hold the merged catalogs after a mod, so a later run can start from the
+// last mod whose files (and whose predecessors' files) did not change. Layout: magic,
+// version, word size, key, section count, then a size-prefixed section per catalog
+// stage. Sections are independent of each other; within one, a symbol is stored by
+// name the first time it appears and by index after that.
+const uint64_t snapshotMagic = 0x504e534447324353ull; // "SC2GDSNP"
+const uint32_t snapshotVersion = 1; // bump whenever a snapshotted struct or a parser changes
 
-void jsonPolyvecWrite( PolygonVector& polyvec, Json::Value& arr )
+class SnapshotWriter
 {
-  for ( auto& poly : polyvec )
+public:
+  template <class... Fields>
+  void operator()( const Fields&... fields )
   {
-    Json::Value jpoly( Json::arrayValue );
-    for ( auto& pt : poly )
+    int expand[] = { 0, ( io( fields ), 0 )... };
+    (void)expand;
+  }
+
+  vector<char>& data()
+  {
+    return data_;
+  }
+
+  template <class T>
+  typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type io( const T& value )
+  {
+    auto bytes = reinterpret_cast<const char*>( &value );
+    data_.insert( data_.end(), bytes, bytes + sizeof( T ) );
+  }
+
+  void io( const string& value )
+  {
+    io( static_cast<uint64_t>( value.size() ) );
+    data_.insert( data_.end(), value.begin(), value.end() );
+  }
+
+  void io( Symbol symbol )
+  {
+    auto it = symbols_.find( symbol );
+    if ( it != symbols_.end() )
     {
-      Json::Value jpt( Json::arrayValue );
-      jpt.append( pt.x );
-      jpt.append( pt.y );
-      jpoly.append( jpt );
+      io( it->second );
+      return;
     }
-    arr.append( jpoly );
+    uint32_t index = static_cast<uint32_t>( symbols_.size() );
+    symbols_[symbol] = index;
+    io( index );
+    io( symbol.str() );
   }
-}
 
-void resolveFootprint( const string& name, FootprintMap& footprints, Json::Value& out )
-{
-  if ( name.empty() || footprints.find( name ) == footprints.end() )
-    return;
+  template <class T, class Alloc>
+  void io( const vector<T, Alloc>& values )
+  {
+    io( static_cast<uint64_t>( values.size() ) );
+    for ( auto& value : values )
+      io( value );
+  }
 
-  auto& fp = footprints[name];
+  template <class T, class Less, class Alloc>
+  void io( const set<T, Less, Alloc>& values )
+  {
+    io( static_cast<uint64_t>( values.size() ) );
+    for ( auto& value : values )
+      io( value );
+  }
 
-  out["name"] = fp.id;
+  template <class K, class V, class Less, class Alloc>
+  void io( const std::map<K, V, Less, Alloc>& values )
+  {
+    io( static_cast<uint64_t>( values.size() ) );
+    for ( auto& value : values )
+      ( *this )( value.first, value.second );
+  }
 
-  Json::Value shapes( Json::objectValue );
-  shapes["radius"] = fp.shape.radius;
-  Json::Value polygons( Json::arrayValue );
-  jsonPolyvecWrite( fp.shape.unpathablePolys, polygons );
-  shapes["unpathable"] = polygons;
-  polygons.clear();
-  jsonPolyvecWrite( fp.shape.buildingPolys, polygons );
-  shapes["building"] = polygons;
-  out["shape"] = shapes;
+  template <class T>
+  void io( const SymbolMap<T>& values )
+  {
+    io( static_cast<uint64_t>( values.size() ) );
+    for ( auto& value : values )
+      ( *this )( value.first, value.second );
+  }
 
-  Json::Value offset( Json::arrayValue );
-  offset.append( fp.x );
-  offset.append( fp.y );
-  out["offset"] = offset;
+  template <class T>
+  void io( const CopyOnWrite<T>& value )
+  {
+    io( value.get() );
+  }
 
-  Json::Value dim( Json::arrayValue );
-  dim.append( fp.w );
-  dim.append( fp.h );
-  out["dimensions"] = dim;
+  // catalog structs; snapshotFields() takes them by non-const reference because the
+  // reader uses the same field lists, but writing only reads them
+  template <class T>
+  auto io( const T& value ) -> decltype( snapshotFields( std::declval<SnapshotWriter&>(), std::declval<T&>() ) )
+  {
+    snapshotFields( *this, const_cast<T&>( value ) );
+  }
 
-  string data;
-  for ( int y = 0; y < fp.h; y++ )
-    for ( int x = 0; x < fp.w; x++ )
-    {
-      auto idx = y * fp.w + x;
-      data.append( ( fp.placement[idx] ? "x" : fp.creep[idx] ? "o" : fp.nearResources[idx] ? "n" : "." ) );
-    }
-  out["data"] = data;
-}
+private:
+  vector<char> data_;
+  std::unordered_map<Symbol, uint32_t> symbols_;
+};
 
-void dumpUnits( UnitMap& units, FootprintMap& footprints )
+class SnapshotReader
 {
-  printf_s( "[d] dumping units...\r\n" );
+public:
+  SnapshotReader( const char* begin, const char* end ):
+      pos_( begin ), end_( end ) {}
 
-  ofstream out;
-  out.open( "units.json" );
+  template <class... Fields>
+  void operator()( Fields&... fields )
+  {
+    int expand[] = { 0, ( io( fields ), 0 )... };
+    (void)expand;
+  }
 
-  Json::Value root;
-  for ( auto& unit : units )
+  bool atEnd() const
   {
-    if ( unit.second.lifeStart == 0 && unit.second.lifeMax == 0 )
-      continue;
+    return pos_ == end_;
+  }
 
-    Json::Value uval( Json::objectValue );
-    uval["name"] = unit.second.name;
+  // the next size bytes, as they are
+  const char* take( uint64_t size )
+  {
+    if ( size > static_cast<uint64_t>( end_ - pos_ ) )
+      throw runtime_error( "snapshot is truncated" );
+    auto data = pos_;
+    pos_ += size;
+    return data;
+  }
 
-    uval["race"] = raceStr( unit.second.race );
-    uval["food"] = unit.second.food;
+  template <class T>
+  typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type io( T& value )
+  {
+    memcpy( &value, take( sizeof( T ) ), sizeof( T ) );
+  }
 
-    uval["mineralCost"] = static_cast<Json::UInt64>( unit.second.mineralCost );
-    uval["vespeneCost"] = static_cast<Json::UInt64>( unit.second.vespeneCost );
+  void io( string& value )
+  {
+    uint64_t size;
+    io( size );
+    auto data = take( size );
+    value.assign( data, static_cast<size_t>( size ) );
+  }
 
-    uval["speed"] = unit.second.speed;
-    uval["acceleration"] = unit.second.acceleration;
-    uval["speedMultiplierCreep"] = unit.second.speedMultiplierCreep;
+  void io( Symbol& symbol )
+  {
+    uint32_t index;
+    io( index );
+    if ( index == symbols_.size() )
+    {
+      string name;
+      io( name );
+      symbols_.emplace_back( name );
+    }
+    else if ( index > symbols_.size() )
+      throw runtime_error( "snapshot refers to an unknown symbol" );
+    symbol = symbols_[index];
+  }
 
-    uval["radius"] = unit.second.radius;
-    uval["sight"] = unit.second.sight;
+  template <class T, class Alloc>
+  void io( vector<T, Alloc>& values )
+  {
+    values.resize( static_cast<size_t>( count() ) );
+    for ( auto& value : values )
+      io( value );
+  }
 
-    uval["lifeStart"] = unit.second.lifeStart;
-    uval["lifeMax"] = unit.second.lifeMax;
-    uval["lifeRegenRate"] = unit.second.lifeRegenRate;
-    uval["lifeArmor"] = static_cast<Json::UInt64>( unit.second.lifeArmor );
-    uval["shieldsStart"] = unit.second.shieldsStart;
-    uval["shieldsMax"] = unit.second.shieldsMax;
+  template <class T, class Less, class Alloc>
+  void io( set<T, Less, Alloc>& values )
+  {
+    values.clear();
+    for ( auto n = count(); n > 0; n-- )
+    {
+      T value;
+      io( value );
+      values.insert( values.end(), std::move( value ) );
+    }
+  }
 
-    uval["energyStart"] = unit.second.energyStart;
-    uval["energyMax"] = unit.second.energyMax;
-    uval["energyRegenRate"] = unit.second.energyRegenRate;
+  template <class K, class V, class Less, class Alloc>
+  void io( std::map<K, V, Less, Alloc>& values )
+  {
+    values.clear();
+    for ( auto n = count(); n > 0; n-- )
+    {
+      K key;
+      io( key );
+      io( values[key] );
+    }
+  }
 
-    uval["light"] = unit.second.light;
-    uval["biological"] = unit.second.biological;
-    uval["mechanical"] = unit.second.mechanical;
-    uval["armored"] = unit.second.armored;
-    uval["structure"] = unit.second.structure;
-    uval["psionic"] = unit.second.psionic;
-    uval["massive"] = unit.second.massive;
-    uval["cargoSize"] = static_cast<Json::UInt64>( unit.second.cargoSize );
-    uval["turningRate"] = unit.second.turningRate;
+  template <class T>
+  void io( SymbolMap<T>& values )
+  {
+    for ( auto n = count(); n > 0; n-- )
+    {
+      Symbol key;
+      io( key );
+      io( values[key] );
+    }
+  }
 
-    uval["shieldRegenDelay"] = unit.second.shieldRegenDelay;
-    uval["shieldRegenRate"] = unit.second.shieldRegenRate;
-    uval["mover"] = unit.second.mover;
+  template <class T>
+  void io( CopyOnWrite<T>& value )
+  {
+    T contents;
+    io( contents );
+    value = CopyOnWrite<T>();
+    if ( !contents.empty() )
+      value = CopyOnWrite<T>( std::move( contents ) );
+  }
 
-    uval["scoreMake"] = static_cast<Json::UInt64>( unit.second.scoreMake );
-    uval["scoreKill"] = static_cast<Json::UInt64>( unit.second.scoreKill );
+  template <class T>
+  auto io( T& value ) -> decltype( snapshotFields( std::declval<SnapshotReader&>(), value ) )
+  {
+    snapshotFields( *this, value );
+  }
 
-    Json::Value collval( Json::arrayValue );
-    for ( auto& c : unit.second.collides )
-      collval.append( c );
-    uval["collides"] = collval;
+private:
+  // element count of a container; every element takes at least a byte
+  uint64_t count()
+  {
+    uint64_t n;
+    io( n );
+    if ( n > static_cast<uint64_t>( end_ - pos_ ) )
+      throw runtime_error( "snapshot is truncated" );
+    return n;
+  }
 
-    uval["attackTargetPriority"] = unit.second.attackTargetPriority;
-    uval["stationaryTurningRate"] = unit.second.stationaryTurningRate;
-    uval["lateralAcceleration"] = unit.second.lateralAcceleration;
+  const char* pos_;
+  const char* end_;
+  vector<Symbol> symbols_;
+};
 
-    Json::Value techals( Json::arrayValue );
-    if ( !unit.second.techAliases.empty() )
-      for ( auto& a : unit.second.techAliases )
-        if ( !a.empty() )
-          techals.append( a );
+using LoadedCatalogs = vector<std::unique_ptr<CatalogReader>>;
 
-    uval["techAlias"] = techals;
+// One kind of catalog: the files it is read from, how they are merged into the maps, and
+// the part of the merged state that makes up its snapshot section.
+struct CatalogStage {
+  const char* name;
+  vector<const char*> files;
+  std::function<void( const LoadedCatalogs& )> merge;
+  std::function<void( SnapshotWriter& )> save;
+  std::function<void( SnapshotReader& )> load;
+};
 
-    uval["aiEvalFactor"] = unit.second.aiEvalFactor;
+template <class... State>
+CatalogStage catalogStage( const char* name, vector<const char*> files, std::function<void( const LoadedCatalogs& )> merge, State&... state )
+{
+  return { name, std::move( files ), std::move( merge ), [&state...]( SnapshotWriter& ar ) { ar( state... ); }, [&state...]( SnapshotReader& ar ) { ar( state... ); } };
+}
 
-    string evalAs = unit.second.aiEvaluateAlias;
-    boost::replace_all( evalAs, "##id##", unit.second.name );
-    if ( !evalAs.empty() )
-    {
-      if ( g_unitMapping.find( evalAs ) != g_unitMapping.end() )
-      {
-        auto evalid = g_unitMapping[evalAs];
-        if ( evalid != 0 && evalid != g_unitMapping[unit.second.name] )
-          uval["aiEvaluateAs"] = static_cast<Json::UInt64>( evalid );
-      }
-      if ( !boost::iequals( unit.second.name, evalAs ) )
-        uval["aiEvaluateAsName"] = evalAs;
-    }
+vector<CatalogStage> catalogStages( GameData& data )
+{
+  // Every catalog goes into its own maps, so the catalogs are independent of each other.
+  // The only shared state is g_aliases, which the unit parser fills and nothing reads
+  // until the tech tree is generated, after all the mods are in.
+  return {
+      catalogStage( "units", { "UnitData.xml" }, [&]( const LoadedCatalogs& files ) { parseUnitData( *files[0], data.units, data.defaultUnit ); }, data.units, data.defaultUnit, g_aliases ),
+      catalogStage( "abilities", { "AbilData.xml" }, [&]( const LoadedCatalogs& files ) { parseAbilityData( *files[0], data.abilities ); }, data.abilities ),
+      catalogStage( "requirements", { "RequirementData.xml", "RequirementNodeData.xml" }, [&]( const LoadedCatalogs& files ) { parseRequirementData( *files[0], *files[1], data.requirements, data.nodes ); }, data.requirements, data.nodes ),
+      catalogStage( "footprints", { "FootprintData.xml" }, [&]( const LoadedCatalogs& files ) { parseFootprintData( *files[0], data.footprints, data.defaultFootprint ); }, data.footprints, data.defaultFootprint ),
+      catalogStage( "weapons", { "WeaponData.xml" }, [&]( const LoadedCatalogs& files ) { parseWeaponData( *files[0], data.weapons, data.defaultWeapon ); }, data.weapons, data.defaultWeapon ),
+      catalogStage( "effects", { "EffectData.xml" }, [&]( const LoadedCatalogs& files ) { parseEffectData( *files[0], data.effects ); }, data.effects ),
+      catalogStage( "upgrades", { "UpgradeData.xml" }, [&]( const LoadedCatalogs& files ) { parseUpgradeData( *files[0], data.upgrades, data.defaultUpgrade ); }, data.upgrades, data.defaultUpgrade ),
+  };
+}
 
-    string glosAl = unit.second.glossaryAlias;
-    boost::replace_all( glosAl, "##id##", unit.second.name );
-    if ( !glosAl.empty() )
-    {
-      if ( g_unitMapping.find( glosAl ) != g_unitMapping.end() )
-      {
-        auto glosid = g_unitMapping[glosAl];
-        if ( glosid != 0 && glosid != g_unitMapping[unit.second.name] )
-          uval["glossaryAlias"] = static_cast<Json::UInt64>( glosid );
-      }
-      if ( !boost::iequals( unit.second.name, glosAl ) )
-        uval["glossaryAliasName"] = glosAl;
-    }
+// One MurmurHash3 round: each word is scrambled before it is folded in, so words
+// cannot cancel out the way they do with a plain xor-multiply.
+inline uint64_t hashMix( uint64_t hash, uint64_t word )
+{
+  word *= 0x87c37b91114253d5ull;
+  word = ( word << 31 ) | ( word >> 33 );
+  word *= 0x4cf5ad432745937full;
+  hash ^= word;
+  hash = ( hash << 27 ) | ( hash >> 37 );
+  return hash * 5 + 0x52dce729;
+}
 
-    Json::Value planeval( Json::arrayValue );
-    for ( auto& c : unit.second.planeArray )
-      planeval.append( c );
-    uval["planes"] = planeval;
+// MurmurHash3's fmix64, so that every input bit affects every bit of a key.
+inline uint64_t hashFinish( uint64_t hash )
+{
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  return hash ^ ( hash >> 33 );
+}
 
-    Json::Value fp( Json::objectValue );
-    resolveFootprint( unit.second.footprint, footprints, fp );
-    uval["footprint"] = fp;
+inline uint64_t hashString( uint64_t hash, const string& str )
+{
+  for ( unsigned char c : str )
+    hash = hashMix( hash, c );
+  return hashMix( hash, str.size() );
+}
 
-    Json::Value resval( Json::arrayValue );
-    if ( unit.second.resourceType != Resource_None )
+// Covers each file's name and size as well as its bytes.
+uint64_t hashFiles( const string& dir, const vector<const char*>& names )
+{
+  uint64_t hash = 14695981039346656037ull;
+  for ( auto name : names )
+  {
+    string path = dir + PATHSEP + name;
+    MappedFile file( path );
+    auto data = file.data();
+    size_t size = file.size();
+    hash = hashMix( hashString( hash, path ), size );
+    size_t i = 0;
+    for ( ; i + sizeof( uint64_t ) <= size; i += sizeof( uint64_t ) )
     {
-      resval.append( resourceStr( unit.second.resourceType ) );
-      resval.append( unit.second.resourceHarvestable ? "harvestable" : "raw" );
+      uint64_t word;
+      memcpy( &word, data + i, sizeof( word ) );
+      hash = hashMix( hash, word );
     }
-    uval["resource"] = resval;
-    uval["invulnerable"] = unit.second.invulnerable;
-
-    Json::Value weapons( Json::arrayValue );
-    for ( auto& weapon : unit.second.weapons )
-      weapons.append( weapon );
-    uval["weapons"] = weapons;
+    uint64_t tail = 0;
+    for ( size_t shift = 0; i < size; i++, shift += 8 )
+      tail |= static_cast<uint64_t>( static_cast<unsigned char>( data[i] ) ) << shift;
+    hash = hashMix( hash, tail );
+  }
+  return hashFinish( hash );
+}
 
-    Json::Value abils( Json::arrayValue );
-    //for ( auto& abil : unit.second.abilityCommands )
-    //  abils.append( abil );
-    for ( auto& card : unit.second.abilityCardsMap )
-      if ( !card.second.removed )
-        for ( auto& abil : card.second.commands )
-          if ( !abil.second.empty() )
-            abils.append( abil.second );
+// Content hash of each stage's files in each mod, indexed [mod][stage].
+using CatalogHashes = vector<vector<uint64_t>>;
 
-    uval["abilityCommands"] = abils;
+CatalogHashes hashCatalogs( const vector<string>& gameDataPaths, const vector<CatalogStage>& stages )
+{
+  CatalogHashes hashes( gameDataPaths.size(), vector<uint64_t>( stages.size() ) );
+  TaskGraph graph;
+  for ( size_t mod = 0; mod < gameDataPaths.size(); mod++ )
+    for ( size_t stage = 0; stage < stages.size(); stage++ )
+      graph.add( [&, mod, stage] { hashes[mod][stage] = hashFiles( gameDataPaths[mod], stages[stage].files ); } );
+  graph.run();
+  return hashes;
+}
 
-    root[std::to_string( g_unitMapping[unit.second.name] )] = uval;
+// Failing to write a snapshot only costs the next run some time, so it is not an error.
+void writeSnapshot( const string& path, uint64_t key, const vector<vector<char>>& sections )
+{
+  SnapshotWriter header;
+  header( snapshotMagic, snapshotVersion, static_cast<uint32_t>( sizeof( size_t ) ), key, static_cast<uint32_t>( sections.size() ) );
+  uint64_t total = header.data().size();
+  string temp = path + ".tmp";
+  ofstream out( temp, std::ios::binary | std::ios::trunc );
+  out.write( header.data().data(), header.data().size() );
+  for ( auto& section : sections )
+  {
+    uint64_t size = section.size();
+    out.write( reinterpret_cast<const char*>( &size ), sizeof( size ) );
+    out.write( section.data(), section.size() );
+    total += sizeof( size ) + size;
   }
-
-  Json::StreamWriterBuilder builder;
-  builder["commentStyle"] = "None";
-  builder["indentation"] = "  ";
-  std::unique_ptr<Json::StreamWriter> writer( builder.newStreamWriter() );
-  writer->write( root, &out );
-
   out.close();
+  std::remove( path.c_str() );
+  if ( !out || std::rename( temp.c_str(), path.c_str() ) != 0 )
+  {
+    std::remove( temp.c_str() );
+    printf_s( "[s] could not write snapshot %s\r\n", path.c_str() );
+    return;
+  }
+  printf_s( "[s] wrote snapshot %s: %llu bytes\r\n", path.c_str(), static_cast<unsigned long long>( total ) );
 }
 
-bool resolveRequirements( const string& useNodeName, Json::Value& rqtmp, RequirementMap& requirements, RequirementNodeMap& nodes )
+// Returns false if there is no snapshot for this key; throws if there is one but it
+// cannot be read, in which case the maps are left half filled.
+bool loadSnapshot( const string& path, uint64_t key, const vector<CatalogStage>& stages )
 {
-  if ( nodes.find( useNodeName ) == nodes.end() || useNodeName.size() < 5 ) // quick hack to identify numerals
+  if ( !std::ifstream( path ).good() )
+    return false;
+  MappedFile file( path );
+  SnapshotReader header( file.data(), file.data() + file.size() );
+  uint64_t magic, storedKey;
+  uint32_t version, wordSize, sectionCount;
+  header( magic, version, wordSize, storedKey, sectionCount );
+  if ( magic != snapshotMagic || version != snapshotVersion || wordSize != sizeof( size_t ) || storedKey != key || sectionCount != stages.size() )
+    return false;
+
+  TaskGraph graph;
+  for ( auto& stage : stages )
   {
-    rqtmp["type"] = "value";
-    rqtmp["value"] = atoi( useNodeName.c_str() );
-    return true;
+    uint64_t size;
+    header.io( size );
+    auto begin = header.take( size );
+    graph.add( [&stage, begin, size] {
+      SnapshotReader reader( begin, begin + size );
+      stage.load( reader );
+      if ( !reader.atEnd() )
+        throw runtime_error( "snapshot section has trailing data" );
+    } );
   }
-  auto& node = nodes[useNodeName];
-  if ( node.type != ReqNode_Unknown )
+  graph.run();
+  printf_s( "[s] loaded snapshot %s: %llu bytes\r\n", path.c_str(), static_cast<unsigned long long>( file.size() ) );
+  return true;
+}
+
+// The hashes are only needed, and only given, when snapshots are on.
+void readGameData( const vector<string>& gameDataPaths, const vector<CatalogStage>& stages, const CatalogHashes& hashes, const string& snapshotPath, GameData& data )
+{
+  // Start after the longest prefix of the mods that has a snapshot for its current files.
+  size_t first = 0;
+  vector<uint64_t> keys;
+  vector<string> snapshots;
+  if ( !snapshotPath.empty() )
   {
-    if ( node.type == ReqNode_LogicAnd || node.type == ReqNode_LogicOr || node.type == ReqNode_LogicEq || node.type == ReqNode_LogicNot )
+    uint64_t key = ( static_cast<uint64_t>( snapshotVersion ) << 32 ) | sizeof( size_t );
+    for ( size_t mod = 0; mod < gameDataPaths.size(); mod++ )
     {
-      if ( node.operands.empty() )
-        return false;
-      rqtmp["type"] = ( node.type == ReqNode_LogicAnd ? "and" : node.type == ReqNode_LogicOr ? "or" : node.type == ReqNode_LogicEq ? "eq" : "not" );
-      Json::Value rqops( Json::arrayValue );
-      for ( auto& op : node.operands )
-      {
-        Json::Value optmp( Json::objectValue );
-        if ( !resolveRequirements( op.second, optmp, requirements, nodes ) )
-          continue;
-        rqops.append( optmp );
-      }
-      rqtmp["operands"] = rqops;
+      for ( auto hash : hashes[mod] )
+        key = hashMix( key, hash );
+      keys.push_back( hashFinish( key ) );
+      char name[64];
+      sprintf_s( name, 64, "%02u-%016llx.snapshot", static_cast<unsigned>( mod ), static_cast<unsigned long long>( keys.back() ) );
+      snapshots.push_back( snapshotPath + PATHSEP + name );
     }
-    else
+    for ( size_t mod = gameDataPaths.size(); mod > 0 && first == 0; mod-- )
     {
-      rqtmp["type"] = ( node.type == ReqNode_CountUnit ? "unitCount" : node.type == ReqNode_CountUpgrade ? "upgradeCount" : "" );
-      if ( node.type == ReqNode_CountUnit )
+      try
       {
-        Json::Value namesVal( Json::arrayValue );
-        Json::Value idsVal( Json::arrayValue );
-        for ( auto& name : resolveAlias( node.countLink ) )
-        {
-          namesVal.append( name );
-          idsVal.append( static_cast<Json::UInt64>( g_unitMapping[name] ) );
-        }
-        rqtmp["unitName"] = namesVal;
-        rqtmp["unit"] = idsVal;
+        if ( loadSnapshot( snapshots[mod - 1], keys[mod - 1], stages ) )
+          first = mod;
       }
-      else if ( node.type == ReqNode_CountUpgrade )
+      catch ( std::exception& e )
       {
-        rqtmp["upgradeName"] = node.countLink;
-        rqtmp["upgrade"] = static_cast<Json::UInt64>( g_upgradeMapping[node.countLink] );
+        printf_s( "[s] ignoring snapshot %s: %s\r\n", snapshots[mod - 1].c_str(), e.what() );
+        data = GameData();
+        g_aliases = AliasMap();
       }
-      if ( !node.countState.empty() )
-        rqtmp["state"] = node.countState;
     }
-    return true;
   }
-  else
-    return false;
+
+  // Mods are incremental patches, so each catalog is merged one mod after another.
+  // Loading a file (mapping it and scanning its tags) does not touch the maps, so it runs
+  // a mod ahead: mod N+1's files are loaded while mod N's tags are handed to the parsers
+  // and merged.
+  // Loading waits for the merge of mod N-1, so at most two mods' worth of a catalog is
+  // mapped at a time.
+  // With snapshots on, each catalog's section is serialized right after its merge, and
+  // the next mod's merge of that catalog waits for it instead.
+  vector<vector<LoadedCatalogs>> loaded( gameDataPaths.size() );
+  for ( auto& modFiles : loaded )
+    modFiles.resize( stages.size() );
+  vector<vector<TaskGraph::TaskId>> merged( gameDataPaths.size(), vector<TaskGraph::TaskId>( stages.size() ) );
+  vector<vector<vector<char>>> sections( gameDataPaths.size(), vector<vector<char>>( stages.size() ) );
+  TaskGraph graph;
+  for ( size_t mod = first; mod < gameDataPaths.size(); mod++ )
+  {
+    for ( size_t stage = 0; stage < stages.size(); stage++ )
+    {
+      vector<TaskGraph::TaskId> loadDeps;
+      if ( mod >= first + 2 )
+        loadDeps.push_back( merged[mod - 2][stage] );
+      auto load = graph.add( [&, mod, stage] {
+        for ( auto file : stages[stage].files )
+          loaded[mod][stage].emplace_back( new CatalogReader( gameDataPaths[mod] + PATHSEP + file ) );
+      }, loadDeps );
+
+      vector<TaskGraph::TaskId> mergeDeps = { load };
+      if ( mod >= first + 1 )
+        mergeDeps.push_back( merged[mod - 1][stage] );
+      merged[mod][stage] = graph.add( [&, mod, stage] {
+        stages[stage].merge( loaded[mod][stage] );
+        loaded[mod][stage].clear();
+      }, mergeDeps );
+
+      if ( !snapshots.empty() )
+        merged[mod][stage] = graph.add( [&, mod, stage] {
+          SnapshotWriter writer;
+          stages[stage].save( writer );
+          sections[mod][stage].swap( writer.data() );
+        }, { merged[mod][stage] } );
+    }
+    if ( !snapshots.empty() )
+      graph.add( [&, mod] {
+        writeSnapshot( snapshots[mod], keys[mod], sections[mod] );
+        sections[mod].clear();
+      }, merged[mod] );
+  }
+  graph.run();
 }
 
-size_t resolveAbilityCmd( const string& ability, const string& command )
+// One section of stableid.json, both ways round.
+struct StableIDTable {
+  NameToIDMapping& ids;
+  IDToNameMapping& names;
+};
+
+// Reads stableid.json straight out of the mapped file in one pass. Only the id, name and
+// index of the Units, Abilities and Upgrades entries are decoded, into buffers that are
+// reused from entry to entry; everything else is skipped over. Like the JsonCpp reader it
+// replaces, a later entry with the same name wins, and missing fields read as 0 or "".
+class StableIDReader
 {
-  size_t cmdindex = 0;
-  if ( boost::iequals( command, "Execute" ) ) // morphs
-    cmdindex = 0;
-  else if ( command.size() > 5 && boost::iequals( command.substr( 0, 5 ), "Build" ) ) // builds
+public:
+  StableIDReader( const char* begin, const char* end ):
+      begin_( begin ), pos_( begin ), end_( end ) {}
+
+  void read( StableIDTable units, StableIDTable abilities, StableIDTable upgrades )
   {
-    string numpart = command.substr( 5 );
-    cmdindex = ( atoi( numpart.c_str() ) - 1 );
+    expect( '{' );
+    if ( !next( '}' ) )
+      do
+      {
+        text( key_ );
+        expect( ':' );
+        if ( key_ == "Units" )
+          section( units, false );
+        else if ( key_ == "Abilities" )
+          section( abilities, true );
+        else if ( key_ == "Upgrades" )
+          section( upgrades, false );
+        else
+          skip();
+      } while ( next( ',' ) );
+    expect( '}' );
   }
-  else if ( command.size() > 5 && boost::iequals( command.substr( 0, 5 ), "Train" ) ) // trains
+
+private:
+  static const size_t maxID = 1 << 20;
+
+  // abilities are keyed by "name,index"
+  void section( StableIDTable table, bool indexed )
   {
-    string numpart = command.substr( 5 );
-    cmdindex = ( atoi( numpart.c_str() ) - 1 );
+    expect( '[' );
+    if ( next( ']' ) )
+      return;
+    do
+    {
+      uint64_t id = 0;
+      name_.clear();
+      index_.clear();
+      expect( '{' );
+      if ( !next( '}' ) )
+        do
+        {
+          text( key_ );
+          expect( ':' );
+          if ( key_ == "id" )
+            id = number();
+          else if ( key_ == "name" )
+            text( name_ );
+          else if ( key_ == "index" && indexed )
+            scalar( index_ );
+          else
+            skip();
+        } while ( next( ',' ) );
+      expect( '}' );
+
+      if ( indexed )
+      {
+        name_ += ',';
+        name_ += index_;
+      }
+      if ( id >= maxID )
+        fail( "id out of range" );
+      Symbol name( name_ );
+      table.ids[name] = static_cast<size_t>( id );
+      if ( id >= table.names.size() )
+        table.names.resize( static_cast<size_t>( id ) + 1 );
+      table.names[static_cast<size_t>( id )] = name;
+    } while ( next( ',' ) );
+    expect( ']' );
   }
-  else if ( command.size() > 8 && boost::iequals( command.substr( 0, 8 ), "Research" ) ) // researches
+
+  void space()
   {
-    string numpart = command.substr( 8 );
-    cmdindex = ( atoi( numpart.c_str() ) - 1 );
+    while ( pos_ != end_ && ( *pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t' ) )
+      pos_++;
   }
-  string idx = ( ability + "," );
-  idx.append( std::to_string( cmdindex ) );
 
-  return g_abilityMapping[idx];
-}
+  // consumes c if it comes next
+  bool next( char c )
+  {
+    space();
+    if ( pos_ == end_ || *pos_ != c )
+      return false;
+    pos_++;
+    return true;
+  }
 
-void filtersToJSON( std::set<FilterAttribute>& attribs, Json::Value& out )
-{
-  for ( const auto& tk : attribs )
+  void expect( char c )
   {
-    if ( tk == Search_Ground )
-      out.append( "ground" );
-    if ( tk == Search_Structure )
-      out.append( "structure" );
-    if ( tk == Search_Self )
-      out.append( "self" );
-    if ( tk == Search_Player )
-      out.append( "player" );
-    if ( tk == Search_Ally )
-      out.append( "ally" );
-    if ( tk == Search_Air )
-      out.append( "air" );
-    if ( tk == Search_Stasis )
-      out.append( "stasis" );
+    if ( !next( c ) )
+      fail( string( "expected " ) + c );
   }
-};
 
-bool resolveEffect( const string& owner, string name, Json::Value& out, EffectMap& effects )
-{
-  boost::replace_all( name, "##id##", owner );
-  if ( effects.find( name ) != effects.end() )
+  void text( string& out )
   {
-    Json::Value eval( Json::objectValue );
-    auto& fx = effects[name];
-    eval["name"] = fx.name;
-    if ( fx.type == Effect::Effect_Missile )
+    expect( '"' );
+    out.clear();
+    while ( true )
     {
-      eval["type"] = "missile";
-      Json::Value subentry;
-      if ( resolveEffect( name, fx.impactEffect, subentry, effects ) )
-        eval["impact"] = subentry;
+      auto start = pos_;
+      while ( pos_ != end_ && *pos_ != '"' && *pos_ != '\\' )
+        pos_++;
+      out.append( start, pos_ );
+      if ( pos_ == end_ )
+        fail( "unterminated string" );
+      if ( *pos_++ == '"' )
+        return;
+      if ( pos_ == end_ )
+        fail( "unterminated string" );
+      char escaped = *pos_++;
+      switch ( escaped )
+      {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': codePoint( out ); break;
+        default: out += escaped; break;
+      }
     }
-    else if ( fx.type == Effect::Effect_Damage )
-      eval["type"] = "damage";
-    else if ( fx.type == Effect::Effect_CreateUnit )
-      eval["type"] = "createUnit";
-    else if ( fx.type == Effect::Effect_CreateHealer )
-      eval["type"] = "createHealer";
-    else if ( fx.type == Effect::Effect_Other )
-      eval["type"] = "unknown";
-    else if ( fx.type == Effect::Effect_Set )
+  }
+
+  // \uXXXX, possibly a surrogate pair, as UTF-8
+  void codePoint( string& out )
+  {
+    auto hex4 = [this]() {
+      if ( end_ - pos_ < 4 )
+        fail( "bad \\u escape" );
+      unsigned value = 0;
+      for ( int i = 0; i < 4; i++ )
+      {
+        char c = *pos_++;
+        value <<= 4;
+        if ( c >= '0' && c <= '9' )
+          value |= c - '0';
+        else if ( c >= 'a' && c <= 'f' )
+          value |= c - 'a' + 10;
+        else if ( c >= 'A' && c <= 'F' )
+          value |= c - 'A' + 10;
+        else
+          fail( "bad \\u escape" );
+      }
+      return value;
+    };
+    unsigned cp = hex4();
+    if ( cp >= 0xD800 && cp < 0xDC00 && end_ - pos_ >= 6 && pos_[0] == '\\' && pos_[1] == 'u' )
     {
-      eval["type"] = "set";
-      Json::Value subfx( Json::arrayValue );
-      for ( auto& p : fx.setSubEffects )
-        if ( !p.second.empty() )
-        {
-          Json::Value subentry;
-          if ( resolveEffect( name, p.second, subentry, effects ) )
-            subfx.append( subentry );
-        }
-      eval["setEffects"] = subfx;
+      pos_ += 2;
+      cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( hex4() - 0xDC00 );
     }
-    else if ( fx.type == Effect::Effect_Persistent )
+    if ( cp < 0x80 )
+      out += static_cast<char>( cp );
+    else if ( cp < 0x800 )
     {
-      eval["type"] = "persistent";
-      Json::Value subfx( Json::arrayValue );
-      for ( auto& p : fx.persistentEffects )
-        if ( !p.empty() )
-        {
-          Json::Value subentry;
-          if ( resolveEffect( name, p, subentry, effects ) )
-            subfx.append( subentry );
-        }
-      Json::Value periods( Json::arrayValue );
-      for ( auto p : fx.persistentPeriods )
-        periods.append( p );
-      eval["setEffects"] = subfx;
-      if ( fx.periodCount > 0 )
-        eval["persistentCount"] = static_cast<Json::UInt64>( fx.periodCount );
-      if ( !fx.persistentPeriods.empty() )
-        eval["persistentPeriods"] = periods;
+      out += static_cast<char>( 0xC0 | ( cp >> 6 ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
+    }
+    else if ( cp < 0x10000 )
+    {
+      out += static_cast<char>( 0xE0 | ( cp >> 12 ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
+    }
+    else
+    {
+      out += static_cast<char>( 0xF0 | ( cp >> 18 ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+      out += static_cast<char>( 0x80 | ( cp & 0x3F ) );
     }
+  }
 
-    if ( !fx.searchRequires.empty() )
+  uint64_t number()
+  {
+    space();
+    if ( pos_ != end_ && *pos_ == 'n' )
     {
-      Json::Value reqs( Json::arrayValue );
-      filtersToJSON( fx.searchRequires, reqs );
-      eval["searchRequires"] = reqs;
+      literal();
+      return 0;
     }
-    if ( !fx.searchExcludes.empty() )
+    if ( pos_ == end_ || *pos_ < '0' || *pos_ > '9' )
+      fail( "expected an id" );
+    uint64_t value = 0;
+    while ( pos_ != end_ && *pos_ >= '0' && *pos_ <= '9' )
+      value = value * 10 + ( *pos_++ - '0' );
+    return value;
+  }
+
+  // a string or an integer as text, null as ""
+  void scalar( string& out )
+  {
+    space();
+    out.clear();
+    if ( pos_ != end_ && *pos_ == '"' )
+      text( out );
+    else if ( pos_ != end_ && *pos_ == 'n' )
+      literal();
+    else
     {
-      Json::Value excls( Json::arrayValue );
-      filtersToJSON( fx.searchExcludes, excls );
-      eval["searchExcludes"] = excls;
+      auto start = pos_;
+      if ( pos_ != end_ && *pos_ == '-' )
+        pos_++;
+      while ( pos_ != end_ && *pos_ >= '0' && *pos_ <= '9' )
+        pos_++;
+      if ( pos_ == start )
+        fail( "expected an index" );
+      out.assign( start, pos_ );
     }
+  }
+
+  void literal()
+  {
+    while ( pos_ != end_ && *pos_ >= 'a' && *pos_ <= 'z' )
+      pos_++;
+  }
 
-    if ( fx.type == Effect::Effect_Damage )
+  void skip()
+  {
+    space();
+    if ( pos_ == end_ )
+      fail( "unexpected end" );
+    char c = *pos_;
+    if ( c == '"' )
+      text( skipped_ );
+    else if ( c == '{' || c == '[' )
     {
-      if ( fx.flagKill && fx.impactLocation == Effect::Impact_SourceUnit )
-      {
-        eval["type"] = "suicide";
-      }
-      else
+      char close = ( c == '{' ? '}' : ']' );
+      pos_++;
+      if ( next( close ) )
+        return;
+      do
       {
-        eval["dmgAmount"] = fx.damageAmount;
-        eval["dmgArmorReduction"] = fx.damageArmorReduction;
-        eval["dmgKind"] = fx.damageKind;
-        Json::Value attribBonuses( Json::objectValue );
-        for ( auto& attribPair : fx.attributeBonuses )
-          if ( attribPair.second.value != 0.0 )
-            attribBonuses[attribPair.first] = attribPair.second.value;
-        eval["dmgAttributeBonuses"] = attribBonuses;
-        Json::Value splash( Json::arrayValue );
-        for ( auto& area : fx.splashArea )
+        if ( c == '{' )
         {
-          Json::Value entry( Json::objectValue );
-          entry["fraction"] = area.second.fraction;
-          entry["radius"] = area.second.radius;
-          splash.append( entry );
+          text( skipped_ );
+          expect( ':' );
         }
-        eval["dmgSplash"] = splash;
-      }
+        skip();
+      } while ( next( ',' ) );
+      expect( close );
+    }
+    else
+    {
+      auto start = pos_;
+      while ( pos_ != end_ && ( ( *pos_ >= '0' && *pos_ <= '9' ) || ( *pos_ >= 'a' && *pos_ <= 'z' ) || *pos_ == '-' || *pos_ == '+' || *pos_ == '.' || *pos_ == 'E' ) )
+        pos_++;
+      if ( pos_ == start )
+        fail( "unexpected character" );
     }
+  }
 
-    out = eval;
-    return true;
+  [[noreturn]] void fail( const string& what )
+  {
+    throw runtime_error( "stableid.json: " + what + " at offset " + std::to_string( pos_ - begin_ ) );
   }
-  return false;
-}
 
-void dumpWeapons( WeaponMap& weapons, EffectMap& effects )
+  const char* begin_;
+  const char* pos_;
+  const char* end_;
+  string key_;
+  string name_;
+  string index_;
+  string skipped_;
+};
+
+void readStableID( const string& path, StableIDTable units, StableIDTable abilities, StableIDTable upgrades )
 {
-  printf_s( "[d] dumping weapons...\r\n" );
+  if ( !std::ifstream( path ).good() )
+    throw runtime_error( "could not open stableid.json" );
+  MappedFile file( path );
+  StableIDReader reader( file.data(), file.data() + file.size() );
+  reader.read( units, abilities, upgrades );
+}
 
-  ofstream out;
-  out.open( "weapons.json" );
+// footprints as text with easy visualisation
+void dumpFootprintsText( FootprintMap& footprints )
+{
+  ofstream footDump;
+  footDump.open( "footprints.txt" );
+  for ( auto entry : byName( footprints ) )
+  {
+    auto& fp = *entry;
+    if ( fp.second.removed || fp.second.placement.empty() || fp.second.w == -1 )
+      continue;
 
-  Json::Value root;
-  for ( auto& wpn : weapons )
-  {
-    Json::Value wval( Json::objectValue );
-    wval["name"] = wpn.second.name;
-    wval["range"] = wpn.second.range;
-    wval["period"] = wpn.second.period;
-    wval["arc"] = wpn.second.arc;
-    wval["damagePoint"] = wpn.second.damagePoint;
-    wval["backSwing"] = wpn.second.backSwing;
-    wval["rangeSlop"] = wpn.second.rangeSlop;
-    wval["arcSlop"] = wpn.second.arcSlop;
-    wval["minScanRange"] = wpn.second.minScanRange;
-    wval["randomDelayMin"] = wpn.second.randomDelayMin;
-    wval["randomDelayMax"] = wpn.second.randomDelayMax;
-    wval["melee"] = wpn.second.melee;
-    wval["hidden"] = wpn.second.hidden;
-    wval["disabled"] = wpn.second.disabled;
-
-    Json::Value reqs( Json::arrayValue );
-    filtersToJSON( wpn.second.targetRequire, reqs );
-    wval["filterRequires"] = reqs;
-
-    Json::Value excs( Json::arrayValue );
-    filtersToJSON( wpn.second.targetExclude, excs );
-    wval["filterExcludes"] = excs;
-
-    Json::Value effect( Json::objectValue );
-    resolveEffect( wpn.second.name, wpn.second.effect, effect, effects );
-    wval["effect"] = effect;
-
-    root[wpn.second.name] = wval;
-  }
-
-  Json::StreamWriterBuilder builder;
-  builder["commentStyle"] = "None";
-  builder["indentation"] = "  ";
-  std::unique_ptr<Json::StreamWriter> writer( builder.newStreamWriter() );
-  writer->write( root, &out );
+    char sdfsd[128];
+    sprintf_s( sdfsd, 128, " (%i,%i,%i,%i)", fp.second.x, fp.second.y, fp.second.w, fp.second.h );
+    footDump << fp.second.id << sdfsd << std::endl;
+    for ( int y = 0; y < fp.second.h; y++ )
+    {
+      for ( int x = 0; x < fp.second.w; x++ )
+      {
+        auto idx = y * fp.second.w + x;
+        footDump << ( fp.second.placement[idx] ? "x" : fp.second.creep[idx] ? "o" : fp.second.nearResources[idx] ? "n" : "." );
+      }
+      footDump << std::endl;
+    }
+    footDump << std::endl;
+  }
+  footDump.close();
+}
 
-  out.close();
+void dumpTechTreeText( const string& suffix, TechTree& tree )
+{
+  // dump techtree to txt for debug
+  ofstream techDump;
+  techDump.open( "techtree-" + suffix + ".txt" );
+  for ( auto& root : tree )
+  {
+    techDump << root.id << std::endl;
+    if ( !root.builds.empty() )
+      techDump << "  builds" << std::endl;
+    for ( auto& bld : root.builds )
+      if ( !bld.unit.empty() )
+        techDump << "    " << bld.unit << std::endl;
+    if ( !root.morphs.empty() )
+      techDump << "  morphs" << std::endl;
+    for ( auto& mrph : root.morphs )
+      if ( !mrph.unit.empty() )
+        techDump << "    " << mrph.unit << std::endl;
+    if ( !root.merges.empty() )
+      techDump << "  merges" << std::endl;
+    for ( auto& mrg : root.merges )
+      if ( !mrg.unit.empty() )
+        techDump << "    " << mrg.unit << std::endl;
+    if ( !root.researches.empty() )
+    {
+      techDump << "  upgrades" << std::endl;
+      for ( auto& res : root.researches )
+        if ( !res.upgrade.empty() )
+          techDump << "    " << res.upgrade << std::endl;
+    }
+    techDump << std::endl;
+  }
+  techDump.close();
 }
 
-void dumpUpgrades( UpgradeMap& upgrades )
+void cleanupUnitCommandCards( UnitMap& units )
 {
-  printf_s( "[d] dumping upgrades...\r\n" );
+  for ( auto& unit : units )
+  {
+    std::unordered_set<Symbol> usedCommands;
+    for ( auto& card : unit.second.abilityCardsMap.write() )
+    {
+      if ( card.second.removed || card.second.commands.empty() )
+        continue;
+      auto it = card.second.commands.begin();
+      while ( it != card.second.commands.end() )
+      {
+        if ( usedCommands.find( ( *it ).second ) != usedCommands.end() )
+          it = card.second.commands.erase( it );
+        else
+        {
+          usedCommands.insert( ( *it ).second );
+          it++;
+        }
+      }
+    }
+  }
+}
 
-  ofstream out;
-  out.open( "upgrades.json" );
+// Builds the tables of gamedata.db (see sc2gamedata.h) from the parsed catalogs. Every
+// string is stored once, and so is every effect and requirement node, however many
+// weapons or commands share it. The effects are those of g_effectGraph.
+class DatabaseWriter
+{
+public:
+  DatabaseWriter( GameData& data ):
+      data_( data ) {}
 
-  Json::Value root;
-  for ( auto& upgrade : upgrades )
+  // A record for every node of g_effectGraph, the graph weapons.json is written from too,
+  // ordered by depth so that every link points at an earlier record.
+  void addEffects()
   {
-    Json::Value uval( Json::objectValue );
-    uval["name"] = upgrade.second.name;
-    uval["race"] = raceStr( upgrade.second.race );
+    auto& nodes = g_effectGraph.nodes();
+    vector<uint32_t> order( nodes.size() );
+    for ( uint32_t i = 0; i < order.size(); i++ )
+      order[i] = i;
+    std::stable_sort( order.begin(), order.end(), [&nodes]( uint32_t a, uint32_t b ) { return nodes[a].depth < nodes[b].depth; } );
+    effectIndex_.assign( nodes.size(), db::none );
+    for ( uint32_t i = 0; i < order.size(); i++ )
+      effectIndex_[order[i]] = i;
+    for ( auto node : order )
+      effects_.push_back( effectRecord( nodes[node] ) );
+  }
 
-    Json::Value effectArray( Json::arrayValue );
-    for ( auto& entry : upgrade.second.effectArray )
+  void addWeapons()
+  {
+    auto sorted = byName( data_.weapons );
+    for ( size_t i = 0; i < sorted.size(); i++ )
+      weaponIndex_[sorted[i]->first] = static_cast<uint32_t>( i );
+    for ( auto entry : sorted )
     {
-      Json::Value eval( Json::objectValue );
-      eval["operation"] = entry.operation;
-      eval["referenceType"] = entry.referenceType;
-      eval["referenceId"] = entry.referenceId;
-      eval["referenceAttribute"] = entry.referenceAttribute;
-      eval["value"] = entry.value;
-
-      effectArray.append( eval );
+      auto& wpn = entry->second;
+      db::Weapon rec = {};
+      rec.name = str( wpn.name.str() );
+      rec.flags = ( wpn.melee ? db::Weapon_Melee : 0 ) | ( wpn.hidden ? db::Weapon_Hidden : 0 ) | ( wpn.disabled ? db::Weapon_Disabled : 0 );
+      rec.filterRequires = filterBits( wpn.targetRequire );
+      rec.filterExcludes = filterBits( wpn.targetExclude );
+      rec.range = wpn.range;
+      rec.period = wpn.period;
+      rec.arc = wpn.arc;
+      rec.damagePoint = wpn.damagePoint;
+      rec.backSwing = wpn.backSwing;
+      rec.rangeSlop = wpn.rangeSlop;
+      rec.arcSlop = wpn.arcSlop;
+      rec.minScanRange = wpn.minScanRange;
+      rec.randomDelayMin = wpn.randomDelayMin;
+      rec.randomDelayMax = wpn.randomDelayMax;
+      rec.effect = effectIndex( g_effectGraph.weaponEffect( entry->first ) );
+      weapons_.push_back( rec );
     }
-
-    uval["effectArray"] = effectArray;
-
-    root[upgrade.second.name] = uval;
   }
 
-  Json::StreamWriterBuilder builder;
-  builder["commentStyle"] = "None";
-  builder["indentation"] = "  ";
-  std::unique_ptr<Json::StreamWriter> writer( builder.newStreamWriter() );
-  writer->write( root, &out );
+  // in the order of g_aliasClasses, so that its class indices can be stored as they are
+  void addAliasClasses()
+  {
+    size_t words = ( g_unitNames.size() + 63 ) / 64;
+    for ( uint32_t i = 0; i < g_aliasClasses.classes().size(); i++ )
+    {
+      auto members = g_aliasClasses.members( i );
+      db::AliasClass rec = {};
+      rec.name = str( g_aliasClasses.classes()[i].name.str() );
+      rec.unitNames = strings( members );
+      vector<uint32_t> ids;
+      vector<uint64_t> set( words, 0 );
+      for ( auto unit : members )
+      {
+        auto id = stableID( g_unitMapping, unit );
+        ids.push_back( id );
+        if ( id != 0 && id / 64 < words )
+          set[id / 64] |= uint64_t( 1 ) << ( id % 64 );
+      }
+      rec.units = append( indices_, ids );
+      rec.unitSet = append( unitSets_, set );
+      aliasClasses_.push_back( rec );
+    }
+  }
 
-  out.close();
-}
+  // units.json keeps one unit per id, the last by name, and so does this
+  void addUnits()
+  {
+    std::map<uint32_t, Unit*> byID;
+    for ( auto entry : byName( data_.units ) )
+      if ( entry->second.lifeStart != 0 || entry->second.lifeMax != 0 )
+        byID[stableID( g_unitMapping, entry->first )] = &entry->second;
 
-void dumpAbilities( AbilityMap& abils, RequirementMap& requirements, RequirementNodeMap& nodes )
-{
-  printf_s( "[d] dumping abilities...\r\n" );
+    for ( auto& entry : byID )
+    {
+      auto& unit = *entry.second;
+      db::Unit rec = {};
+      rec.id = entry.first;
+      rec.race = static_cast<db::Race>( unit.race );
+      rec.resource = static_cast<db::ResourceType>( unit.resourceType );
+      rec.flags = ( unit.light ? db::Unit_Light : 0 ) | ( unit.biological ? db::Unit_Biological : 0 ) | ( unit.mechanical ? db::Unit_Mechanical : 0 ) |
+                  ( unit.armored ? db::Unit_Armored : 0 ) | ( unit.structure ? db::Unit_Structure : 0 ) | ( unit.psionic ? db::Unit_Psionic : 0 ) |
+                  ( unit.massive ? db::Unit_Massive : 0 ) | ( unit.invulnerable ? db::Unit_Invulnerable : 0 ) |
+                  ( unit.resourceType != Resource_None && unit.resourceHarvestable ? db::Unit_ResourceHarvestable : 0 );
+      rec.name = str( unit.name.str() );
+      rec.mover = str( unit.mover );
+      alias( unit, unit.aiEvaluateAlias, rec.aiEvaluateAs, rec.aiEvaluateAsName );
+      alias( unit, unit.glossaryAlias, rec.glossaryAlias, rec.glossaryAliasName );
+      rec.footprint = footprint( unit.footprint );
+
+      rec.collides = strings( unit.collides );
+      SymbolVector aliases;
+      for ( auto& a : unit.techAliases )
+        if ( !a.empty() )
+          aliases.push_back( a );
+      rec.techAliases = strings( aliases );
+      rec.planes = strings( unit.planeArray );
 
-  ofstream out;
-  out.open( "abilities.json" );
+      auto classes = g_aliasClasses.classesOf( unit.name );
+      rec.aliasClasses = append( indices_, vector<uint32_t>( classes.begin(), classes.end() ) );
 
-  Json::Value root;
-  for ( auto& abil : abils )
-  {
-    if ( abil.second.type == AbilType_Other )
-      continue;
+      rec.weapons = db::Range{ static_cast<uint32_t>( refs_.size() ), 0 };
+      for ( auto& weapon : unit.weapons )
+      {
+        auto it = weaponIndex_.find( weapon );
+        db::Ref ref = {};
+        ref.name = str( weapon.str() );
+        ref.index = ( it == weaponIndex_.end() ? db::none : it->second );
+        refs_.push_back( ref );
+        rec.weapons.count++;
+      }
 
-    Json::Value uval( Json::objectValue );
-    uval["name"] = abil.second.name;
-    uval["type"] = abilTypeStr( abil.second.type );
-    if ( !abil.second.morphUnit.empty() )
-      uval["morphUnit"] = abil.second.morphUnit;
+      SymbolVector commands;
+      for ( auto& card : unit.abilityCardsMap )
+        if ( !card.second.removed )
+          for ( auto& abil : card.second.commands )
+            if ( !abil.second.empty() )
+              commands.push_back( abil.second );
+      rec.abilityCommands = strings( commands );
+
+      rec.food = unit.food;
+      rec.speed = unit.speed;
+      rec.acceleration = unit.acceleration;
+      rec.speedMultiplierCreep = unit.speedMultiplierCreep;
+      rec.radius = unit.radius;
+      rec.sight = unit.sight;
+      rec.lifeStart = unit.lifeStart;
+      rec.lifeMax = unit.lifeMax;
+      rec.lifeRegenRate = unit.lifeRegenRate;
+      rec.shieldsStart = unit.shieldsStart;
+      rec.shieldsMax = unit.shieldsMax;
+      rec.shieldRegenDelay = unit.shieldRegenDelay;
+      rec.shieldRegenRate = unit.shieldRegenRate;
+      rec.energyStart = unit.energyStart;
+      rec.energyMax = unit.energyMax;
+      rec.energyRegenRate = unit.energyRegenRate;
+      rec.turningRate = unit.turningRate;
+      rec.stationaryTurningRate = unit.stationaryTurningRate;
+      rec.lateralAcceleration = unit.lateralAcceleration;
+      rec.attackTargetPriority = unit.attackTargetPriority;
+      rec.aiEvalFactor = unit.aiEvalFactor;
+      rec.mineralCost = unit.mineralCost;
+      rec.vespeneCost = unit.vespeneCost;
+      rec.lifeArmor = unit.lifeArmor;
+      rec.cargoSize = unit.cargoSize;
+      rec.scoreMake = unit.scoreMake;
+      rec.scoreKill = unit.scoreKill;
+      units_.push_back( rec );
+      unitSources_.push_back( &unit );
+    }
+  }
 
-    Json::Value cmds( Json::objectValue );
-    for ( auto& cmd : abil.second.commands )
+  void addAbilities()
+  {
+    for ( auto entry : byName( data_.abilities ) )
     {
-      if ( abil.second.type == AbilType_Train && cmd.second.units.empty() )
+      auto& abil = entry->second;
+      if ( abil.type == AbilType_Other )
         continue;
 
-      Json::Value cval;
-      cval["index"] = static_cast<Json::UInt64>( resolveAbilityCmd( abil.second.name, cmd.second.index ) );
-      cval["time"] = cmd.second.time;
-      if ( !cmd.second.requirements.empty() )
-      {
-        Json::Value reqsnode( Json::arrayValue );
-        vector<string> rqs;
-        if ( requirements.find( cmd.second.requirements ) != requirements.end() )
-        {
-          if ( !requirements[cmd.second.requirements].useNodeName.empty() )
-            rqs.push_back( requirements[cmd.second.requirements].useNodeName );
-          if ( !requirements[cmd.second.requirements].showNodeName.empty() )
-            rqs.push_back( requirements[cmd.second.requirements].showNodeName );
-        }
-        else
-          rqs.push_back( cmd.second.requirements );
-        for ( auto& r : rqs )
-        {
-          Json::Value optmp( Json::objectValue );
-          if ( resolveRequirements( r, optmp, requirements, nodes ) )
-            reqsnode.append( optmp );
-        }
-        cval["requires"] = reqsnode;
-      }
+      db::Ability rec = {};
+      rec.name = str( abil.name.str() );
+      rec.morphUnit = str( abil.morphUnit.str() );
+      rec.type = static_cast<db::AbilityType>( abil.type );
 
-      if ( !cmd.second.units.empty() )
+      vector<db::AbilityCommand> commands;
+      for ( auto& cmd : abil.commands )
       {
-        Json::Value units( Json::arrayValue );
+        if ( abil.type == AbilType_Train && cmd.second.units.empty() )
+          continue;
+
+        db::AbilityCommand crec = {};
+        crec.index = str( cmd.second.index );
+        crec.ability = static_cast<uint32_t>( abilities_.size() );
+        crec.id = g_abilityCommands.resolve( abil.name, cmd.second.index );
+        crec.time = cmd.second.time;
+        crec.requirements = requirementTrees( cmd.second.requirements );
+        SymbolVector units;
         for ( auto& unit : cmd.second.units )
           if ( !unit.empty() )
-            units.append( unit );
-
-        cval["units"] = units;
+            units.push_back( unit );
+        crec.units = strings( units );
+        commands.push_back( crec );
       }
-
-      cmds[cmd.second.index] = cval;
+      rec.commands = append( commands_, commands );
+      abilities_.push_back( rec );
     }
-
-    uval["commands"] = cmds;
-
-    root[abil.second.name] = uval;
   }
 
-  Json::StreamWriterBuilder builder;
-  builder["commentStyle"] = "None";
-  builder["indentation"] = "  ";
-  std::unique_ptr<Json::StreamWriter> writer( builder.newStreamWriter() );
-  writer->write( root, &out );
-
-  out.close();
-}
-
-struct TechTreeBuildEntry {
-  string unit;
-  int unitCount;
-  string ability;
-  string command;
-  double time;
-  string requirements;
-  bool buildInterruptible;
-  bool finishKillsPeon;
-  bool trainFinishKills;
-  bool trainCancelKills;
-  TechTreeBuildEntry():
-      buildInterruptible( false ), finishKillsPeon( false ), trainFinishKills( false ), trainCancelKills( false ) {}
-};
-
-struct TechTreeResearchEntry {
-  string upgrade;
-  string ability;
-  string command;
-  double time;
-  string requirements;
-  int64_t minerals;
-  int64_t vespene;
-};
-
-struct TechTreeEntry {
-  string id;
-  vector<TechTreeBuildEntry> builds;
-  vector<TechTreeBuildEntry> morphs;
-  vector<TechTreeBuildEntry> merges;
-  vector<TechTreeResearchEntry> researches;
-};
-
-using TechTree = vector<TechTreeEntry>;
-
-using TechMap = std::map<Race, TechTree>;
-
-void generateTechTree( UnitMap& units, AbilityMap& abilities, Race race, TechTree& tree )
-{
-  UnitMap buildings;
-  for ( auto& unit : units )
+  // The damage matrix, a row of db::Damage per weapon of a unit with a column per unit.
+  // The targets are laid out as arrays of their properties first, so that each row is a
+  // few straight passes over floats that the compiler can vectorize.
+  void addDamageMatrix()
   {
-    if ( unit.second.race != race )
-      continue;
-
-    // some cleanup
-    if ( boost::iequals( unit.second.name.substr( 0, 7 ), "XelNaga" ) && !boost::iequals( unit.second.name, "XelNagaTower" ) )
-      continue;
-    if ( boost::iequals( unit.second.name.substr( 0, 4 ), "Aiur" ) || boost::iequals( unit.second.name.substr( 0, 8 ), "PortCity" ) || boost::iequals( unit.second.name.substr( 0, 8 ), "Shakuras" ) || boost::iequals( unit.second.name.substr( 0, 19 ), "SnowRefinery_Terran" ) || boost::iequals( unit.second.name.substr( 0, 15 ), "ExtendingBridge" ) )
-      continue;
+    auto targets = units_.size();
+    vector<float> lifeArmor( targets ), life( targets ), shields( targets );
+    vector<uint8_t> attributes( targets );
+    vector<uint32_t> kinds( targets ); // the db::Filter bits a weapon's filters can rule out
+    for ( size_t t = 0; t < targets; t++ )
+    {
+      auto& unit = *unitSources_[t];
+      lifeArmor[t] = static_cast<float>( unit.lifeArmor );
+      life[t] = static_cast<float>( unit.lifeMax );
+      shields[t] = static_cast<float>( unit.shieldsMax );
+      attributes[t] = static_cast<uint8_t>( units_[t].flags & attributeMask );
+      kinds[t] = ( unit.structure ? static_cast<uint32_t>( db::Filter_Structure ) : 0u );
+      for ( auto& plane : unit.planeArray )
+        if ( plane == "Ground" )
+          kinds[t] |= db::Filter_Ground;
+        else if ( plane == "Air" )
+          kinds[t] |= db::Filter_Air;
+    }
 
-    // hardcode to get rid of mothership core; i think blizzard screwed up in their cmdcard XML regarding this. it might even be possible to still build one in a melee game.
-    if ( boost::iequals( unit.second.name, "MothershipCore" ) )
-      continue;
+    vector<float> lifeHit( targets ), shieldsHit( targets );
+    vector<std::pair<const Effect*, double>> hits;
+    for ( uint32_t a = 0; a < units_.size(); a++ )
+    {
+      for ( auto& weaponName : unitSources_[a]->weapons )
+      {
+        auto wpnIt = data_.weapons.find( weaponName );
+        auto index = weaponIndex_.find( weaponName );
+        if ( wpnIt == data_.weapons.end() || index == weaponIndex_.end() )
+          continue;
+        auto& wpn = wpnIt->second;
+        attacks_.push_back( db::Attack{ a, index->second } );
 
-    TechTreeEntry entry;
-    entry.id = unit.second.name;
+        hits.clear();
+        auto effect = g_effectGraph.weaponEffect( weaponName );
+        if ( effect != noEffect )
+          g_effectGraph.damageEffects( effect, 1.0, hits );
 
-    // for ( auto& name : unit.second.abilityCommands )
-    for ( auto& card : unit.second.abilityCardsMap )
-      if ( !card.second.removed )
-        for ( auto& cmdpair : card.second.commands )
+        std::fill( lifeHit.begin(), lifeHit.end(), 0.0f );
+        std::fill( shieldsHit.begin(), shieldsHit.end(), 0.0f );
+        for ( auto& hit : hits )
         {
-          if ( cmdpair.second.empty() )
-            continue;
-
-          string name = cmdpair.second;
-          // "Ability,Command"
-          vector<string> parts;
-          boost::split( parts, name, boost::is_any_of( "," ) );
-          if ( parts.size() != 2 )
-            continue;
-
-          auto& ability = abilities[parts[0]];
-          if ( ability.type == AbilType_Train || ability.type == AbilType_Build || ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement || ability.type == AbilType_Merge )
+          auto& fx = *hit.first;
+          float bonus[attributeMask + 1] = {}; // by the attributes a target has
+          for ( auto& attrib : fx.attributeBonuses )
+            for ( uint32_t bit = 0; bit < 7; bit++ )
+              if ( boost::iequals( attrib.first, attributeNames[bit] ) )
+                for ( uint32_t mask = 0; mask <= attributeMask; mask++ )
+                  if ( mask & ( 1u << bit ) )
+                    bonus[mask] += static_cast<float>( attrib.second.value );
+          auto amount = static_cast<float>( fx.damageAmount );
+          auto reduction = static_cast<float>( fx.damageArmorReduction );
+          auto times = static_cast<float>( hit.second );
+          for ( size_t t = 0; t < targets; t++ )
           {
-            auto& cmd = ability.commands[parts[1]];
-
-            if ( cmd.units.empty() || cmd.isUpgrade )
-              continue;
-
-            TechTreeBuildEntry bentry;
-            // training zergling has ["zergling", "zergling"] for example, so this simplification seems reasonable
-            // but skip cocoons and eggs, we don't care
-            for ( auto& u : cmd.units )
-            {
-              if ( u.find( "Cocoon" ) != std::string::npos )
-                continue;
-              if ( u.find( "Egg" ) != std::string::npos )
-                continue;
-              bentry.unit = u;
-              break;
-            }
-
-            // cannot morph to myself. this might happen eg ObserverSiegeMode descends from Observer but doesn't override the morph skill.
-            if ( ( ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement ) && boost::iequals( bentry.unit, unit.second.name ) )
-              continue;
-
-            // hardcode to get rid of mothership core
-            if ( boost::iequals( bentry.unit, "MothershipCore" ) )
-              continue;
-
-            if ( bentry.unit.empty() )
-            {
-              bentry.unit = cmd.units[cmd.units.size() - 1]; // else just choose the last one which is usually better than first
-            }
-            bentry.unitCount = ( bentry.unit.empty() ? 0 : 1 );
-            // hardcode hack to fix zerglings, literally the only unit that's built 2 at a time
-            if ( ability.type == AbilType_Train && boost::iequals( bentry.unit, "Zergling" ) )
-            {
-              bentry.unitCount = 2;
-            }
-            bentry.ability = ability.name;
-            bentry.time = cmd.time;
-            bentry.command = cmd.index;
-            bentry.requirements = cmd.requirements;
-
-            if ( ability.type == AbilType_Build )
-            {
-              bentry.buildInterruptible = ability.buildInterruptible;
-              bentry.finishKillsPeon = ability.buildFinishKillsPeon;
-            }
-            else if ( ability.type == AbilType_Train )
-            {
-              bentry.trainFinishKills = ability.trainFinishKills;
-              bentry.trainCancelKills = ability.trainCancelKills;
-            }
-
-            // separate morphs from other types as morph consumes existing unit
-            if ( ability.type == AbilType_Morph || ability.type == AbilType_MorphPlacement )
-              entry.morphs.push_back( bentry );
-            else if ( ability.type == AbilType_Merge )
-              entry.merges.push_back( bentry );
-            else
-              entry.builds.push_back( bentry );
+            float base = amount + bonus[attributes[t]];
+            float vsLife = std::max( 0.5f, base - lifeArmor[t] * reduction );
+            lifeHit[t] += ( base > 0.0f ? vsLife * times : 0.0f );
+            shieldsHit[t] += ( base > 0.0f ? std::max( 0.5f, base ) * times : 0.0f ); // shield armor is 0 before upgrades
           }
-          else if ( ability.type == AbilType_Research )
-          {
-            auto& cmd = ability.commands[parts[1]];
-            if ( !cmd.isUpgrade )
-              continue;
+        }
 
-            TechTreeResearchEntry res;
-            res.upgrade = cmd.upgrade;
-            res.ability = ability.name;
-            res.time = cmd.time;
-            res.command = cmd.index;
-            res.requirements = cmd.requirements;
-            res.minerals = cmd.mineralCost;
-            res.vespene = cmd.vespeneCost;
-            entry.researches.push_back( res );
+        auto required = filterBits( wpn.targetRequire );
+        auto excluded = filterBits( wpn.targetExclude );
+        float rate = ( wpn.period > 0.0 ? static_cast<float>( 1.0 / wpn.period ) : 0.0f );
+        for ( size_t t = 0; t < targets; t++ )
+        {
+          db::Damage dmg = {};
+          if ( ( required & kindMask & ~kinds[t] ) == 0 && ( excluded & kinds[t] ) == 0 && lifeHit[t] > 0.0f )
+          {
+            dmg.lifePerHit = lifeHit[t];
+            dmg.shieldsPerHit = shieldsHit[t];
+            dmg.lifeDps = lifeHit[t] * rate;
+            dmg.shieldsDps = shieldsHit[t] * rate;
+            dmg.hitsToKill = hitsToKill( life[t], shields[t], lifeArmor[t], lifeHit[t], shieldsHit[t] );
           }
+          damage_.push_back( dmg );
         }
-
-    tree.push_back( entry );
-
-    buildings[unit.second.name] = unit.second;
+      }
+    }
   }
-}
 
-void dumpRequirementsJSON( const string& reqstr, RequirementMap& requirements, RequirementNodeMap& nodes, Json::Value& out )
-{
-  if ( !reqstr.empty() )
+  void addUpgrades()
   {
-    Json::Value reqsnode( Json::arrayValue );
-    vector<string> rqs;
-    if ( requirements.find( reqstr ) != requirements.end() )
-    {
-      if ( !requirements[reqstr].useNodeName.empty() )
-        rqs.push_back( requirements[reqstr].useNodeName );
-      if ( !requirements[reqstr].showNodeName.empty() )
-        rqs.push_back( requirements[reqstr].showNodeName );
-    }
-    else
-      rqs.push_back( reqstr );
-    for ( auto& r : rqs )
+    for ( auto entry : byName( data_.upgrades ) )
     {
-      Json::Value optmp( Json::objectValue );
-      if ( resolveRequirements( r, optmp, requirements, nodes ) )
-        reqsnode.append( optmp );
+      auto& upgrade = entry->second;
+      db::Upgrade rec = {};
+      rec.name = str( upgrade.name.str() );
+      rec.id = stableID( g_upgradeMapping, upgrade.name );
+      rec.race = static_cast<db::Race>( upgrade.race );
+
+      vector<db::UpgradeEffect> effects;
+      for ( auto& fx : upgrade.effectArray )
+        effects.push_back( db::UpgradeEffect{ str( fx.operation ), str( fx.referenceType ), str( fx.referenceId ), str( fx.referenceAttribute ), str( fx.value ) } );
+      rec.effects = append( upgradeEffects_, effects );
+      upgrades_.push_back( rec );
     }
-    out["requires"] = reqsnode;
   }
-}
-
-void dumpTechTree( TechMap& techtree, RequirementMap& requirements, RequirementNodeMap& nodes )
-{
-  printf_s( "[d] dumping tech tree...\r\n" );
 
-  ofstream out;
-  out.open( "techtree.json" );
-
-  Json::Value root;
-  for ( auto& entry : techtree )
+  void addTechTree( TechMap& techtree )
   {
-    Json::Value racenode( Json::objectValue );
-    for ( auto& asd : entry.second )
+    for ( auto& race : techtree )
     {
-      if ( asd.builds.empty() && asd.morphs.empty() && asd.researches.empty() )
-        continue;
+      std::map<uint32_t, TechTreeEntry*> byID;
+      for ( auto& entry : race.second )
+        if ( !entry.builds.empty() || !entry.morphs.empty() || !entry.researches.empty() )
+          byID[stableID( g_unitMapping, entry.id )] = &entry;
 
-      Json::Value unitnode( Json::objectValue );
-      unitnode["name"] = asd.id;
-
-      if ( !asd.builds.empty() )
+      for ( auto& id : byID )
       {
-        Json::Value buildsnode( Json::arrayValue );
-        for ( auto& build : asd.builds )
+        auto& entry = *id.second;
+        db::TechEntry rec = {};
+        rec.unit = id.first;
+        rec.race = static_cast<db::Race>( race.first );
+        rec.name = str( entry.id.str() );
+        rec.builds = buildItems( entry.builds );
+        rec.morphs = buildItems( entry.morphs );
+        rec.merges = buildItems( entry.merges );
+
+        vector<db::TechItem> items;
+        for ( auto& res : entry.researches )
         {
-          auto abilityCmdIndex = resolveAbilityCmd( build.ability, build.command );
-
-          Json::Value buildnode( Json::objectValue );
-          buildnode["unit"] = static_cast<Json::UInt64>( g_unitMapping[build.unit] );
-          buildnode["unitName"] = build.unit;
-
-          if ( build.unitCount > 1 )
-            buildnode["unitCount"] = build.unitCount;
-
-          buildnode["abilityName"] = ( build.ability + "," + build.command );
-          buildnode["ability"] = static_cast<Json::UInt64>( abilityCmdIndex );
-          buildnode["time"] = build.time;
-
-          if ( build.buildInterruptible ) // terran scv -> building; CAbilBuild
-            buildnode["interruptible"] = true;
-          if ( build.finishKillsPeon ) // terran scv -> building; CAbilBuild
-            buildnode["finishKillsWorker"] = true;
-          if ( build.trainFinishKills ) // zerg larva -> *; CAbilTrain
-            buildnode["finishKillsSource"] = true;
-          if ( build.trainCancelKills ) // zerg larva -> *; CAbilTrain
-            buildnode["cancelKillsSource"] = true;
-
-          dumpRequirementsJSON( build.requirements, requirements, nodes, buildnode );
-
-          buildsnode.append( buildnode );
+          if ( res.upgrade.str().size() < 2 )
+            continue;
+          db::TechItem item = {};
+          item.target = stableID( g_upgradeMapping, res.upgrade );
+          item.ability = g_abilityCommands.resolve( res.ability, res.commandSlot );
+          item.targetName = str( res.upgrade.str() );
+          item.abilityName = str( res.ability.str() + "," + res.command );
+          item.requirements = requirementTrees( res.requirements );
+          item.time = res.time;
+          item.minerals = res.minerals;
+          item.vespene = res.vespene;
+          items.push_back( item );
         }
-        unitnode["builds"] = buildsnode;
+        rec.researches = append( techItems_, items );
+        techEntries_.push_back( rec );
       }
+    }
+  }
 
-      if ( !asd.morphs.empty() )
-      {
-        Json::Value morphsnode( Json::arrayValue );
-        for ( auto& morph : asd.morphs )
-        {
-          auto abilityCmdIndex = resolveAbilityCmd( morph.ability, morph.command );
+  void write( const string& path )
+  {
+    vector<char> out( sizeof( db::Header ) );
+    db::Header header = {};
+    header.magic = db::dbMagic;
+    header.version = db::dbVersion;
+    header.tableCount = db::Table_Count;
+    table( out, header, db::Table_Strings, strings_ );
+    table( out, header, db::Table_StringRefs, stringRefs_ );
+    table( out, header, db::Table_Indices, indices_ );
+    table( out, header, db::Table_Values, values_ );
+    table( out, header, db::Table_Points, points_ );
+    table( out, header, db::Table_Polygons, polygons_ );
+    table( out, header, db::Table_Footprints, footprints_ );
+    table( out, header, db::Table_Refs, refs_ );
+    table( out, header, db::Table_Units, units_ );
+    table( out, header, db::Table_AttributeBonuses, bonuses_ );
+    table( out, header, db::Table_SplashAreas, splash_ );
+    table( out, header, db::Table_Effects, effects_ );
+    table( out, header, db::Table_Weapons, weapons_ );
+    table( out, header, db::Table_Requirements, requirements_ );
+    table( out, header, db::Table_AbilityCommands, commands_ );
+    table( out, header, db::Table_Abilities, abilities_ );
+    table( out, header, db::Table_UpgradeEffects, upgradeEffects_ );
+    table( out, header, db::Table_Upgrades, upgrades_ );
+    table( out, header, db::Table_TechItems, techItems_ );
+    table( out, header, db::Table_TechEntries, techEntries_ );
+    table( out, header, db::Table_UnitIds, idTable( units_ ) );
+    table( out, header, db::Table_AbilityIds, idTable( commands_ ) );
+    table( out, header, db::Table_UpgradeIds, idTable( upgrades_ ) );
+    table( out, header, db::Table_AliasClasses, aliasClasses_ );
+    table( out, header, db::Table_UnitSets, unitSets_ );
+    table( out, header, db::Table_RequirementCode, requirementCode_ );
+    table( out, header, db::Table_Attacks, attacks_ );
+    table( out, header, db::Table_Damage, damage_ );
+    memcpy( out.data(), &header, sizeof( header ) );
+
+    ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( out.data(), out.size() );
+  }
 
-          Json::Value morphnode( Json::objectValue );
-          morphnode["unit"] = static_cast<Json::UInt64>( g_unitMapping[morph.unit] );
-          morphnode["unitName"] = morph.unit;
+private:
+  template <class T>
+  static void table( vector<char>& out, db::Header& header, db::TableId id, const vector<T>& records )
+  {
+    out.resize( ( out.size() + 7 ) & ~size_t( 7 ) );
+    header.tables[id].offset = out.size();
+    header.tables[id].count = static_cast<uint32_t>( records.size() );
+    header.tables[id].recordSize = sizeof( T );
+    auto bytes = reinterpret_cast<const char*>( records.data() );
+    out.insert( out.end(), bytes, bytes + records.size() * sizeof( T ) );
+  }
 
-          if ( morph.unitCount > 1 )
-            morphnode["unitCount"] = morph.unitCount;
+  // record index by stable id; records without a known id (0) are left out
+  template <class T>
+  static vector<uint32_t> idTable( const vector<T>& records )
+  {
+    vector<uint32_t> index;
+    for ( size_t i = 0; i < records.size(); i++ )
+    {
+      auto id = records[i].id;
+      if ( id == 0 )
+        continue;
+      if ( id >= index.size() )
+        index.resize( id + 1, db::none );
+      index[id] = static_cast<uint32_t>( i );
+    }
+    return index;
+  }
 
-          morphnode["abilityName"] = ( morph.ability + "," + morph.command );
-          morphnode["ability"] = static_cast<Json::UInt64>( abilityCmdIndex );
-          morphnode["time"] = morph.time;
+  template <class T>
+  static db::Range append( vector<T>& table, const vector<T>& records )
+  {
+    db::Range range = { static_cast<uint32_t>( table.size() ), static_cast<uint32_t>( records.size() ) };
+    table.insert( table.end(), records.begin(), records.end() );
+    return range;
+  }
 
-          dumpRequirementsJSON( morph.requirements, requirements, nodes, morphnode );
+  db::String str( const string& text )
+  {
+    auto it = stringIndex_.find( text );
+    if ( it != stringIndex_.end() )
+      return it->second;
+    db::String ref = { static_cast<uint32_t>( strings_.size() ), static_cast<uint32_t>( text.size() ) };
+    strings_.insert( strings_.end(), text.begin(), text.end() );
+    strings_.push_back( 0 );
+    stringIndex_[text] = ref;
+    return ref;
+  }
 
-          morphsnode.append( morphnode );
-        }
-        unitnode["morphs"] = morphsnode;
-      }
+  static const string& text( const string& value ) { return value; }
+  static const string& text( Symbol value ) { return value.str(); }
 
-      if ( !asd.merges.empty() )
-      {
-        Json::Value mergesnode( Json::arrayValue );
-        for ( auto& merge : asd.merges )
-        {
-          auto abilityCmdIndex = resolveAbilityCmd( merge.ability, merge.command );
+  template <class Container>
+  db::Range strings( const Container& values )
+  {
+    vector<db::String> refs;
+    for ( auto& value : values )
+      refs.push_back( str( text( value ) ) );
+    return append( stringRefs_, refs );
+  }
 
-          Json::Value mergenode( Json::objectValue );
-          mergenode["unit"] = static_cast<Json::UInt64>( g_unitMapping[merge.unit] );
-          mergenode["unitName"] = merge.unit;
+  static uint32_t filterBits( const FilterSet& filters )
+  {
+    uint32_t bits = 0;
+    for ( auto filter : filters )
+      bits |= 1u << filter;
+    return bits;
+  }
 
-          if ( merge.unitCount > 1 )
-            mergenode["unitCount"] = merge.unitCount;
+  static const uint32_t attributeMask = db::Unit_Light | db::Unit_Biological | db::Unit_Mechanical | db::Unit_Armored | db::Unit_Structure | db::Unit_Psionic | db::Unit_Massive;
+  static const char* const attributeNames[7]; // the attribute bonus names of those bits, in order
+  static const uint32_t kindMask = db::Filter_Ground | db::Filter_Air | db::Filter_Structure;
+
+  // Shields go first, and whatever the last hit on them has left over reaches life less
+  // the armor. Shields have no armor without upgrades, which are not modelled. The count
+  // is capped rather than ever wrapping around.
+  static uint32_t hitsToKill( float life, float shields, float armor, float lifeHit, float shieldsHit )
+  {
+    double hits = 0.0;
+    if ( shields > 0.0f )
+    {
+      hits = std::ceil( shields / shieldsHit );
+      life -= std::max( 0.0f, static_cast<float>( hits * shieldsHit - shields ) - armor );
+    }
+    if ( life > 0.0f )
+      hits += std::ceil( life / lifeHit );
+    return static_cast<uint32_t>( std::min( hits, 4294967295.0 ) );
+  }
+
+  // units.json leaves out an alias that is the unit itself, or has no id of its own
+  void alias( const Unit& unit, string name, uint32_t& id, db::String& nameOut )
+  {
+    boost::replace_all( name, "##id##", unit.name.str() );
+    if ( name.empty() )
+      return;
+    auto aliasID = stableID( g_unitMapping, Symbol::lookup( name ) );
+    if ( aliasID != stableID( g_unitMapping, unit.name ) )
+      id = aliasID;
+    if ( !boost::iequals( unit.name.str(), name ) )
+      nameOut = str( name );
+  }
 
-          mergenode["abilityName"] = ( merge.ability + "," + merge.command );
-          mergenode["ability"] = static_cast<Json::UInt64>( abilityCmdIndex );
-          mergenode["time"] = merge.time;
+  uint32_t footprint( Symbol name )
+  {
+    auto it = data_.footprints.find( name );
+    if ( name.empty() || it == data_.footprints.end() )
+      return db::none;
+    auto known = footprintIndex_.find( name );
+    if ( known != footprintIndex_.end() )
+      return known->second;
+
+    auto& fp = it->second;
+    db::Footprint rec = {};
+    rec.name = str( fp.id.str() );
+    rec.radius = fp.shape.radius;
+    rec.unpathable = polygons( fp.shape.unpathablePolys );
+    rec.building = polygons( fp.shape.buildingPolys );
+    rec.x = fp.x;
+    rec.y = fp.y;
+    rec.w = fp.w;
+    rec.h = fp.h;
+    string cells;
+    for ( int y = 0; y < fp.h; y++ )
+      for ( int x = 0; x < fp.w; x++ )
+      {
+        auto idx = y * fp.w + x;
+        cells.push_back( fp.placement[idx] ? 'x' : fp.creep[idx] ? 'o' : fp.nearResources[idx] ? 'n' : '.' );
+      }
+    rec.data = str( cells );
 
-          dumpRequirementsJSON( merge.requirements, requirements, nodes, mergenode );
+    auto index = static_cast<uint32_t>( footprints_.size() );
+    footprints_.push_back( rec );
+    footprintIndex_[name] = index;
+    return index;
+  }
 
-          mergesnode.append( mergenode );
-        }
-        unitnode["merges"] = mergesnode;
-      }
+  db::Range polygons( const PolygonVector& polys )
+  {
+    vector<db::Polygon> recs;
+    for ( auto& poly : polys )
+    {
+      vector<db::Point> points;
+      for ( auto& pt : poly )
+        points.push_back( db::Point{ pt.x, pt.y } );
+      recs.push_back( db::Polygon{ append( points_, points ) } );
+    }
+    return append( polygons_, recs );
+  }
 
-      if ( !asd.researches.empty() )
+  db::Effect effectRecord( const EffectGraph::Node& node )
+  {
+    auto& fx = *node.effect;
+    db::Effect rec = {};
+    rec.name = str( fx.name.str() );
+    rec.impact = effectIndex( node.impact );
+    rec.searchRequires = filterBits( fx.searchRequires );
+    rec.searchExcludes = filterBits( fx.searchExcludes );
+    vector<uint32_t> children;
+    for ( auto child : node.children )
+      children.push_back( effectIndex( child ) );
+    rec.children = append( indices_, children );
+    switch ( fx.type )
+    {
+      case Effect::Effect_Missile:
+        rec.type = db::Effect_Missile;
+        break;
+      case Effect::Effect_Damage:
+        rec.type = ( fx.flagKill && fx.impactLocation == Effect::Impact_SourceUnit ? db::Effect_Suicide : db::Effect_Damage );
+        break;
+      case Effect::Effect_CreateUnit:
+        rec.type = db::Effect_CreateUnit;
+        break;
+      case Effect::Effect_CreateHealer:
+        rec.type = db::Effect_CreateHealer;
+        break;
+      case Effect::Effect_Set:
+        rec.type = db::Effect_Set;
+        break;
+      case Effect::Effect_Persistent:
       {
-        Json::Value resnode( Json::arrayValue );
-        for ( auto& res : asd.researches )
-        {
-          if ( res.upgrade.size() < 2 )
-            continue;
+        rec.type = db::Effect_Persistent;
+        vector<double> periods( fx.persistentPeriods.begin(), fx.persistentPeriods.end() );
+        rec.persistentPeriods = append( values_, periods );
+        rec.persistentCount = fx.periodCount;
+        break;
+      }
+      case Effect::Effect_EnumArea:
+        rec.type = db::Effect_EnumArea;
+        break;
+      default:
+        rec.type = db::Effect_Unknown;
+        break;
+    }
 
-          auto abilityCmdIndex = resolveAbilityCmd( res.ability, res.command );
+    if ( rec.type == db::Effect_Damage )
+    {
+      rec.damageAmount = fx.damageAmount;
+      rec.damageArmorReduction = fx.damageArmorReduction;
+      rec.damageKind = str( fx.damageKind );
+      vector<db::AttributeBonus> bonuses;
+      for ( auto& bonus : fx.attributeBonuses )
+        if ( bonus.second.value != 0.0 )
+          bonuses.push_back( db::AttributeBonus{ str( bonus.first ), bonus.second.value } );
+      rec.attributeBonuses = append( bonuses_, bonuses );
+      vector<db::SplashArea> areas;
+      for ( auto& area : fx.splashArea )
+        areas.push_back( db::SplashArea{ area.second.fraction, area.second.radius } );
+      rec.splash = append( splash_, areas );
+    }
+    return rec;
+  }
 
-          Json::Value resentry( Json::objectValue );
-          resentry["upgrade"] = static_cast<Json::UInt64>( g_upgradeMapping[res.upgrade] );
-          resentry["upgradeName"] = res.upgrade;
-          resentry["abilityName"] = ( res.ability + "," + res.command );
-          resentry["ability"] = static_cast<Json::UInt64>( abilityCmdIndex );
-          resentry["time"] = res.time;
-          resentry["minerals"] = static_cast<Json::UInt64>( res.minerals );
-          resentry["vespene"] = static_cast<Json::UInt64>( res.vespene );
+  uint32_t effectIndex( uint32_t node ) const
+  {
+    return ( node == noEffect ? db::none : effectIndex_[node] );
+  }
 
-          dumpRequirementsJSON( res.requirements, requirements, nodes, resentry );
+  static db::RequirementOp op( db::RequirementOpCode code, uint32_t arg )
+  {
+    db::RequirementOp rec = {};
+    rec.code = code;
+    rec.arg = arg;
+    return rec;
+  }
 
-          resnode.append( resentry );
+  // the requirement nodes as a table, one record per node name, each with its tree
+  // compiled into a program for RequirementEvaluator
+  uint32_t requirement( Symbol name )
+  {
+    auto known = requirementIndex_.find( name );
+    if ( known != requirementIndex_.end() )
+      return known->second;
+
+    uint32_t index = db::none;
+    db::Requirement rec = {};
+    vector<db::RequirementOp> program;
+    auto it = data_.nodes.find( name );
+    if ( it == data_.nodes.end() || name.str().size() < 5 ) // numerals, as in RequirementGraph
+    {
+      rec.type = db::Requirement_Value;
+      rec.value = atoi( name.c_str() );
+      rec.program = append( requirementCode_, { op( db::Op_Value, static_cast<uint32_t>( rec.value ) ) } );
+      index = static_cast<uint32_t>( requirements_.size() );
+      requirements_.push_back( rec );
+    }
+    else if ( it->second.type != ReqNode_Unknown )
+    {
+      auto& node = it->second;
+      bool valid = true;
+      if ( node.type == ReqNode_LogicAnd || node.type == ReqNode_LogicOr || node.type == ReqNode_LogicEq || node.type == ReqNode_LogicNot )
+      {
+        rec.type = ( node.type == ReqNode_LogicAnd ? db::Requirement_And : node.type == ReqNode_LogicOr ? db::Requirement_Or : node.type == ReqNode_LogicEq ? db::Requirement_Eq : db::Requirement_Not );
+        valid = !node.operands.empty();
+        vector<uint32_t> operands;
+        for ( auto& op : node.operands )
+        {
+          auto opIndex = requirement( op.second );
+          if ( opIndex != db::none )
+            operands.push_back( opIndex );
         }
-        unitnode["researches"] = resnode;
+        rec.operands = append( indices_, operands );
+        // postfix: the operands' programs, which are already in the table, then this node
+        for ( auto opIndex : operands )
+        {
+          auto first = requirementCode_.begin() + requirements_[opIndex].program.first;
+          program.insert( program.end(), first, first + requirements_[opIndex].program.count );
+        }
+        auto code = ( node.type == ReqNode_LogicAnd ? db::Op_And : node.type == ReqNode_LogicOr ? db::Op_Or : node.type == ReqNode_LogicEq ? db::Op_Eq : db::Op_Not );
+        program.push_back( op( code, static_cast<uint32_t>( operands.size() ) ) );
       }
+      else if ( node.type == ReqNode_CountUnit )
+      {
+        rec.type = db::Requirement_UnitCount;
+        rec.aliasClass = g_aliasClasses.find( node.countLink );
+        auto& cls = aliasClasses_[rec.aliasClass];
+        rec.unitNames = cls.unitNames;
+        rec.units = cls.units;
+        program.push_back( op( db::Op_UnitCount, rec.aliasClass ) );
+      }
+      else
+      {
+        rec.type = db::Requirement_UpgradeCount;
+        rec.upgradeName = str( node.countLink.str() );
+        rec.upgrade = stableID( g_upgradeMapping, node.countLink );
+        rec.aliasClass = db::none;
+        program.push_back( op( db::Op_UpgradeCount, rec.upgrade ) );
+      }
+      if ( node.type == ReqNode_CountUnit || node.type == ReqNode_CountUpgrade )
+        rec.state = str( node.countState );
+      if ( valid )
+      {
+        rec.program = append( requirementCode_, program );
+        index = static_cast<uint32_t>( requirements_.size() );
+        requirements_.push_back( rec );
+      }
+    }
+    requirementIndex_[name] = index;
+    return index;
+  }
 
-      auto numindex = std::to_string( g_unitMapping[asd.id] );
-
-      racenode[numindex] = unitnode;
+  // the trees of a requirement, as dumpRequirementsJSON() lists them
+  db::Range requirementTrees( Symbol reqstr )
+  {
+    vector<uint32_t> roots;
+    if ( !reqstr.empty() )
+    {
+      vector<Symbol> rqs;
+      auto req = data_.requirements.find( reqstr );
+      if ( req != data_.requirements.end() )
+      {
+        if ( !req->second.useNodeName.empty() )
+          rqs.push_back( req->second.useNodeName );
+        if ( !req->second.showNodeName.empty() )
+          rqs.push_back( req->second.showNodeName );
+      }
+      else
+        rqs.push_back( reqstr );
+      for ( auto& r : rqs )
+      {
+        auto index = requirement( r );
+        if ( index != db::none )
+          roots.push_back( index );
+      }
     }
+    return append( indices_, roots );
+  }
 
-    root[raceStr( entry.first )] = racenode;
+  db::Range buildItems( const vector<TechTreeBuildEntry>& entries )
+  {
+    vector<db::TechItem> items;
+    for ( auto& build : entries )
+    {
+      db::TechItem item = {};
+      item.target = stableID( g_unitMapping, build.unit );
+      item.ability = g_abilityCommands.resolve( build.ability, build.commandSlot );
+      item.targetName = str( build.unit.str() );
+      item.abilityName = str( build.ability.str() + "," + build.command );
+      item.unitCount = build.unitCount;
+      item.flags = ( build.buildInterruptible ? db::Tech_Interruptible : 0 ) | ( build.finishKillsPeon ? db::Tech_FinishKillsWorker : 0 ) |
+                   ( build.trainFinishKills ? db::Tech_FinishKillsSource : 0 ) | ( build.trainCancelKills ? db::Tech_CancelKillsSource : 0 );
+      item.requirements = requirementTrees( build.requirements );
+      item.time = build.time;
+      items.push_back( item );
+    }
+    return append( techItems_, items );
   }
 
-  Json::StreamWriterBuilder builder;
-  builder["commentStyle"] = "None";
-  builder["indentation"] = "  ";
-  std::unique_ptr<Json::StreamWriter> writer( builder.newStreamWriter() );
-  writer->write( root, &out );
+  GameData& data_;
+  std::unordered_map<string, db::String> stringIndex_;
+  SymbolMap<uint32_t> footprintIndex_;
+  SymbolMap<uint32_t> weaponIndex_;
+  vector<uint32_t> effectIndex_; // by g_effectGraph node
+  SymbolMap<uint32_t> requirementIndex_;
+
+  vector<char> strings_;
+  vector<db::String> stringRefs_;
+  vector<uint32_t> indices_;
+  vector<double> values_;
+  vector<db::Point> points_;
+  vector<db::Polygon> polygons_;
+  vector<db::Footprint> footprints_;
+  vector<db::Ref> refs_;
+  vector<db::Unit> units_;
+  vector<db::AttributeBonus> bonuses_;
+  vector<db::SplashArea> splash_;
+  vector<db::Effect> effects_;
+  vector<db::Weapon> weapons_;
+  vector<db::Requirement> requirements_;
+  vector<db::AbilityCommand> commands_;
+  vector<db::Ability> abilities_;
+  vector<db::UpgradeEffect> upgradeEffects_;
+  vector<db::Upgrade> upgrades_;
+  vector<db::TechItem> techItems_;
+  vector<db::TechEntry> techEntries_;
+  vector<db::AliasClass> aliasClasses_;
+  vector<uint64_t> unitSets_;
+  vector<db::RequirementOp> requirementCode_;
+  vector<db::Attack> attacks_;
+  vector<db::Damage> damage_;
+  vector<const Unit*> unitSources_; // parallel to units_
+};
+
+const char* const DatabaseWriter::attributeNames[7] = { "Light", "Biological", "Mechanical", "Armored", "Structure", "Psionic", "Massive" };
 
-  out.close();
+void dumpDatabase( GameData& data, TechMap& techtree )
+{
+  printf_s( "[d] dumping binary database...\r\n" );
+
+  DatabaseWriter writer( data );
+  writer.addEffects();
+  writer.addWeapons();
+  writer.addAliasClasses();
+  writer.addUnits();
+  writer.addDamageMatrix();
+  writer.addAbilities();
+  writer.addUpgrades();
+  writer.addTechTree( techtree );
+  writer.write( "gamedata.db" );
 }
 
-void readGameData( const string& path, UnitMap& units, Unit& defaultUnit, Footprint& defaultFootprint, AbilityMap& abilities, RequirementMap& requirements, RequirementNodeMap& nodes, FootprintMap& footprints, WeaponMap& weapons, Weapon& defaultWeapon, EffectMap& effects, UpgradeMap& upgrades, Upgrade& defaultUpgrade )
-{
-  string unitDataPath = path + PATHSEP "UnitData.xml";
+// An output is only written again when something it is generated from has changed. The
+// manifest remembers the key of each output's inputs and the size it was written with.
+// Bump outputVersion whenever an emitter changes, so that every output is written again:
+//   2: gamedata.db is also keyed on db::dbVersion
+//   3: gamedata.db carries the tech alias classes
+//   4: gamedata.db carries compiled requirement programs
+//   5: gamedata.db carries the damage matrix
+//   6: gamedata.db effects come from the effect graph
+const uint32_t outputVersion = 6;
+
+struct OutputFile {
+  const char* name;
+  vector<const char*> inputs; // catalog stages, stableid sections, options and file formats
+  std::function<void()> write;
+  bool usesTechTree; // waits for generateTechTree()
+  uint64_t key;
+};
 
-  size_t loops = 0;
-  while ( true )
-  {
-    loops++;
-    size_t notfound = 0;
-    parseUnitData( unitDataPath, units, defaultUnit, notfound );
-    if ( notfound == 0 )
-      break;
-    if ( loops > 10 )
-      throw runtime_error( "Failed to parse unit data in 10 rounds, wtf?" );
-  }
+using OutputManifest = std::map<string, std::pair<uint64_t, uint64_t>>; // name -> key, size
 
-  string abilityDataPath = path + PATHSEP "AbilData.xml";
-  parseAbilityData( abilityDataPath, abilities );
+uint64_t fileSize( const string& path )
+{
+  ifstream in( path, std::ios::binary | std::ios::ate );
+  return in.is_open() ? static_cast<uint64_t>( in.tellg() ) : UINT64_MAX;
+}
 
-  string requirementDataPath = path + PATHSEP "RequirementData.xml";
-  string requirementNodeDataPath = path + PATHSEP "RequirementNodeData.xml";
-  parseRequirementData( requirementDataPath, requirementNodeDataPath, requirements, nodes );
+OutputManifest readOutputManifest( const string& path )
+{
+  OutputManifest manifest;
+  ifstream in( path );
+  string name;
+  uint64_t key, size;
+  while ( in >> name >> std::hex >> key >> std::dec >> size )
+    manifest[name] = std::make_pair( key, size );
+  return manifest;
+}
 
-  string footprintDataPath = path + PATHSEP "FootprintData.xml";
-  loops = 0;
-  while ( true )
-  {
-    loops++;
-    size_t notfound = 0;
-    parseFootprintData( footprintDataPath, footprints, defaultFootprint, notfound );
-    if ( notfound == 0 )
-      break;
-    if ( loops > 10 )
-      throw runtime_error( "Failed to parse footprint data in 10 rounds, wtf?" );
-  }
+void writeOutputManifest( const string& path, const OutputManifest& manifest )
+{
+  ofstream out( path, std::ios::trunc );
+  for ( auto& entry : manifest )
+    out << entry.first << " " << std::hex << entry.second.first << " " << std::dec << entry.second.second << std::endl;
+}
 
-  string weaponDataPath = path + PATHSEP "WeaponData.xml";
-  parseWeaponData( weaponDataPath, weapons, defaultWeapon );
+uint64_t hashMapping( const NameToIDMapping& mapping )
+{
+  uint64_t hash = 14695981039346656037ull;
+  for ( auto& entry : mapping )
+    hash = hashMix( hashString( hash, entry.first.str() ), entry.second );
+  return hashFinish( hash );
+}
 
-  string effectDataPath = path + PATHSEP "EffectData.xml";
-  loops = 0;
-  while ( true )
+template <class Map, class Key>
+void benchmarkMap( const char* label, const vector<Key>& keys, const vector<Key>& probes, size_t rounds )
+{
+  using Clock = std::chrono::steady_clock;
+  Clock::duration insertTime( 0 );
+  Clock::duration findTime( 0 );
+  size_t checksum = 0;
+  for ( size_t round = 0; round < rounds; round++ )
   {
-    loops++;
-    size_t notfound = 0;
-    parseEffectData( effectDataPath, effects, notfound );
-    if ( notfound == 0 )
-      break;
-    if ( loops > 10 )
-      throw runtime_error( "Failed to parse effect data in 10 rounds, wtf?" );
+    auto start = Clock::now();
+    Map map;
+    for ( size_t i = 0; i < keys.size(); i++ )
+      map[keys[i]] = i;
+    auto inserted = Clock::now();
+    for ( auto& key : probes )
+      checksum += map.find( key )->second;
+    findTime += Clock::now() - inserted;
+    insertTime += inserted - start;
   }
+  auto ns = []( Clock::duration time, size_t ops ) { return std::chrono::duration<double, std::nano>( time ).count() / ops; };
+  printf_s( "[b] %-32s insert %7.1f ns  find %7.1f ns  (checksum %llu)\r\n", label, ns( insertTime, keys.size() * rounds ), ns( findTime, probes.size() * rounds ), static_cast<unsigned long long>( checksum ) );
+}
 
-  string upgradeDataPath = path + PATHSEP "UpgradeData.xml";
-  parseUpgradeData( upgradeDataPath, upgrades, defaultUpgrade );
+// Times the catalog map against the std::map<string> it replaced, using the unit,
+// ability, upgrade and weapon names of a real dataset directory as the keys.
+void benchmarkMaps( const string& dataPath )
+{
+  Json::Value stableIDs;
+  Json::Value weapons;
+  std::ifstream in( dataPath + PATHSEP "stableid.json" );
+  if ( !in.is_open() )
+    throw runtime_error( "could not open " + dataPath + PATHSEP "stableid.json" );
+  in >> stableIDs;
+  std::ifstream weaponsIn( dataPath + PATHSEP "weapons.json" );
+  if ( weaponsIn.is_open() )
+    weaponsIn >> weapons;
+
+  vector<string> names;
+  for ( auto& unit : stableIDs["Units"] )
+    names.push_back( unit["name"].asString() );
+  for ( auto& ability : stableIDs["Abilities"] )
+    names.push_back( ability["name"].asString() + "," + ability["index"].asString() );
+  for ( auto& upgrade : stableIDs["Upgrades"] )
+    names.push_back( upgrade["name"].asString() );
+  for ( auto& name : weapons.getMemberNames() )
+    names.push_back( name );
+  std::sort( names.begin(), names.end() );
+  names.erase( std::unique( names.begin(), names.end() ), names.end() );
+
+  vector<string> probes = names;
+  std::shuffle( probes.begin(), probes.end(), std::mt19937( 65384 ) );
+  vector<Symbol> keySymbols;
+  vector<Symbol> probeSymbols;
+  for ( auto& name : names )
+    keySymbols.emplace_back( name );
+  for ( auto& name : probes )
+    probeSymbols.emplace_back( name );
+
+  printf_s( "[b] %llu names from %s\r\n", static_cast<unsigned long long>( names.size() ), dataPath.c_str() );
+  const size_t rounds = 200;
+  benchmarkMap<std::map<string, size_t>>( "std::map<string>", names, probes, rounds );
+  benchmarkMap<std::unordered_map<string, size_t>>( "std::unordered_map<string>", names, probes, rounds );
+  benchmarkMap<std::unordered_map<Symbol, size_t>>( "std::unordered_map<Symbol>", keySymbols, probeSymbols, rounds );
+  benchmarkMap<SymbolMap<size_t>>( "SymbolMap", keySymbols, probeSymbols, rounds );
 }
 
-void readStableID( const string& path, NameToIDMapping& unitMapping, NameToIDMapping& abilityMapping, NameToIDMapping& upgradeMapping )
+// The JsonCpp reader readStableID replaced, kept to benchmark it against.
+void readStableIDDOM( const string& path, NameToIDMapping& unitMapping, NameToIDMapping& abilityMapping, NameToIDMapping& upgradeMapping )
 {
   Json::Value root;
   std::ifstream infile;
@@ -2625,7 +6504,7 @@ void readStableID( const string& path, NameToIDMapping& unitMapping, NameToIDMap
   auto& units = root["Units"];
   for ( auto& unit : units )
   {
-    unitMapping[unit["name"].asString()] = unit["id"].asUInt64();
+    unitMapping[Symbol( unit["name"].asString() )] = unit["id"].asUInt64();
   }
 
   auto& abilities = root["Abilities"];
@@ -2633,77 +6512,401 @@ void readStableID( const string& path, NameToIDMapping& unitMapping, NameToIDMap
   {
     string name = ( ability["name"].asString() + "," );
     name.append( ability["index"].asString() );
-    abilityMapping[name] = ability["id"].asUInt64();
+    abilityMapping[Symbol( name )] = ability["id"].asUInt64();
   }
 
   auto& upgrades = root["Upgrades"];
   for ( auto& upgrade : upgrades )
   {
-    upgradeMapping[upgrade["name"].asString()] = upgrade["id"].asUInt64();
+    upgradeMapping[Symbol( upgrade["name"].asString() )] = upgrade["id"].asUInt64();
   }
 }
 
-void dumpTechTreeText( const string& suffix, TechTree& tree )
+// Times readStableID against the JsonCpp reader it replaced on every checked-in
+// stableid.json, checking that both produce the same mappings.
+void benchmarkStableID()
 {
-  // dump techtree to txt for debug
-  ofstream techDump;
-  techDump.open( "techtree-" + suffix + ".txt" );
-  for ( auto& root : tree )
+  using Clock = std::chrono::steady_clock;
+  const size_t rounds = 20;
+  for ( auto dataset : sc2gamedata::datasets )
   {
-    techDump << root.id << std::endl;
-    if ( !root.builds.empty() )
-      techDump << "  builds" << std::endl;
-    for ( auto& bld : root.builds )
-      if ( !bld.unit.empty() )
-        techDump << "    " << bld.unit << std::endl;
-    if ( !root.morphs.empty() )
-      techDump << "  morphs" << std::endl;
-    for ( auto& mrph : root.morphs )
-      if ( !mrph.unit.empty() )
-        techDump << "    " << mrph.unit << std::endl;
-    if ( !root.merges.empty() )
-      techDump << "  merges" << std::endl;
-    for ( auto& mrg : root.merges )
-      if ( !mrg.unit.empty() )
-        techDump << "    " << mrg.unit << std::endl;
-    if ( !root.researches.empty() )
+    string path = string( dataset ) + PATHSEP "stableid.json";
+    if ( !std::ifstream( path ).good() )
+      continue;
+
+    Clock::duration domTime {};
+    Clock::duration streamTime {};
+    NameToIDMapping domMappings[3];
+    NameToIDMapping streamMappings[3];
+    IDToNameMapping names[3];
+    for ( size_t round = 0; round < rounds; round++ )
     {
-      techDump << "  upgrades" << std::endl;
-      for ( auto& res : root.researches )
-        if ( !res.upgrade.empty() )
-          techDump << "    " << res.upgrade << std::endl;
+      for ( size_t i = 0; i < 3; i++ )
+      {
+        domMappings[i] = NameToIDMapping();
+        streamMappings[i] = NameToIDMapping();
+        names[i].clear();
+      }
+      auto start = Clock::now();
+      readStableIDDOM( path, domMappings[0], domMappings[1], domMappings[2] );
+      auto parsed = Clock::now();
+      readStableID( path, { streamMappings[0], names[0] }, { streamMappings[1], names[1] }, { streamMappings[2], names[2] } );
+      streamTime += Clock::now() - parsed;
+      domTime += parsed - start;
     }
-    techDump << std::endl;
+
+    for ( size_t i = 0; i < 3; i++ )
+    {
+      if ( domMappings[i].size() != streamMappings[i].size() )
+        throw runtime_error( path + ": readers disagree on the number of ids" );
+      for ( auto& entry : domMappings[i] )
+      {
+        auto it = streamMappings[i].find( entry.first );
+        if ( it == streamMappings[i].end() || it->second != entry.second )
+          throw runtime_error( path + ": readers disagree on " + entry.first.str() );
+      }
+    }
+
+    auto ms = []( Clock::duration time, size_t count ) { return std::chrono::duration<double, std::milli>( time ).count() / count; };
+    printf_s( "[b] %-40s JsonCpp %7.2f ms  streaming %7.2f ms  (%llu ids)\r\n", path.c_str(), ms( domTime, rounds ), ms( streamTime, rounds ),
+      static_cast<unsigned long long>( streamMappings[0].size() + streamMappings[1].size() + streamMappings[2].size() ) );
   }
-  techDump.close();
 }
 
-void cleanupUnitCommandCards( UnitMap& units )
+// Times the combat simulator on random fights between units of a generated gamedata.db
+// that have attacks, on one thread and on all of them.
+void benchmarkCombat( const string& dbPath )
 {
-  for ( auto& unit : units )
+  using Clock = std::chrono::steady_clock;
+  sc2gamedata::MappedDatabase db( dbPath );
+  sc2gamedata::CombatModel model( db );
+
+  vector<uint32_t> fighters;
+  for ( uint32_t unit = 0; unit < model.unitCount(); unit++ )
+    if ( model.attacksBegin( unit ) != model.attacksEnd( unit ) && model.life( unit ) > 0.0f && !( db.units()[unit].flags & sc2gamedata::Unit_Structure ) )
+      fighters.push_back( unit );
+  if ( fighters.empty() )
+    throw runtime_error( dbPath + " has no units with attacks" );
+
+  std::mt19937 rng( 65384 );
+  vector<sc2gamedata::CombatScenario> scenarios( 4096 );
+  for ( auto& scenario : scenarios )
   {
-    std::set<std::string> usedCommands;
-    for ( auto& card : unit.second.abilityCardsMap )
+    uint32_t types[2] = { fighters[rng() % fighters.size()], fighters[rng() % fighters.size()] };
+    size_t count = 4 + rng() % 29;
+    for ( uint8_t side = 0; side < 2; side++ )
+      for ( size_t i = 0; i < count; i++ )
+        scenario.units.push_back( { types[side], side, ( side ? 23.0f - static_cast<float>( i % 4 ) : static_cast<float>( i % 4 ) ), static_cast<float>( i / 4 ) } );
+  }
+
+  unsigned cores = std::max( 1u, std::thread::hardware_concurrency() );
+  printf_s( "[b] %llu scenarios of up to 64 units, %llu unit types with attacks\r\n", static_cast<unsigned long long>( scenarios.size() ),
+    static_cast<unsigned long long>( fighters.size() ) );
+  vector<unsigned> threadCounts = { 1u };
+  if ( cores > 1 )
+    threadCounts.push_back( cores );
+  for ( unsigned threads : threadCounts )
+  {
+    auto start = Clock::now();
+    auto results = sc2gamedata::simulate( model, scenarios, threads );
+    double seconds = std::chrono::duration<double>( Clock::now() - start ).count();
+    size_t decided = 0;
+    double gameTime = 0.0;
+    for ( auto& result : results )
     {
-      if ( card.second.removed || card.second.commands.empty() )
-        continue;
-      auto it = card.second.commands.begin();
-      while ( it != card.second.commands.end() )
+      decided += ( result.winner >= 0 );
+      gameTime += result.time;
+    }
+    printf_s( "[b] %2u threads %10.0f scenarios/s  (%llu decided, %.0f game seconds)\r\n", threads, scenarios.size() / seconds,
+      static_cast<unsigned long long>( decided ), gameTime );
+  }
+}
+
+// Times build order rollouts from the standard opening of every race gamedata.db has one
+// for, on random build orders that the simulator itself checked can be started.
+void benchmarkBuild( const string& dbPath )
+{
+  using Clock = std::chrono::steady_clock;
+  sc2gamedata::MappedDatabase db( dbPath );
+  auto unitId = [&db]( const char* name ) {
+    for ( auto& unit : db.units() )
+      if ( strcmp( db.text( unit.name ), name ) == 0 )
+        return unit.id;
+    return sc2gamedata::none;
+  };
+
+  struct Opening {
+    sc2gamedata::Race race;
+    const char* label;
+    const char* townhall;
+    const char* worker;
+  };
+  const Opening openings[] = {
+      { sc2gamedata::Race_Terran, "terran", "CommandCenter", "SCV" },
+      { sc2gamedata::Race_Protoss, "protoss", "Nexus", "Probe" },
+      { sc2gamedata::Race_Zerg, "zerg", "Hatchery", "Drone" },
+  };
+  const double timeLimit = 1200.0;
+  for ( auto& opening : openings )
+  {
+    sc2gamedata::BuildModel model( db, opening.race );
+    auto townhall = unitId( opening.townhall );
+    auto worker = unitId( opening.worker );
+    if ( model.unitIndex( townhall ) == sc2gamedata::none || model.unitIndex( worker ) == sc2gamedata::none )
+    {
+      printf_s( "[b] %-8s no %s and %s in the tech tree\r\n", opening.label, opening.townhall, opening.worker );
+      continue;
+    }
+    auto start = model.start( 50.0, 0.0 );
+    model.add( start, townhall, 1 );
+    model.add( start, worker, 12 );
+    if ( opening.race == sc2gamedata::Race_Zerg )
+    {
+      // a larva every 11 seconds at Faster, up to 3 per hatchery
+      auto larva = unitId( "Larva" );
+      for ( auto name : { "Hatchery", "Lair", "Hive" } )
+        if ( model.unitIndex( unitId( name ) ) != sc2gamedata::none && model.unitIndex( larva ) != sc2gamedata::none )
+          model.addSpawner( unitId( name ), larva, 11.0 * 1.4, 3 );
+      if ( model.unitIndex( larva ) != sc2gamedata::none )
+        model.add( start, larva, 3 );
+      if ( model.unitIndex( unitId( "Overlord" ) ) != sc2gamedata::none )
+        model.add( start, unitId( "Overlord" ), 1 );
+    }
+
+    vector<uint32_t> goals;
+    for ( uint32_t goal = 0; goal < sc2gamedata::maxBuildUnits + sc2gamedata::maxBuildUpgrades; goal++ )
+      if ( model.goalBegin( goal ) != model.goalEnd( goal ) )
+        goals.push_back( goal );
+    std::mt19937 rng( 65384 );
+    vector<vector<uint32_t>> orders( 1024 );
+    for ( auto& order : orders )
+    {
+      auto state = start;
+      for ( size_t attempt = 0; attempt < 200 && order.size() < 30; attempt++ )
       {
-        if ( usedCommands.find( ( *it ).second ) != usedCommands.end() )
-          it = card.second.commands.erase( it );
+        order.push_back( goals[rng() % goals.size()] );
+        auto next = state;
+        if ( model.run( next, order.data(), static_cast<uint32_t>( order.size() ), timeLimit ).complete )
+          state = next;
         else
-        {
-          usedCommands.insert( ( *it ).second );
-          it++;
-        }
+          order.pop_back();
+      }
+    }
+
+    unsigned cores = std::max( 1u, std::thread::hardware_concurrency() );
+    vector<unsigned> threadCounts = { 1u };
+    if ( cores > 1 )
+      threadCounts.push_back( cores );
+    for ( unsigned threads : threadCounts )
+    {
+      size_t rollouts = 0;
+      size_t steps = 0;
+      auto begin = Clock::now();
+      double seconds = 0.0;
+      while ( seconds < 1.0 )
+      {
+        for ( auto& result : sc2gamedata::simulate( model, start, orders, timeLimit, threads ) )
+          steps += result.steps;
+        rollouts += orders.size();
+        seconds = std::chrono::duration<double>( Clock::now() - begin ).count();
       }
+      printf_s( "[b] %-8s %2u threads %10.0f rollouts/s  (%.1f steps each, %u unit types, %llu actions)\r\n", opening.label, threads, rollouts / seconds,
+        static_cast<double>( steps ) / rollouts, model.unitCount(), static_cast<unsigned long long>( model.actions().size() ) );
     }
   }
 }
 
-int main()
+// --check-db: values of the v4.3.2.65384 data that are known from the game, read back
+// from a generated gamedata.db through the readers in the headers.
+struct DatabaseCheck {
+  size_t failures = 0;
+
+  void operator()( bool ok, const char* what )
+  {
+    printf_s( "[c] %-48s %s\r\n", what, ok ? "ok" : "FAILED" );
+    failures += !ok;
+  }
+};
+
+bool hasName( const sc2gamedata::Database& db, sc2gamedata::String name, const char* expected )
+{
+  return strcmp( db.text( name ), expected ) == 0;
+}
+
+void checkLookups( const sc2gamedata::Database& db, DatabaseCheck& check )
+{
+  auto marine = db.unit( 48 );
+  check( marine && hasName( db, marine->name, "Marine" ) && marine->lifeMax == 45.0 && marine->food == -1.0 && marine->mineralCost == 50, "unit 48 is the Marine" );
+  auto zergling = db.unit( 105 );
+  check( zergling && hasName( db, zergling->name, "Zergling" ) && zergling->lifeMax == 35.0, "unit 105 is the Zergling" );
+  check( !db.unit( 1u << 30 ), "unknown unit ids are not found" );
+  auto train = db.abilityCommand( 560 );
+  check( train && hasName( db, db.ability( *train ).name, "BarracksTrain" ) && hasName( db, train->index, "Train1" ) && train->time == 25.0,
+    "ability 560 is BarracksTrain,Train1" );
+  auto stimpack = db.upgrade( 15 );
+  check( stimpack && hasName( db, stimpack->name, "Stimpack" ), "upgrade 15 is Stimpack" );
+}
+
+// The Marauder needs a tech lab on its barracks.
+void checkRequirements( const sc2gamedata::Database& db, DatabaseCheck& check )
+{
+  auto train = db.abilityCommand( 563 );
+  if ( !train || train->requirements.count == 0 )
+  {
+    check( false, "ability 563 has requirements" );
+    return;
+  }
+  sc2gamedata::RequirementEvaluator evaluator( db );
+  auto holds = [&]( const sc2gamedata::TechState& state ) {
+    auto& results = evaluator.evaluate( state );
+    bool all = true;
+    for ( auto req : db.range<uint32_t>( sc2gamedata::Table_Indices, train->requirements ) )
+      all = all && results[req];
+    return all;
+  };
+  sc2gamedata::TechState state;
+  state.addUnit( 21 );
+  check( !holds( state ), "Marauder needs more than a Barracks" );
+  state.addUnit( 5 );
+  check( holds( state ), "Marauder needs a TechLab" );
+}
+
+// A Marine shoots a Zergling dead in six hits and takes nine of its bites, so it wins
+// one against one from a little beyond its range.
+void checkCombat( const sc2gamedata::Database& db, DatabaseCheck& check )
+{
+  auto marine = db.unit( 48 );
+  auto zergling = db.unit( 105 );
+  if ( !marine || !zergling )
+  {
+    check( false, "Marine and Zergling are in the database" );
+    return;
+  }
+  auto marineIndex = static_cast<uint32_t>( marine - db.units().begin() );
+  auto zerglingIndex = static_cast<uint32_t>( zergling - db.units().begin() );
+  sc2gamedata::CombatModel model( db );
+  auto attack = [&]( uint32_t unit, uint32_t target ) -> const sc2gamedata::Damage* {
+    auto a = model.bestAttack( unit, target );
+    return ( a == sc2gamedata::none ? nullptr : &db.damage( a, target ) );
+  };
+  auto shots = attack( marineIndex, zerglingIndex );
+  check( shots && shots->lifePerHit == 6.0f && shots->hitsToKill == 6, "Marine kills a Zergling in 6 hits" );
+  auto bites = attack( zerglingIndex, marineIndex );
+  check( bites && bites->lifePerHit == 5.0f && bites->hitsToKill == 9, "Zergling kills a Marine in 9 hits" );
+
+  sc2gamedata::CombatScenario scenario;
+  scenario.units.push_back( { marineIndex, 0, 0.0f, 0.0f } );
+  scenario.units.push_back( { zerglingIndex, 1, 6.0f, 0.0f } );
+  auto result = sc2gamedata::CombatSimulator( model ).run( scenario );
+  check( result.winner == 0 && result.survivors[0] == 1 && result.health[0] < 45.0f, "Marine beats a Zergling" );
+}
+
+// From the standard terran opening, a Barracks needs a Supply Depot first and a Marine
+// needs the Barracks, so the three only go one after the other.
+void checkBuild( const sc2gamedata::Database& db, DatabaseCheck& check )
+{
+  sc2gamedata::BuildModel model( db, sc2gamedata::Race_Terran );
+  const uint32_t commandCenter = 18, supplyDepot = 19, barracks = 21, scv = 45, marine = 48;
+  uint32_t depotGoal = model.unitGoal( supplyDepot ), barracksGoal = model.unitGoal( barracks ), marineGoal = model.unitGoal( marine );
+  if ( model.unitIndex( commandCenter ) == sc2gamedata::none || model.unitIndex( scv ) == sc2gamedata::none || depotGoal == sc2gamedata::none ||
+       barracksGoal == sc2gamedata::none || marineGoal == sc2gamedata::none )
+  {
+    check( false, "terran tech tree has the opening units" );
+    return;
+  }
+  auto start = model.start( 50.0, 0.0 );
+  model.add( start, commandCenter, 1 );
+  model.add( start, scv, 12 );
+
+  const uint32_t order[] = { depotGoal, barracksGoal, marineGoal };
+  double leastTime = 0.0;
+  for ( auto goal : order )
+    leastTime += model.actions()[*model.goalBegin( goal )].time;
+  auto state = start;
+  auto result = model.run( state, order, 3, 1200.0 );
+  check( result.complete && state.count[model.unitIndex( marine )] == 1 && result.time >= leastTime, "Supply Depot, Barracks and Marine go in turn" );
+
+  const uint32_t early[] = { barracksGoal };
+  state = start;
+  result = model.run( state, early, 1, 1200.0 );
+  check( !result.complete && result.steps == 0, "no Barracks without a Supply Depot" );
+
+  // With a second Barracks free, a Marauder or Ghost could start on it at once if the
+  // tech lab still being built on the first one were counted; it has to be complete.
+  const uint32_t ghostAcademy = 26, barracksTechLab = 37, ghost = 50, marauder = 51;
+  auto techLabGoal = model.unitGoal( barracksTechLab );
+  if ( techLabGoal == sc2gamedata::none || model.unitIndex( ghostAcademy ) == sc2gamedata::none )
+  {
+    check( false, "terran tech tree has the tech lab units" );
+    return;
+  }
+  start = model.start( 1000.0, 1000.0 );
+  model.add( start, commandCenter, 1 );
+  model.add( start, scv, 12 );
+  model.add( start, supplyDepot, 1 );
+  model.add( start, barracks, 2 );
+  model.add( start, ghostAcademy, 1 );
+  // an order that makes none passes unless it has to make one
+  auto afterTechLab = [&]( uint32_t unit, bool mustMake ) {
+    auto goal = model.unitGoal( unit );
+    if ( goal == sc2gamedata::none )
+      return false;
+    const uint32_t order[] = { techLabGoal, goal };
+    auto state = start;
+    auto result = model.run( state, order, 2, 1200.0 );
+    double least = model.actions()[*model.goalBegin( techLabGoal )].time + model.actions()[*model.goalBegin( goal )].time;
+    if ( state.count[model.unitIndex( unit )] == 0 )
+      return !mustMake;
+    return result.time >= least - 1e-6;
+  };
+  check( afterTechLab( marauder, false ), "no Marauder before the TechLab is complete" );
+  check( afterTechLab( ghost, true ), "no Ghost before the BarracksTechLab is complete" );
+}
+
+int checkDatabase( const string& dbPath )
+{
+  sc2gamedata::MappedDatabase db( dbPath );
+  DatabaseCheck check;
+  checkLookups( db, check );
+  checkRequirements( db, check );
+  checkCombat( db, check );
+  checkBuild( db, check );
+  printf_s( "[c] %llu checks failed\r\n", static_cast<unsigned long long>( check.failures ) );
+  return ( check.failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE );
+}
+
+int main( int argc, char* argv[] )
 {
+  if ( argc > 1 && strcmp( argv[1], "--bench-maps" ) == 0 )
+  {
+    benchmarkMaps( argc > 2 ? argv[2] : "v4.3.2.65384" );
+    return EXIT_SUCCESS;
+  }
+  if ( argc > 1 && strcmp( argv[1], "--bench-stableid" ) == 0 )
+  {
+    benchmarkStableID();
+    return EXIT_SUCCESS;
+  }
+  if ( argc > 1 && strcmp( argv[1], "--bench-combat" ) == 0 )
+  {
+    benchmarkCombat( argc > 2 ? argv[2] : "v4.3.2.65384" PATHSEP "gamedata.db" );
+    return EXIT_SUCCESS;
+  }
+  if ( argc > 1 && strcmp( argv[1], "--bench-build" ) == 0 )
+  {
+    benchmarkBuild( argc > 2 ? argv[2] : "v4.3.2.65384" PATHSEP "gamedata.db" );
+    return EXIT_SUCCESS;
+  }
+  if ( argc > 1 && strcmp( argv[1], "--check-db" ) == 0 )
+    return checkDatabase( argc > 2 ? argv[2] : "v4.3.2.65384" PATHSEP "gamedata.db" );
+
+  bool useSnapshots = true;
+  for ( int i = 1; i < argc; i++ )
+    if ( strcmp( argv[i], "--no-snapshots" ) == 0 )
+      useSnapshots = false;
+    else if ( strcmp( argv[i], "--shared-requirements" ) == 0 )
+      g_sharedRequirements = true;
+
   string rootPath;
   rootPath.reserve( MAX_PATH );
 
@@ -2716,7 +6919,7 @@ int main()
   string stableIDPath = rootPath.c_str(); // clone from c_str because internally rootPath is corrupted
   stableIDPath.append( PATHSEP "stableid.json" );
 
-  readStableID( stableIDPath, g_unitMapping, g_abilityMapping, g_upgradeMapping );
+  readStableID( stableIDPath, { g_unitMapping, g_unitNames }, { g_abilityMapping, g_abilityNames }, { g_upgradeMapping, g_upgradeNames } );
 
   // sc2 uses incremental patches so these have to be in order
   vector<string> mods = {
@@ -2728,19 +6931,29 @@ int main()
       "balancemulti.sc2mod",
   };
 
-  UnitMap units;
-  AbilityMap abilities;
-  RequirementMap requirements;
-  RequirementNodeMap nodes;
-  FootprintMap footprints;
-  WeaponMap weapons;
-  Weapon defaultWeapon;
-  Footprint defaultFootprint;
-  EffectMap effects;
-  Unit defaultUnit;
-  UpgradeMap upgrades;
-  Upgrade defaultUpgrade;
+  GameData data;
+  auto& units = data.units;
+  auto& abilities = data.abilities;
+  auto& requirements = data.requirements;
+  auto& nodes = data.nodes;
+  auto& footprints = data.footprints;
+  auto& weapons = data.weapons;
+  auto& effects = data.effects;
+  auto& upgrades = data.upgrades;
+
+  string snapshotPath;
+  if ( useSnapshots )
+  {
+    snapshotPath = rootPath.c_str(); // clone from c_str because internally rootPath is corrupted
+    snapshotPath.append( PATHSEP "snapshots" );
+#if defined( WIN32 )
+    CreateDirectoryA( snapshotPath.c_str(), NULL );
+#else
+    mkdir( snapshotPath.c_str(), 0755 );
+#endif
+  }
 
+  vector<string> gameDataPaths;
   for ( auto mod : mods )
   {
     string modPath = rootPath.c_str(); // clone from c_str because internally rootPath is corrupted
@@ -2748,63 +6961,108 @@ int main()
 
     printf_s( "[A] mod: %s\r\n", mod.c_str() );
 
-    string gameDataPath = modPath + PATHSEP "base.sc2data" PATHSEP "GameData";
-    readGameData( gameDataPath, units, defaultUnit, defaultFootprint, abilities, requirements, nodes, footprints, weapons, defaultWeapon, effects, upgrades, defaultUpgrade );
+    gameDataPaths.push_back( modPath + PATHSEP "base.sc2data" PATHSEP "GameData" );
   }
 
-  cleanupUnitCommandCards( units );
-
-  dumpUnits( units, footprints );
-
-  dumpAbilities( abilities, requirements, nodes );
-
-  dumpWeapons( weapons, effects );
-
-  dumpUpgrades( upgrades );
-
-  TechTree zergTechTree;
-  TechTree protossTechTree;
-  TechTree terranTechTree;
-  generateTechTree( units, abilities, Race_Zerg, zergTechTree );
-  generateTechTree( units, abilities, Race_Protoss, protossTechTree );
-  generateTechTree( units, abilities, Race_Terran, terranTechTree );
-
-  TechMap techMap;
-  techMap[Race_Zerg] = zergTechTree;
-  techMap[Race_Protoss] = protossTechTree;
-  techMap[Race_Terran] = terranTechTree;
-
-  dumpTechTree( techMap, requirements, nodes );
-
-  printf_s( "[d] dumping text files for humans...\r\n" );
-
-  // dump footprints to text file with easy visualisation
-  ofstream footDump;
-  footDump.open( "footprints.txt" );
-  for ( auto& fp : footprints )
+  auto stages = catalogStages( data );
+
+  // filled in by the emit phase, before the outputs that are written from it
+  TechMap techMap = { { Race_Zerg, TechTree() }, { Race_Protoss, TechTree() }, { Race_Terran, TechTree() } };
+
+  // In the order they have always been written, which is still the order of the manifest.
+  vector<OutputFile> outputs = {
+      { "units.json", { "units", "footprints", "stableid:Units" }, [&] { dumpUnits( units, footprints ); }, false, 0 },
+      { "abilities.json", { "abilities", "requirements", "units", "stableid:Units", "stableid:Abilities", "stableid:Upgrades", "option:shared-requirements" }, [&] { dumpAbilities( abilities ); }, false, 0 },
+      { "weapons.json", { "weapons", "effects" }, [&] { dumpWeapons( weapons ); }, false, 0 },
+      { "upgrades.json", { "upgrades" }, [&] { dumpUpgrades( upgrades ); }, false, 0 },
+      { "techtree.json", { "units", "abilities", "requirements", "stableid:Units", "stableid:Abilities", "stableid:Upgrades", "option:shared-requirements" }, [&] { dumpTechTree( techMap ); }, true, 0 },
+      { "footprints.txt", { "footprints" }, [&] { printf_s( "[d] dumping text files for humans...\r\n" ); dumpFootprintsText( footprints ); }, false, 0 },
+      { "techtree-zerg.txt", { "units", "abilities" }, [&] { dumpTechTreeText( "zerg", techMap.at( Race_Zerg ) ); }, true, 0 },
+      { "techtree-protoss.txt", { "units", "abilities" }, [&] { dumpTechTreeText( "protoss", techMap.at( Race_Protoss ) ); }, true, 0 },
+      { "techtree-terran.txt", { "units", "abilities" }, [&] { dumpTechTreeText( "terran", techMap.at( Race_Terran ) ); }, true, 0 },
+      { "gamedata.db", { "units", "footprints", "weapons", "effects", "abilities", "requirements", "upgrades", "stableid:Units", "stableid:Abilities", "stableid:Upgrades", "format:gamedata.db" }, [&] { dumpDatabase( data, techMap ); }, true, 0 },
+  };
+  if ( g_sharedRequirements )
+    outputs.push_back( { "requirements.json", { "units", "abilities", "requirements", "stableid:Units", "stableid:Upgrades" }, [&] { dumpRequirements(); }, false, 0 } );
+
+  // Without snapshots there is nothing to compare against, so everything is written.
+  CatalogHashes hashes;
+  OutputManifest manifest;
+  string manifestPath;
+  vector<OutputFile*> stale;
+  if ( useSnapshots )
   {
-    if ( fp.second.removed || fp.second.placement.empty() || fp.second.w == -1 )
-      continue;
-
-    char sdfsd[128];
-    sprintf_s( sdfsd, 128, " (%i,%i,%i,%i)", fp.second.x, fp.second.y, fp.second.w, fp.second.h );
-    footDump << fp.second.id << sdfsd << std::endl;
-    for ( int y = 0; y < fp.second.h; y++ )
+    hashes = hashCatalogs( gameDataPaths, stages );
+    std::map<string, uint64_t> inputKeys;
+    for ( size_t stage = 0; stage < stages.size(); stage++ )
     {
-      for ( int x = 0; x < fp.second.w; x++ )
-      {
-        auto idx = y * fp.second.w + x;
-        footDump << ( fp.second.placement[idx] ? "x" : fp.second.creep[idx] ? "o" : fp.second.nearResources[idx] ? "n" : "." );
-      }
-      footDump << std::endl;
+      uint64_t key = 14695981039346656037ull;
+      for ( auto& modHashes : hashes )
+        key = hashMix( key, modHashes[stage] );
+      inputKeys[stages[stage].name] = hashFinish( key );
+    }
+    inputKeys["stableid:Units"] = hashMapping( g_unitMapping );
+    inputKeys["stableid:Abilities"] = hashMapping( g_abilityMapping );
+    inputKeys["stableid:Upgrades"] = hashMapping( g_upgradeMapping );
+    inputKeys["option:shared-requirements"] = g_sharedRequirements;
+    inputKeys["format:gamedata.db"] = db::dbVersion;
+
+    manifestPath = snapshotPath + PATHSEP "outputs.manifest";
+    manifest = readOutputManifest( manifestPath );
+    for ( auto& output : outputs )
+    {
+      output.key = outputVersion;
+      for ( auto input : output.inputs )
+        output.key = hashMix( output.key, inputKeys.at( input ) );
+      output.key = hashFinish( output.key );
+      auto it = manifest.find( output.name );
+      if ( it != manifest.end() && it->second.first == output.key && it->second.second == fileSize( output.name ) )
+        printf_s( "[o] %s is up to date\r\n", output.name );
+      else
+        stale.push_back( &output );
     }
-    footDump << std::endl;
   }
-  footDump.close();
+  else
+    for ( auto& output : outputs )
+      stale.push_back( &output );
+
+  if ( !stale.empty() )
+  {
+    readGameData( gameDataPaths, stages, hashes, snapshotPath, data );
+    reportAllocations( "parsed" );
+
+    cleanupUnitCommandCards( units );
+
+    g_aliasClasses.build( g_aliases, nodes );
+    g_requirementGraph.build( abilities, requirements, nodes );
+    g_effectGraph.build( weapons, effects );
+    g_effectGraph.report();
+    g_abilityCommands.build( abilities, g_abilityMapping );
+    for ( auto& miss : g_abilityCommands.misses() )
+      printf_s( "[i] ability command %s has no stable id\r\n", miss.c_str() );
+
+    // The catalogs are only read from here on, so the tech trees are generated and the
+    // outputs written concurrently. Every output has a file of its own and the manifest is
+    // updated once they are all done, so nothing depends on the order they finish in.
+    TaskGraph emit;
+    vector<TaskGraph::TaskId> techTasks;
+    if ( std::any_of( stale.begin(), stale.end(), []( const OutputFile* output ) { return output->usesTechTree; } ) )
+      for ( auto& race : techMap )
+      {
+        auto tree = &race;
+        techTasks.push_back( emit.add( [&units, &abilities, tree] { generateTechTree( units, abilities, tree->first, tree->second ); } ) );
+      }
+    for ( auto output : stale )
+      emit.add( output->write, output->usesTechTree ? techTasks : vector<TaskGraph::TaskId>() );
+    emit.run();
 
-  dumpTechTreeText( "zerg", techMap[Race_Zerg] );
-  dumpTechTreeText( "protoss", techMap[Race_Protoss] );
-  dumpTechTreeText( "terran", techMap[Race_Terran] );
+    for ( auto output : stale )
+      manifest[output->name] = std::make_pair( output->key, fileSize( output->name ) );
+    if ( useSnapshots )
+      writeOutputManifest( manifestPath, manifest );
+
+    reportAllocations( "written" );
+  }
 
 #if defined( WIN32 )
   system( "pause" );
@@ -0,0 +1,708 @@
+#pragma once
+
+// Build order rollouts on top of gamedata.db.
+//
+// BuildModel compiles the tech tree of one race out of a Database: every item a unit can
+// build, morph into, merge into or research becomes an Action with its producer, time,
+// costs, supply and a requirement program over the model's own unit and upgrade numbers,
+// so that "has a unit of this alias class" is an AND of a few bitset words. A BuildState
+// is everything a rollout has, in one block of fixed size that is copied as is; run()
+// takes it from event to event, that is from one job finishing, larva spawning or the
+// next step becoming affordable to the next, and never allocates. The model is read-only
+// while it runs, so any number of threads can share one.
+//
+// The economy is an estimate: every worker that is not busy mines at a fixed rate, gas
+// buildings take workersPerGas of them, and there is no saturation, travel or rally time.
+
+#include "sc2gamedata.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sc2gamedata {
+
+  // BuildState has room for this much. BuildModel checks the tech tree against the first
+  // two and run() the build order against the third, and both throw when one is exceeded.
+  const uint32_t maxBuildUnits = 256; // unit types one race's tech tree mentions
+  const uint32_t maxBuildUpgrades = 64; // researches of one race, a bit each in one word
+  const uint32_t maxBuildJobs = 64; // things in production at once
+  const uint32_t maxBuildSpawners = 4;
+
+  // What gamedata.db does not say about the economy. Rates are per game second at Normal
+  // speed, which is what the tech tree times are in.
+  struct BuildEconomy {
+    double mineralsPerWorker;
+    double vespenePerWorker;
+    uint32_t workersPerGas;
+    float maxFood;
+    BuildEconomy():
+        mineralsPerWorker( 0.5 ), vespenePerWorker( 0.6 ), workersPerGas( 3 ), maxFood( 200.0f ) {}
+  };
+
+  enum BuildActionKind : uint8_t {
+    BuildAction_Unit, // TechEntry::builds
+    BuildAction_Morph,
+    BuildAction_Merge,
+    BuildAction_Research,
+  };
+
+  struct BuildJob {
+    double finish; // game seconds
+    uint32_t action;
+    uint32_t reserved;
+  };
+
+  // Everything a rollout has. Units and upgrades are numbered by the model; see
+  // BuildModel::unitIndex() and upgradeIndex().
+  struct BuildState {
+    double time;
+    double minerals;
+    double vespene;
+    float foodUsed;
+    float foodCap; // what the complete units provide, before BuildEconomy::maxFood
+    uint32_t step; // of the build order, the next one to start
+    uint32_t jobCount;
+    uint16_t count[maxBuildUnits]; // complete
+    uint16_t busy[maxBuildUnits]; // of count, producing something
+    uint16_t pending[maxBuildUnits]; // in production
+    uint64_t complete[maxBuildUnits / 64]; // a bit per unit with a count
+    uint64_t queued[maxBuildUnits / 64]; // a bit per unit with a count or in production
+    uint64_t upgrades; // researched
+    uint64_t upgradesQueued; // researched or being researched
+    double spawnProgress[maxBuildSpawners]; // towards the next spawn, 0 to 1
+    BuildJob jobs[maxBuildJobs];
+  };
+
+  struct BuildResult {
+    uint32_t steps; // of the build order that were started
+    double time; // when the last of them finished, or when the order got stuck
+    bool complete;
+  };
+
+  class BuildModel
+  {
+  public:
+    struct Op {
+      RequirementOpCode code;
+      uint8_t queued; // Op_UnitCount and Op_UpgradeCount: count what is in production too
+      uint16_t reserved;
+      int32_t arg; // Op_UnitCount: unit class of the model; Op_UpgradeCount: upgrade index
+    };
+
+    struct Action {
+      BuildActionKind kind;
+      uint8_t flags; // TechItemFlags
+      uint8_t producers; // how many producer units it takes, 2 for merges
+      uint8_t consumes; // the producers are gone when it starts, else they are busy until it finishes
+      uint8_t occupies; // they are busy until it finishes
+      uint8_t reserved;
+      uint16_t producer; // unit index
+      uint16_t target; // unit index, upgrade index for researches
+      uint16_t count; // units it makes
+      uint16_t reserved2;
+      double time;
+      double minerals;
+      double vespene;
+      float food; // supply it takes when it starts, less what consumed producers free
+      float foodCap; // supply it provides when it finishes, less what consumed producers did
+      Range program; // into code(); all the requirement trees of the TechItem, ANDed
+    };
+
+    BuildModel( const Database& db, Race race, const BuildEconomy& economy = BuildEconomy() ):
+        db_( db ), race_( race ), economy_( economy ), unitCount_( 0 ), upgradeCount_( 0 ), unitWords_( 0 )
+    {
+      auto entries = db.table<TechEntry>( Table_TechEntries );
+      for ( auto& entry : entries )
+      {
+        if ( entry.race != race )
+          continue;
+        addUnit( entry.unit );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.builds ) )
+          addUnit( item.target );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.morphs ) )
+          addUnit( item.target );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.merges ) )
+          addUnit( item.target );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.researches ) )
+          addUpgrade( item.target );
+      }
+      unitWords_ = ( unitCount_ + 63 ) / 64;
+
+      // workers are the units that build structures without being one, gas buildings are
+      // where vespene is harvested from
+      for ( auto& entry : entries )
+      {
+        if ( entry.race != race || !units_[unitIndex( entry.unit )] || ( units_[unitIndex( entry.unit )]->flags & Unit_Structure ) )
+          continue;
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.builds ) )
+        {
+          auto target = units_[unitIndex( item.target )];
+          if ( target && ( target->flags & Unit_Structure ) && std::find( workers_.begin(), workers_.end(), unitIndex( entry.unit ) ) == workers_.end() )
+            workers_.push_back( static_cast<uint16_t>( unitIndex( entry.unit ) ) );
+        }
+      }
+      for ( uint32_t u = 0; u < unitCount_; u++ )
+        if ( units_[u] && units_[u]->resource == Resource_Vespene && ( units_[u]->flags & Unit_ResourceHarvestable ) )
+          gasBuildings_.push_back( static_cast<uint16_t>( u ) );
+
+      std::vector<uint32_t> goals;
+      for ( auto& entry : entries )
+      {
+        if ( entry.race != race )
+          continue;
+        auto producer = unitIndex( entry.unit );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.builds ) )
+          addAction( BuildAction_Unit, producer, item, goals );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.morphs ) )
+          addAction( BuildAction_Morph, producer, item, goals );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.merges ) )
+          addAction( BuildAction_Merge, producer, item, goals );
+        for ( auto& item : db.range<TechItem>( Table_TechItems, entry.researches ) )
+          addAction( BuildAction_Research, producer, item, goals );
+      }
+
+      // the actions of every goal, in tech tree order
+      goalBegins_.assign( maxBuildUnits + maxBuildUpgrades + 1, 0 );
+      for ( auto goal : goals )
+        goalBegins_[goal + 1]++;
+      for ( size_t g = 0; g + 1 < goalBegins_.size(); g++ )
+        goalBegins_[g + 1] += goalBegins_[g];
+      goalActions_.resize( goals.size() );
+      std::vector<uint32_t> fill( goalBegins_.begin(), goalBegins_.end() - 1 );
+      for ( uint32_t a = 0; a < goals.size(); a++ )
+        goalActions_[fill[goals[a]]++] = a;
+    }
+
+    const Database& database() const { return db_; }
+    Race race() const { return race_; }
+    const BuildEconomy& economy() const { return economy_; }
+    uint32_t unitCount() const { return unitCount_; }
+    uint32_t upgradeCount() const { return upgradeCount_; }
+    const std::vector<Action>& actions() const { return actions_; }
+    const std::vector<Op>& code() const { return code_; }
+
+    // the model's number for a UnitTypeId or UpgradeId, none if this race's tech tree does not have it
+    uint32_t unitIndex( uint32_t id ) const { return ( id < unitIndices_.size() ? unitIndices_[id] : none ); }
+    uint32_t upgradeIndex( uint32_t id ) const { return ( id < upgradeIndices_.size() ? upgradeIndices_[id] : none ); }
+    uint32_t unitId( uint32_t index ) const { return unitIds_[index]; }
+    uint32_t upgradeId( uint32_t index ) const { return upgradeIds_[index]; }
+
+    // A build order is a list of goals: make a unit, or research an upgrade. none if nothing
+    // of this race makes the unit or researches the upgrade.
+    uint32_t unitGoal( uint32_t id ) const { return goal( unitIndex( id ) ); }
+    uint32_t researchGoal( uint32_t id ) const { return goal( upgradeIndex( id ) == none ? none : maxBuildUnits + upgradeIndex( id ) ); }
+
+    // The actions that reach a goal, eg. every unit that can train an SCV
+    const uint32_t* goalBegin( uint32_t goal ) const { return goalActions_.data() + goalBegins_[goal]; }
+    const uint32_t* goalEnd( uint32_t goal ) const { return goalActions_.data() + goalBegins_[goal + 1]; }
+
+    // Units that spawn another on their own, such as a Hatchery its Larva, one every period
+    // game seconds while there are fewer than maxPerSpawner of it for each spawner. The
+    // tech tree has no record of this, so it is up to the caller.
+    void addSpawner( uint32_t spawnerId, uint32_t spawnedId, double period, uint16_t maxPerSpawner )
+    {
+      auto spawner = unitIndex( spawnerId );
+      auto spawned = unitIndex( spawnedId );
+      if ( spawner == none || spawned == none || period <= 0.0 )
+        throw std::runtime_error( "spawner units are not in the tech tree" );
+      for ( auto& rule : spawners_ )
+        if ( rule.spawned == spawned )
+        {
+          rule.spawners.push_back( static_cast<uint16_t>( spawner ) );
+          return;
+        }
+      if ( spawners_.size() == maxBuildSpawners )
+        throw std::runtime_error( "too many spawners" );
+      Spawner rule;
+      rule.spawned = static_cast<uint16_t>( spawned );
+      rule.maxPerSpawner = maxPerSpawner;
+      rule.period = period;
+      rule.spawners.push_back( static_cast<uint16_t>( spawner ) );
+      spawners_.push_back( rule );
+    }
+
+    BuildState start( double minerals, double vespene ) const
+    {
+      BuildState state;
+      std::memset( &state, 0, sizeof( state ) );
+      state.minerals = minerals;
+      state.vespene = vespene;
+      return state;
+    }
+
+    // units a rollout starts with
+    void add( BuildState& state, uint32_t unitId, uint16_t n ) const
+    {
+      auto u = unitIndex( unitId );
+      if ( u == none )
+        throw std::runtime_error( "unit is not in the tech tree" );
+      state.count[u] += n;
+      state.foodUsed += consumes( u ) * n;
+      state.foodCap += provides( u ) * n;
+      update( state, u );
+    }
+
+    // whether all the requirements of an action hold
+    bool allowed( const BuildState& state, const Action& action ) const
+    {
+      int32_t stack[maxDepth];
+      uint32_t top = 0;
+      for ( auto op = code_.data() + action.program.first, end = op + action.program.count; op != end; ++op )
+      {
+        if ( op->code >= Op_And )
+          top -= op->arg;
+        const int32_t* args = stack + top;
+        int32_t result = 1;
+        switch ( op->code )
+        {
+          case Op_Value:
+            result = op->arg;
+            break;
+          case Op_UnitCount:
+          {
+            auto bits = ( op->queued ? state.queued : state.complete );
+            auto& mask = classes_[op->arg];
+            uint64_t any = 0;
+            for ( uint32_t w = 0; w < unitWords_; w++ )
+              any |= bits[w] & mask.bits[w];
+            result = ( any != 0 );
+            break;
+          }
+          case Op_UpgradeCount:
+            result = ( ( op->queued ? state.upgradesQueued : state.upgrades ) >> op->arg & 1 ) != 0;
+            break;
+          case Op_And:
+            for ( int32_t i = 0; i < op->arg; i++ )
+              result &= ( args[i] != 0 );
+            break;
+          case Op_Or:
+            result = 0;
+            for ( int32_t i = 0; i < op->arg; i++ )
+              result |= ( args[i] != 0 );
+            break;
+          case Op_Eq:
+            for ( int32_t i = 1; i < op->arg; i++ )
+              result &= ( args[i] == args[0] );
+            break;
+          case Op_Not:
+            for ( int32_t i = 0; i < op->arg; i++ )
+              result &= ( args[i] == 0 );
+            break;
+        }
+        stack[top++] = result;
+      }
+      return top == 0 || stack[0] != 0;
+    }
+
+    // Starts the steps of a build order one after the other, each as soon as a producer is
+    // free, its requirements hold and there is supply and money for it, and then lets what
+    // is in production finish. Stops when a step can never start, or could only start after
+    // timeLimit. Picks up from state.step, so a rollout can be run a piece at a time.
+    // Throws if the order has more than maxBuildJobs things in production at once.
+    BuildResult run( BuildState& state, const uint32_t* order, uint32_t length, double timeLimit ) const
+    {
+      const double never = std::numeric_limits<double>::infinity();
+      while ( state.step < length )
+      {
+        double wait = never;
+        if ( tryStart( state, order[state.step], wait ) )
+        {
+          state.step++;
+          continue;
+        }
+        wait = std::min( wait, nextEvent( state ) );
+        if ( wait == never || state.time + wait > timeLimit )
+          return BuildResult{ state.step, state.time, false };
+        advance( state, wait );
+      }
+      while ( state.jobCount > 0 )
+        advance( state, std::max( 0.0, nextJob( state ) - state.time ) );
+      return BuildResult{ state.step, state.time, true };
+    }
+
+  private:
+    static const uint32_t maxDepth = 32; // of a requirement program's stack
+
+    struct UnitClass {
+      uint64_t bits[maxBuildUnits / 64];
+    };
+
+    struct Spawner {
+      uint16_t spawned;
+      uint16_t maxPerSpawner;
+      double period;
+      std::vector<uint16_t> spawners;
+    };
+
+    uint32_t goal( uint32_t g ) const
+    {
+      return ( g != none && goalBegins_[g] != goalBegins_[g + 1] ? g : none );
+    }
+
+    void addUnit( uint32_t id )
+    {
+      if ( unitIndex( id ) != none )
+        return;
+      if ( unitCount_ == maxBuildUnits )
+        throw std::runtime_error( "gamedata.db: a tech tree has more than " + std::to_string( maxBuildUnits ) + " unit types (maxBuildUnits)" );
+      if ( id >= unitIndices_.size() )
+        unitIndices_.resize( id + 1, none );
+      unitIndices_[id] = unitCount_++;
+      unitIds_.push_back( id );
+      units_.push_back( db_.unit( id ) );
+    }
+
+    void addUpgrade( uint32_t id )
+    {
+      if ( upgradeIndex( id ) != none )
+        return;
+      if ( upgradeCount_ == maxBuildUpgrades )
+        throw std::runtime_error( "gamedata.db: a tech tree has more than " + std::to_string( maxBuildUpgrades ) + " researches (maxBuildUpgrades)" );
+      if ( id >= upgradeIndices_.size() )
+        upgradeIndices_.resize( id + 1, none );
+      upgradeIndices_[id] = upgradeCount_++;
+      upgradeIds_.push_back( id );
+    }
+
+    float consumes( uint32_t u ) const { return ( units_[u] && units_[u]->food < 0.0 ? static_cast<float>( -units_[u]->food ) : 0.0f ); }
+    float provides( uint32_t u ) const { return ( units_[u] && units_[u]->food > 0.0 ? static_cast<float>( units_[u]->food ) : 0.0f ); }
+
+    void addAction( BuildActionKind kind, uint32_t producer, const TechItem& item, std::vector<uint32_t>& goals )
+    {
+      Action action = {};
+      action.kind = kind;
+      action.flags = item.flags;
+      action.producer = static_cast<uint16_t>( producer );
+      action.time = item.time;
+      action.producers = ( kind == BuildAction_Merge ? 2 : 1 );
+      if ( kind == BuildAction_Research )
+      {
+        action.target = static_cast<uint16_t>( upgradeIndex( item.target ) );
+        action.minerals = static_cast<double>( item.minerals );
+        action.vespene = static_cast<double>( item.vespene );
+        action.occupies = 1;
+      }
+      else
+      {
+        auto target = unitIndex( item.target );
+        auto unit = units_[target];
+        action.target = static_cast<uint16_t>( target );
+        action.count = static_cast<uint16_t>( std::max<int32_t>( item.unitCount, 1 ) );
+        action.minerals = ( unit ? static_cast<double>( unit->mineralCost ) * action.count : 0.0 );
+        action.vespene = ( unit ? static_cast<double>( unit->vespeneCost ) * action.count : 0.0 );
+        // a morph or merge turns its producers into the target, as does a drone its building
+        // or larva its egg; protoss workers only start a warp-in, terran ones stay to build
+        action.consumes = ( kind != BuildAction_Unit || ( item.flags & ( Tech_FinishKillsWorker | Tech_FinishKillsSource ) ) );
+        bool warpIn = ( race_ == Race_Protoss && unit && ( unit->flags & Unit_Structure ) &&
+                        std::find( workers_.begin(), workers_.end(), producer ) != workers_.end() );
+        action.occupies = ( !action.consumes && !warpIn );
+        action.food = consumes( target ) * action.count - ( action.consumes ? consumes( producer ) * action.producers : 0.0f );
+        action.foodCap = provides( target ) * action.count - ( action.consumes ? provides( producer ) * action.producers : 0.0f );
+      }
+
+      action.program.first = static_cast<uint32_t>( code_.size() );
+      uint32_t depth = 0;
+      uint32_t roots = 0;
+      for ( auto req : db_.range<uint32_t>( Table_Indices, item.requirements ) )
+      {
+        compile( req, depth, roots++ );
+      }
+      if ( roots > 1 )
+        emit( Op_And, 0, static_cast<int32_t>( roots ) );
+      action.program.count = static_cast<uint32_t>( code_.size() ) - action.program.first;
+      if ( depth > maxDepth )
+        throw std::runtime_error( "gamedata.db: requirement too deep" );
+
+      goals.push_back( kind == BuildAction_Research ? maxBuildUnits + action.target : action.target );
+      actions_.push_back( action );
+    }
+
+    void emit( RequirementOpCode code, uint8_t queued, int32_t arg )
+    {
+      Op op = {};
+      op.code = code;
+      op.queued = queued;
+      op.arg = arg;
+      code_.push_back( op );
+    }
+
+    // postfix, as Table_RequirementCode, but over the model's numbers and keeping the
+    // state of every count: only QueuedOrBetter counts what is still in production.
+    // CompleteOnlyAtUnit, as on a tech lab, also wants the unit attached to the producer;
+    // that is not modelled, so it is taken as CompleteOnly.
+    void compile( uint32_t index, uint32_t& depth, uint32_t stack )
+    {
+      auto& req = db_.table<Requirement>( Table_Requirements )[index];
+      depth = std::max( depth, stack + 1 );
+      bool queued = ( std::strcmp( db_.text( req.state ), "QueuedOrBetter" ) == 0 );
+      switch ( req.type )
+      {
+        case Requirement_Value:
+          emit( Op_Value, 0, req.value );
+          break;
+        case Requirement_UnitCount:
+        {
+          UnitClass mask = {};
+          for ( auto id : db_.range<uint32_t>( Table_Indices, req.units ) )
+            if ( unitIndex( id ) != none )
+              mask.bits[unitIndex( id ) / 64] |= uint64_t( 1 ) << ( unitIndex( id ) % 64 );
+          uint64_t any = 0;
+          for ( auto word : mask.bits )
+            any |= word;
+          if ( !any )
+          {
+            emit( Op_Value, 0, 0 );
+            break;
+          }
+          uint32_t cls = 0;
+          while ( cls < classes_.size() && std::memcmp( &classes_[cls], &mask, sizeof( mask ) ) != 0 )
+            cls++;
+          if ( cls == classes_.size() )
+            classes_.push_back( mask );
+          emit( Op_UnitCount, queued, static_cast<int32_t>( cls ) );
+          break;
+        }
+        case Requirement_UpgradeCount:
+          if ( upgradeIndex( req.upgrade ) == none )
+            emit( Op_Value, 0, 0 );
+          else
+            emit( Op_UpgradeCount, queued, static_cast<int32_t>( upgradeIndex( req.upgrade ) ) );
+          break;
+        default:
+        {
+          uint32_t operands = 0;
+          for ( auto operand : db_.range<uint32_t>( Table_Indices, req.operands ) )
+            compile( operand, depth, stack + operands++ );
+          static const RequirementOpCode codes[] = { Op_Value, Op_And, Op_Or, Op_Eq, Op_Not };
+          emit( codes[req.type], 0, static_cast<int32_t>( operands ) );
+        }
+      }
+    }
+
+    void update( BuildState& state, uint32_t u ) const
+    {
+      uint64_t bit = uint64_t( 1 ) << ( u % 64 );
+      state.complete[u / 64] = ( state.count[u] > 0 ? state.complete[u / 64] | bit : state.complete[u / 64] & ~bit );
+      state.queued[u / 64] = ( state.count[u] + state.pending[u] > 0 ? state.queued[u / 64] | bit : state.queued[u / 64] & ~bit );
+    }
+
+    bool tryStart( BuildState& state, uint32_t goal, double& wait ) const
+    {
+      const double epsilon = 1e-9;
+      for ( auto a = goalBegin( goal ); a != goalEnd( goal ); ++a )
+      {
+        auto& action = actions_[*a];
+        if ( state.count[action.producer] - state.busy[action.producer] < action.producers )
+          continue;
+        if ( action.kind == BuildAction_Research && ( state.upgradesQueued >> action.target & 1 ) )
+          continue;
+        if ( action.food > 0.0f && state.foodUsed + action.food > std::min( state.foodCap, economy_.maxFood ) + 1e-3f )
+          continue;
+        if ( !allowed( state, action ) )
+          continue;
+        if ( state.minerals + epsilon < action.minerals || state.vespene + epsilon < action.vespene )
+        {
+          double mineralRate, vespeneRate;
+          rates( state, mineralRate, vespeneRate );
+          double need = 0.0;
+          if ( state.minerals < action.minerals )
+            need = ( mineralRate > 0.0 ? ( action.minerals - state.minerals ) / mineralRate : std::numeric_limits<double>::infinity() );
+          if ( state.vespene < action.vespene )
+            need = std::max( need, vespeneRate > 0.0 ? ( action.vespene - state.vespene ) / vespeneRate : std::numeric_limits<double>::infinity() );
+          wait = std::min( wait, need );
+          continue;
+        }
+
+        if ( state.jobCount == maxBuildJobs )
+          throw std::runtime_error( "build order has more than " + std::to_string( maxBuildJobs ) + " things in production at once (maxBuildJobs)" );
+        state.minerals = std::max( 0.0, state.minerals - action.minerals );
+        state.vespene = std::max( 0.0, state.vespene - action.vespene );
+        state.foodUsed += action.food;
+        if ( action.consumes )
+        {
+          state.count[action.producer] -= action.producers;
+          update( state, action.producer );
+        }
+        else if ( action.occupies )
+          state.busy[action.producer] += action.producers;
+        if ( action.kind == BuildAction_Research )
+          state.upgradesQueued |= uint64_t( 1 ) << action.target;
+        else
+        {
+          state.pending[action.target] += action.count;
+          update( state, action.target );
+        }
+        auto& job = state.jobs[state.jobCount++];
+        job.finish = state.time + action.time;
+        job.action = *a;
+        return true;
+      }
+      return false;
+    }
+
+    void rates( const BuildState& state, double& minerals, double& vespene ) const
+    {
+      uint32_t workers = 0;
+      for ( auto w : workers_ )
+        workers += state.count[w] - state.busy[w];
+      uint32_t gas = 0;
+      for ( auto g : gasBuildings_ )
+        gas += state.count[g];
+      uint32_t onGas = std::min( workers, gas * economy_.workersPerGas );
+      minerals = ( workers - onGas ) * economy_.mineralsPerWorker;
+      vespene = onGas * economy_.vespenePerWorker;
+    }
+
+    double nextJob( const BuildState& state ) const
+    {
+      double next = std::numeric_limits<double>::infinity();
+      for ( uint32_t j = 0; j < state.jobCount; j++ )
+        next = std::min( next, state.jobs[j].finish );
+      return next;
+    }
+
+    // until the next job finishes or the next unit spawns
+    double nextEvent( const BuildState& state ) const
+    {
+      double next = std::max( 0.0, nextJob( state ) - state.time );
+      for ( size_t s = 0; s < spawners_.size(); s++ )
+      {
+        auto& rule = spawners_[s];
+        uint32_t spawners = 0;
+        for ( auto u : rule.spawners )
+          spawners += state.count[u];
+        if ( spawners > 0 && state.count[rule.spawned] < rule.maxPerSpawner * spawners )
+          next = std::min( next, ( 1.0 - state.spawnProgress[s] ) * rule.period / spawners );
+      }
+      return next;
+    }
+
+    void advance( BuildState& state, double dt ) const
+    {
+      double mineralRate, vespeneRate;
+      rates( state, mineralRate, vespeneRate );
+      state.minerals += mineralRate * dt;
+      state.vespene += vespeneRate * dt;
+      for ( size_t s = 0; s < spawners_.size(); s++ )
+      {
+        auto& rule = spawners_[s];
+        uint32_t spawners = 0;
+        for ( auto u : rule.spawners )
+          spawners += state.count[u];
+        uint32_t cap = rule.maxPerSpawner * spawners;
+        if ( state.count[rule.spawned] >= cap )
+        {
+          state.spawnProgress[s] = 0.0;
+          continue;
+        }
+        state.spawnProgress[s] += dt * spawners / rule.period;
+        while ( state.spawnProgress[s] >= 1.0 - 1e-9 && state.count[rule.spawned] < cap )
+        {
+          state.count[rule.spawned]++;
+          state.spawnProgress[s] = std::max( 0.0, state.spawnProgress[s] - 1.0 );
+        }
+        update( state, rule.spawned );
+        if ( state.count[rule.spawned] >= cap )
+          state.spawnProgress[s] = 0.0;
+      }
+      state.time += dt;
+
+      for ( uint32_t j = 0; j < state.jobCount; )
+      {
+        if ( state.jobs[j].finish > state.time + 1e-9 )
+        {
+          j++;
+          continue;
+        }
+        finish( state, actions_[state.jobs[j].action] );
+        state.jobs[j] = state.jobs[--state.jobCount];
+      }
+    }
+
+    void finish( BuildState& state, const Action& action ) const
+    {
+      if ( action.occupies )
+        state.busy[action.producer] -= action.producers;
+      if ( action.kind == BuildAction_Research )
+      {
+        state.upgrades |= uint64_t( 1 ) << action.target;
+        return;
+      }
+      state.pending[action.target] -= action.count;
+      state.count[action.target] += action.count;
+      state.foodCap += action.foodCap;
+      update( state, action.target );
+    }
+
+    const Database& db_;
+    Race race_;
+    BuildEconomy economy_;
+    uint32_t unitCount_;
+    uint32_t upgradeCount_;
+    uint32_t unitWords_; // of the unit bitsets, that the tech tree uses
+    std::vector<uint32_t> unitIndices_; // by UnitTypeId
+    std::vector<uint32_t> upgradeIndices_; // by UpgradeId
+    std::vector<uint32_t> unitIds_;
+    std::vector<uint32_t> upgradeIds_;
+    std::vector<const Unit*> units_; // nullptr for ids gamedata.db has no record of
+    std::vector<uint16_t> workers_;
+    std::vector<uint16_t> gasBuildings_;
+    std::vector<Action> actions_;
+    std::vector<Op> code_;
+    std::vector<UnitClass> classes_;
+    std::vector<Spawner> spawners_;
+    std::vector<uint32_t> goalBegins_; // by goal, into goalActions_
+    std::vector<uint32_t> goalActions_;
+  };
+
+  // Runs every build order from the same start, spread over threads (all cores if 0);
+  // results are in order. Rethrows the first error a rollout throws.
+  inline std::vector<BuildResult> simulate( const BuildModel& model, const BuildState& start, const std::vector<std::vector<uint32_t>>& orders,
+    double timeLimit, unsigned threads = 0 )
+  {
+    std::vector<BuildResult> results( orders.size() );
+    if ( threads == 0 )
+      threads = std::max( 1u, std::thread::hardware_concurrency() );
+    std::atomic<size_t> next( 0 );
+    std::mutex errorLock;
+    std::exception_ptr error;
+    auto worker = [&]() {
+      BuildState state;
+      const size_t batch = 64;
+      try
+      {
+        for ( size_t first = next.fetch_add( batch ); first < orders.size(); first = next.fetch_add( batch ) )
+          for ( size_t i = first; i < std::min( first + batch, orders.size() ); i++ )
+          {
+            state = start;
+            results[i] = model.run( state, orders[i].data(), static_cast<uint32_t>( orders[i].size() ), timeLimit );
+          }
+      }
+      catch ( ... )
+      {
+        next = orders.size();
+        std::lock_guard<std::mutex> lock( errorLock );
+        if ( !error )
+          error = std::current_exception();
+      }
+    };
+    std::vector<std::thread> pool;
+    for ( unsigned t = 1; t < threads; t++ )
+      pool.emplace_back( worker );
+    worker();
+    for ( auto& thread : pool )
+      thread.join();
+    if ( error )
+      std::rethrow_exception( error );
+    return results;
+  }
+
+}
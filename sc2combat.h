@@ -0,0 +1,430 @@
+#pragma once
+
+// Army against army combat estimates on top of gamedata.db.
+//
+// CombatModel gathers what a fight needs from a Database once: the life, shields,
+// speed and size of every unit, the range, period, damage point and splash of every
+// attack, and the damage matrix. CombatSimulator then plays out a CombatScenario in steps
+// of a game loop (1/16 game second) with every unit of the fight in one set of flat
+// arrays: each unit goes for the nearest enemy it can hurt, walks into range, winds up
+// for the damage point and hits, and shields come back after shieldRegenDelay. It is an
+// estimate: there is no pathing, collision, abilities or upgrades. simulate() runs many
+// scenarios, which are independent of one another, on all cores.
+
+#include "sc2gamedata.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace sc2gamedata {
+
+  struct CombatUnit {
+    uint32_t unit; // Table_Units
+    uint8_t side; // 0 or 1
+    float x;
+    float y;
+  };
+
+  struct CombatScenario {
+    std::vector<CombatUnit> units;
+    float timeLimit; // game seconds
+    CombatScenario():
+        timeLimit( 60.0f ) {}
+  };
+
+  struct CombatResult {
+    int winner; // the side left standing, -1 if both or neither are
+    float time; // game seconds until it was decided or timed out
+    uint32_t survivors[2];
+    float health[2]; // life and shields left per side
+  };
+
+  class CombatModel
+  {
+  public:
+    struct Splash {
+      float fraction;
+      float radius;
+    };
+
+    struct AttackInfo {
+      float range;
+      float period;
+      float damagePoint;
+      uint32_t firstSplash; // into splash(), by radius
+      uint32_t splashCount;
+    };
+
+    explicit CombatModel( const Database& db ):
+        db_( db )
+    {
+      auto units = db.units();
+      for ( auto& unit : units )
+      {
+        life_.push_back( static_cast<float>( unit.lifeMax ) );
+        shields_.push_back( static_cast<float>( unit.shieldsMax ) );
+        speed_.push_back( static_cast<float>( unit.speed ) );
+        radius_.push_back( static_cast<float>( unit.radius ) );
+        shieldRegenDelay_.push_back( static_cast<float>( unit.shieldRegenDelay ) );
+        shieldRegenRate_.push_back( static_cast<float>( unit.shieldRegenRate ) );
+      }
+
+      auto weapons = db.table<Weapon>( Table_Weapons );
+      auto attacks = db.attacks();
+      attackBegins_.assign( units.size() + 1, 0 );
+      for ( auto& attack : attacks )
+        attackBegins_[attack.unit + 1]++;
+      for ( size_t i = 0; i < units.size(); i++ )
+        attackBegins_[i + 1] += attackBegins_[i];
+      attacksOf_.resize( attacks.size() );
+      std::vector<uint32_t> fill( attackBegins_.begin(), attackBegins_.end() - 1 );
+      for ( uint32_t a = 0; a < attacks.size(); a++ )
+      {
+        auto& weapon = weapons[attacks[a].weapon];
+        AttackInfo info;
+        info.range = static_cast<float>( weapon.range );
+        info.period = static_cast<float>( weapon.period );
+        info.damagePoint = static_cast<float>( weapon.damagePoint );
+        info.firstSplash = static_cast<uint32_t>( splash_.size() );
+        if ( weapon.effect != none )
+          addSplash( weapon.effect );
+        info.splashCount = static_cast<uint32_t>( splash_.size() ) - info.firstSplash;
+        std::sort( splash_.begin() + info.firstSplash, splash_.end(), []( const Splash& x, const Splash& y ) { return x.radius < y.radius; } );
+        attacks_.push_back( info );
+        attacksOf_[fill[attacks[a].unit]++] = a;
+      }
+    }
+
+    const Database& database() const { return db_; }
+    uint32_t unitCount() const { return static_cast<uint32_t>( life_.size() ); }
+
+    float life( uint32_t unit ) const { return life_[unit]; }
+    float shields( uint32_t unit ) const { return shields_[unit]; }
+    float speed( uint32_t unit ) const { return speed_[unit]; }
+    float radius( uint32_t unit ) const { return radius_[unit]; }
+    float shieldRegenDelay( uint32_t unit ) const { return shieldRegenDelay_[unit]; }
+    float shieldRegenRate( uint32_t unit ) const { return shieldRegenRate_[unit]; }
+
+    const AttackInfo& attack( uint32_t attack ) const { return attacks_[attack]; }
+    const Splash* splash( const AttackInfo& attack ) const { return splash_.data() + attack.firstSplash; }
+
+    // the indices of db.attacks() that belong to a unit
+    const uint32_t* attacksBegin( uint32_t unit ) const { return attacksOf_.data() + attackBegins_[unit]; }
+    const uint32_t* attacksEnd( uint32_t unit ) const { return attacksOf_.data() + attackBegins_[unit + 1]; }
+
+    // the attack a unit kills an unhurt target soonest with, none if it cannot hurt it;
+    // the first hit lands after the damage point and each one after that a period later
+    uint32_t bestAttack( uint32_t unit, uint32_t target ) const
+    {
+      uint32_t best = none;
+      float bestTime = 0.0f;
+      for ( auto a = attacksBegin( unit ); a != attacksEnd( unit ); ++a )
+      {
+        auto& dmg = db_.damage( *a, target );
+        if ( dmg.lifePerHit <= 0.0f || dmg.hitsToKill == 0 )
+          continue;
+        auto& info = attacks_[*a];
+        float time = info.damagePoint + static_cast<float>( dmg.hitsToKill - 1 ) * info.period;
+        if ( best == none || time < bestTime )
+        {
+          best = *a;
+          bestTime = time;
+        }
+      }
+      return best;
+    }
+
+  private:
+    // the splash of the damage effects a weapon's effect leads to; Database has checked
+    // that effects only link to earlier ones, so this ends
+    void addSplash( uint32_t effect )
+    {
+      auto effects = db_.table<Effect>( Table_Effects );
+      if ( effect >= effects.size() )
+        return;
+      auto& fx = effects[effect];
+      if ( fx.type == Effect_Damage )
+        for ( auto& area : db_.range<SplashArea>( Table_SplashAreas, fx.splash ) )
+          if ( area.radius > 0.0 && area.fraction > 0.0 )
+            splash_.push_back( Splash{ static_cast<float>( area.fraction ), static_cast<float>( area.radius ) } );
+      if ( fx.impact != none )
+        addSplash( fx.impact );
+      for ( auto child : db_.range<uint32_t>( Table_Indices, fx.children ) )
+        addSplash( child );
+    }
+
+    const Database& db_;
+    std::vector<float> life_;
+    std::vector<float> shields_;
+    std::vector<float> speed_;
+    std::vector<float> radius_;
+    std::vector<float> shieldRegenDelay_;
+    std::vector<float> shieldRegenRate_;
+    std::vector<AttackInfo> attacks_;
+    std::vector<Splash> splash_;
+    std::vector<uint32_t> attackBegins_; // by unit, into attacksOf_
+    std::vector<uint32_t> attacksOf_;
+  };
+
+  // Plays out one scenario at a time; keeps its arrays between runs, so one simulator per
+  // thread does not allocate once it has seen its largest fight.
+  class CombatSimulator
+  {
+  public:
+    explicit CombatSimulator( const CombatModel& model ):
+        model_( model ) {}
+
+    CombatResult run( const CombatScenario& scenario )
+    {
+      const float step = 1.0f / 16.0f;
+      load( scenario );
+      CombatResult result = {};
+      result.winner = -1;
+      float time = 0.0f;
+      bool engaged = true;
+      while ( engaged && time < scenario.timeLimit && alive_[0] > 0 && alive_[1] > 0 )
+      {
+        // a fight where nobody left can get at anybody left is over
+        engaged = false;
+        for ( uint32_t i = 0; i < count_; i++ )
+          if ( acting_[i] )
+            engaged = act( i, time, step ) || engaged;
+        // units killed during a step still act in it and everybody moves at the end of it, so
+        // the order of the arrays favours neither side
+        for ( uint32_t i = 0; i < count_; i++ )
+        {
+          acting_[i] = ( life_[i] > 0.0f );
+          x_[i] = nextX_[i];
+          y_[i] = nextY_[i];
+        }
+        time += step;
+      }
+
+      result.time = time;
+      for ( uint32_t i = 0; i < count_; i++ )
+        if ( life_[i] > 0.0f )
+        {
+          result.survivors[side_[i]]++;
+          result.health[side_[i]] += life_[i] + shields_[i];
+        }
+      if ( ( alive_[0] > 0 ) != ( alive_[1] > 0 ) )
+        result.winner = ( alive_[0] > 0 ? 0 : 1 );
+      return result;
+    }
+
+  private:
+    void load( const CombatScenario& scenario )
+    {
+      count_ = static_cast<uint32_t>( scenario.units.size() );
+      type_.resize( count_ );
+      side_.resize( count_ );
+      x_.resize( count_ );
+      y_.resize( count_ );
+      nextX_.resize( count_ );
+      nextY_.resize( count_ );
+      life_.resize( count_ );
+      shields_.resize( count_ );
+      cooldown_.resize( count_ );
+      windup_.resize( count_ );
+      lastHit_.resize( count_ );
+      acting_.resize( count_ );
+      target_.resize( count_ );
+      attack_.resize( count_ );
+      alive_[0] = alive_[1] = 0;
+      for ( uint32_t i = 0; i < count_; i++ )
+      {
+        auto& unit = scenario.units[i];
+        type_[i] = unit.unit;
+        side_[i] = static_cast<uint8_t>( unit.side & 1 );
+        x_[i] = unit.x;
+        y_[i] = unit.y;
+        nextX_[i] = unit.x;
+        nextY_[i] = unit.y;
+        life_[i] = model_.life( unit.unit );
+        shields_[i] = model_.shields( unit.unit );
+        cooldown_[i] = 0.0f;
+        windup_[i] = -1.0f;
+        lastHit_[i] = -1e9f;
+        acting_[i] = 1;
+        target_[i] = none;
+        attack_[i] = none;
+        alive_[side_[i]]++;
+      }
+    }
+
+    float distance( uint32_t i, uint32_t j ) const
+    {
+      float dx = x_[j] - x_[i];
+      float dy = y_[j] - y_[i];
+      return std::sqrt( dx * dx + dy * dy ) - model_.radius( type_[i] ) - model_.radius( type_[j] );
+    }
+
+    // false if the unit has nobody it can attack or walk up to
+    bool act( uint32_t i, float time, float step )
+    {
+      auto type = type_[i];
+      if ( shields_[i] < model_.shields( type ) && time - lastHit_[i] >= model_.shieldRegenDelay( type ) )
+        shields_[i] = std::min( model_.shields( type ), shields_[i] + model_.shieldRegenRate( type ) * step );
+      cooldown_[i] -= step;
+
+      if ( target_[i] == none || life_[target_[i]] <= 0.0f )
+      {
+        windup_[i] = -1.0f;
+        pickTarget( i );
+        if ( target_[i] == none )
+          return false;
+      }
+      auto target = target_[i];
+      auto& attack = model_.attack( attack_[i] );
+
+      if ( windup_[i] >= 0.0f )
+      {
+        windup_[i] -= step;
+        if ( windup_[i] < 0.0f )
+          hit( i, target, time );
+        return true;
+      }
+
+      float dist = distance( i, target );
+      // a little slack, or a unit walking up to exactly its range may never quite get there
+      if ( dist > attack.range + 1.0f / 64.0f )
+      {
+        if ( model_.speed( type ) <= 0.0f )
+          return false;
+        float move = std::min( model_.speed( type ) * step, dist - attack.range );
+        float dx = x_[target] - x_[i];
+        float dy = y_[target] - y_[i];
+        float length = std::sqrt( dx * dx + dy * dy );
+        if ( length > 0.0f )
+        {
+          nextX_[i] = x_[i] + dx / length * move;
+          nextY_[i] = y_[i] + dy / length * move;
+        }
+      }
+      else if ( cooldown_[i] <= 0.0f )
+      {
+        cooldown_[i] = std::max( attack.period, step );
+        windup_[i] = attack.damagePoint;
+        if ( windup_[i] <= 0.0f )
+        {
+          windup_[i] = -1.0f;
+          hit( i, target, time );
+        }
+      }
+      return true;
+    }
+
+    // the nearest enemy this unit can hurt
+    void pickTarget( uint32_t i )
+    {
+      target_[i] = none;
+      attack_[i] = none;
+      float nearest = 0.0f;
+      for ( uint32_t j = 0; j < count_; j++ )
+      {
+        if ( side_[j] == side_[i] || life_[j] <= 0.0f )
+          continue;
+        auto attack = model_.bestAttack( type_[i], type_[j] );
+        if ( attack == none )
+          continue;
+        float dist = distance( i, j );
+        if ( target_[i] == none || dist < nearest )
+        {
+          target_[i] = j;
+          attack_[i] = attack;
+          nearest = dist;
+        }
+      }
+    }
+
+    void hit( uint32_t i, uint32_t target, float time )
+    {
+      if ( life_[target] <= 0.0f )
+        return;
+      auto& attack = model_.attack( attack_[i] );
+      damage( target, model_.database().damage( attack_[i], type_[target] ), 1.0f, time );
+      if ( attack.splashCount == 0 )
+        return;
+      auto splash = model_.splash( attack );
+      for ( uint32_t j = 0; j < count_; j++ )
+      {
+        if ( j == target || side_[j] == side_[i] || life_[j] <= 0.0f )
+          continue;
+        float dx = x_[j] - x_[target];
+        float dy = y_[j] - y_[target];
+        float dist = std::sqrt( dx * dx + dy * dy ) - model_.radius( type_[j] );
+        for ( uint32_t s = 0; s < attack.splashCount; s++ )
+          if ( dist <= splash[s].radius )
+          {
+            damage( j, model_.database().damage( attack_[i], type_[j] ), splash[s].fraction, time );
+            break;
+          }
+      }
+    }
+
+    // shields first; the part of the hit they do not soak goes to life, with the armor the
+    // damage matrix already took off lifePerHit
+    void damage( uint32_t j, const Damage& dmg, float fraction, float time )
+    {
+      if ( dmg.lifePerHit <= 0.0f )
+        return;
+      lastHit_[j] = time;
+      if ( shields_[j] > 0.0f && dmg.shieldsPerHit > 0.0f )
+      {
+        float soaked = std::min( shields_[j], dmg.shieldsPerHit * fraction );
+        shields_[j] -= soaked;
+        fraction -= soaked / dmg.shieldsPerHit;
+        if ( fraction <= 0.0f )
+          return;
+      }
+      life_[j] -= dmg.lifePerHit * fraction;
+      if ( life_[j] <= 0.0f )
+        alive_[side_[j]]--;
+    }
+
+    const CombatModel& model_;
+    uint32_t count_;
+    uint32_t alive_[2];
+    std::vector<uint32_t> type_;
+    std::vector<uint8_t> side_;
+    std::vector<float> x_;
+    std::vector<float> y_;
+    std::vector<float> nextX_; // where the unit is at the end of the step
+    std::vector<float> nextY_;
+    std::vector<float> life_;
+    std::vector<float> shields_;
+    std::vector<float> cooldown_;
+    std::vector<float> windup_; // until the damage point of the attack under way, -1 if none
+    std::vector<float> lastHit_;
+    std::vector<uint8_t> acting_;
+    std::vector<uint32_t> target_;
+    std::vector<uint32_t> attack_;
+  };
+
+  // Runs every scenario, spread over threads (all cores if 0); results are in scenario order.
+  inline std::vector<CombatResult> simulate( const CombatModel& model, const std::vector<CombatScenario>& scenarios, unsigned threads = 0 )
+  {
+    std::vector<CombatResult> results( scenarios.size() );
+    if ( threads == 0 )
+      threads = std::max( 1u, std::thread::hardware_concurrency() );
+    std::atomic<size_t> next( 0 );
+    auto worker = [&]() {
+      CombatSimulator sim( model );
+      const size_t batch = 16;
+      for ( size_t first = next.fetch_add( batch ); first < scenarios.size(); first = next.fetch_add( batch ) )
+        for ( size_t i = first; i < std::min( first + batch, scenarios.size() ); i++ )
+          results[i] = sim.run( scenarios[i] );
+    };
+    std::vector<std::thread> pool;
+    for ( unsigned t = 1; t < threads; t++ )
+      pool.emplace_back( worker );
+    worker();
+    for ( auto& thread : pool )
+      thread.join();
+    return results;
+  }
+
+}
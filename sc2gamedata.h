@@ -0,0 +1,880 @@
+#pragma once
+
+// Layout of gamedata.db, the binary counterpart of the JSON outputs.
+//
+// The file starts with a Header whose directory gives the offset, record count and record
+// size of every table. Each table is an array of the fixed-size records below, aligned to
+// 8 bytes. Records never hold pointers: text is a String into the Strings table, and a
+// list is a Range of consecutive records in another table. That way the file can be
+// mapped and used in place. All values are little-endian.
+//
+// The records carry what units.json, weapons.json, abilities.json, upgrades.json and
+// techtree.json do, plus the tech alias classes the unit count requirements refer to.
+// Tables keyed by name in the JSON are sorted by name here. Units are sorted by id, and
+// tech entries by race and then id. The id tables map each stable id from stableid.json
+// to the record that carries it, so lookups by id are plain indexing.
+//
+// Database below reads the file in place; MappedDatabase maps it from disk first.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined( _WIN32 )
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sc2gamedata {
+
+  const uint32_t dbMagic = 0x42444753; // "SGDB"
+  const uint32_t dbVersion = 6;
+
+  const uint32_t none = 0xFFFFFFFF; // a missing record index
+
+  enum TableId : uint32_t {
+    Table_Strings, // char; every string is followed by a NUL
+    Table_StringRefs, // String
+    Table_Indices, // uint32_t; record indices or stable ids, depending on the list
+    Table_Values, // double
+    Table_Points, // Point
+    Table_Polygons, // Polygon
+    Table_Footprints, // Footprint
+    Table_Refs, // Ref
+    Table_Units, // Unit
+    Table_AttributeBonuses, // AttributeBonus
+    Table_SplashAreas, // SplashArea
+    Table_Effects, // Effect
+    Table_Weapons, // Weapon
+    Table_Requirements, // Requirement
+    Table_AbilityCommands, // AbilityCommand
+    Table_Abilities, // Ability
+    Table_UpgradeEffects, // UpgradeEffect
+    Table_Upgrades, // Upgrade
+    Table_TechItems, // TechItem
+    Table_TechEntries, // TechEntry
+    Table_UnitIds, // uint32_t per UnitTypeId; index into Table_Units, or none
+    Table_AbilityIds, // uint32_t per AbilityId; index into Table_AbilityCommands, or none
+    Table_UpgradeIds, // uint32_t per UpgradeId; index into Table_Upgrades, or none
+    Table_AliasClasses, // AliasClass
+    Table_UnitSets, // uint64_t; bitsets over UnitTypeIds
+    Table_RequirementCode, // RequirementOp
+    Table_Attacks, // Attack
+    Table_Damage, // Damage; a row of one per Table_Units record for every Table_Attacks record
+    Table_Count
+  };
+
+  struct TableInfo {
+    uint64_t offset; // from the start of the file
+    uint32_t count;
+    uint32_t recordSize;
+  };
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tableCount;
+    uint32_t reserved;
+    TableInfo tables[Table_Count];
+  };
+
+  struct String {
+    uint32_t offset; // into Table_Strings
+    uint32_t length;
+  };
+
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  enum Race : uint8_t {
+    Race_Neutral,
+    Race_Terran,
+    Race_Protoss,
+    Race_Zerg,
+  };
+
+  enum ResourceType : uint8_t {
+    Resource_None,
+    Resource_Minerals,
+    Resource_Vespene,
+    Resource_Terrazine,
+    Resource_Custom,
+  };
+
+  // bits of Weapon::filterRequires/filterExcludes and Effect::searchRequires/searchExcludes
+  enum Filter : uint32_t {
+    Filter_Ground = 1 << 0,
+    Filter_Structure = 1 << 1,
+    Filter_Self = 1 << 2,
+    Filter_Player = 1 << 3,
+    Filter_Ally = 1 << 4,
+    Filter_Air = 1 << 5,
+    Filter_Stasis = 1 << 6,
+  };
+
+  struct Point {
+    int32_t x;
+    int32_t y;
+  };
+
+  struct Polygon {
+    Range points; // Table_Points
+  };
+
+  struct Footprint {
+    String name;
+    double radius;
+    Range unpathable; // Table_Polygons
+    Range building; // Table_Polygons
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+    String data; // w * h cells row by row: 'x' placement, 'o' creep, 'n' near resources, '.'
+  };
+
+  // A name together with the record it refers to, for links that may point outside the file.
+  struct Ref {
+    String name;
+    uint32_t index; // none when the name has no record
+    uint32_t reserved;
+  };
+
+  enum UnitFlags : uint16_t {
+    Unit_Light = 1 << 0,
+    Unit_Biological = 1 << 1,
+    Unit_Mechanical = 1 << 2,
+    Unit_Armored = 1 << 3,
+    Unit_Structure = 1 << 4,
+    Unit_Psionic = 1 << 5,
+    Unit_Massive = 1 << 6,
+    Unit_Invulnerable = 1 << 7,
+    Unit_ResourceHarvestable = 1 << 8, // as opposed to raw, eg. a geyser without an extractor
+  };
+
+  struct Unit {
+    uint32_t id; // UnitTypeId
+    Race race;
+    ResourceType resource;
+    uint16_t flags; // UnitFlags
+    uint32_t aiEvaluateAs; // UnitTypeId, 0 if none
+    uint32_t glossaryAlias; // UnitTypeId, 0 if none
+    uint32_t footprint; // Table_Footprints, none if the unit has no footprint
+    uint32_t reserved;
+    String name;
+    String mover;
+    String aiEvaluateAsName; // empty when it is the unit itself
+    String glossaryAliasName; // empty when it is the unit itself
+    Range collides; // Table_StringRefs
+    Range techAliases; // Table_StringRefs
+    Range planes; // Table_StringRefs
+    Range weapons; // Table_Refs into Table_Weapons
+    Range abilityCommands; // Table_StringRefs, "Ability,Command"
+    Range aliasClasses; // Table_Indices into Table_AliasClasses, the classes the unit counts towards
+    double food;
+    double speed;
+    double acceleration;
+    double speedMultiplierCreep;
+    double radius;
+    double sight;
+    double lifeStart;
+    double lifeMax;
+    double lifeRegenRate;
+    double shieldsStart;
+    double shieldsMax;
+    double shieldRegenDelay;
+    double shieldRegenRate;
+    double energyStart;
+    double energyMax;
+    double energyRegenRate;
+    double turningRate;
+    double stationaryTurningRate;
+    double lateralAcceleration;
+    double attackTargetPriority;
+    double aiEvalFactor;
+    int64_t mineralCost;
+    int64_t vespeneCost;
+    int64_t lifeArmor;
+    int64_t cargoSize;
+    int64_t scoreMake;
+    int64_t scoreKill;
+  };
+
+  struct AttributeBonus {
+    String attribute;
+    double value;
+  };
+
+  struct SplashArea {
+    double fraction;
+    double radius;
+  };
+
+  enum EffectType : uint8_t {
+    Effect_Unknown,
+    Effect_Missile,
+    Effect_Damage,
+    Effect_Suicide, // damage that kills its source
+    Effect_CreateUnit,
+    Effect_CreateHealer,
+    Effect_Set,
+    Effect_Persistent,
+    Effect_EnumArea,
+  };
+
+  // An effect as resolved for the weapon that uses it. Damage fields are only set for Effect_Damage.
+  // The effects are ordered so that impact and children always point at an earlier record;
+  // a link that would close a cycle is left out, as it is in weapons.json.
+  struct Effect {
+    EffectType type;
+    uint8_t reserved[3];
+    uint32_t impact; // Table_Effects, missiles only; none if unresolved
+    String name;
+    String damageKind;
+    Range children; // Table_Indices into Table_Effects; the set or persistent effects
+    Range persistentPeriods; // Table_Values
+    Range attributeBonuses; // Table_AttributeBonuses
+    Range splash; // Table_SplashAreas
+    uint32_t searchRequires; // Filter bits
+    uint32_t searchExcludes; // Filter bits
+    uint64_t persistentCount;
+    double damageAmount;
+    double damageArmorReduction;
+  };
+
+  enum WeaponFlags : uint8_t {
+    Weapon_Melee = 1 << 0,
+    Weapon_Hidden = 1 << 1,
+    Weapon_Disabled = 1 << 2,
+  };
+
+  struct Weapon {
+    String name;
+    uint32_t effect; // Table_Effects, none if unresolved
+    uint8_t flags; // WeaponFlags
+    uint8_t reserved[3];
+    uint32_t filterRequires; // Filter bits
+    uint32_t filterExcludes; // Filter bits
+    double range;
+    double period;
+    double arc;
+    double damagePoint;
+    double backSwing;
+    double rangeSlop;
+    double arcSlop;
+    double minScanRange;
+    double randomDelayMin;
+    double randomDelayMax;
+  };
+
+  enum RequirementType : uint8_t {
+    Requirement_Value,
+    Requirement_And,
+    Requirement_Or,
+    Requirement_Eq,
+    Requirement_Not,
+    Requirement_UnitCount,
+    Requirement_UpgradeCount,
+  };
+
+  // One node of a requirement tree. Nodes are shared by every tree that uses them.
+  struct Requirement {
+    RequirementType type;
+    uint8_t reserved[3];
+    int32_t value; // Requirement_Value
+    Range operands; // Table_Indices into Table_Requirements
+    Range unitNames; // Table_StringRefs, the unit and its tech aliases
+    Range units; // Table_Indices, the UnitTypeIds of unitNames
+    String upgradeName;
+    String state;
+    uint32_t upgrade; // UpgradeId
+    uint32_t aliasClass; // Table_AliasClasses, the same units as a class; none unless Requirement_UnitCount
+    Range program; // Table_RequirementCode, the whole tree in postfix
+  };
+
+  enum RequirementOpCode : uint8_t {
+    Op_Value, // push arg
+    Op_UnitCount, // push whether the player has a unit of AliasClass arg
+    Op_UpgradeCount, // push whether the player has UpgradeId arg
+    Op_And, // pop arg values, push whether none is 0
+    Op_Or, // pop arg values, push whether any is not 0
+    Op_Eq, // pop arg values, push whether they are all equal
+    Op_Not, // pop arg values, push whether all are 0
+  };
+
+  // One instruction of a requirement program; see RequirementEvaluator.
+  struct RequirementOp {
+    RequirementOpCode code;
+    uint8_t reserved[3];
+    uint32_t arg;
+  };
+
+  // The units a tech alias such as Alias_SiegeTank stands for, or a unit that no alias
+  // covers on its own. Classes overlap: a unit is in every class it declares an alias for.
+  struct AliasClass {
+    String name;
+    Range unitNames; // Table_StringRefs, by name
+    Range units; // Table_Indices, the UnitTypeIds of unitNames
+    Range unitSet; // Table_UnitSets; bit id % 64 of word id / 64 is set for every UnitTypeId in units
+  };
+
+  struct AbilityCommand {
+    String index; // eg. "Train1"
+    uint32_t id; // AbilityId, 0 if unknown
+    uint32_t ability; // Table_Abilities
+    double time;
+    Range requirements; // Table_Indices into Table_Requirements
+    Range units; // Table_StringRefs
+  };
+
+  enum AbilityType : uint8_t {
+    Ability_Train,
+    Ability_Morph,
+    Ability_Build,
+    Ability_Merge,
+    Ability_Research,
+    Ability_MorphPlacement,
+  };
+
+  struct Ability {
+    String name;
+    String morphUnit;
+    Range commands; // Table_AbilityCommands
+    AbilityType type;
+    uint8_t reserved[7];
+  };
+
+  struct UpgradeEffect {
+    String operation;
+    String referenceType;
+    String referenceId;
+    String referenceAttribute;
+    String value;
+  };
+
+  struct Upgrade {
+    String name;
+    uint32_t id; // UpgradeId, 0 if unknown
+    Race race;
+    uint8_t reserved[3];
+    Range effects; // Table_UpgradeEffects
+  };
+
+  enum TechItemFlags : uint8_t {
+    Tech_Interruptible = 1 << 0,
+    Tech_FinishKillsWorker = 1 << 1,
+    Tech_FinishKillsSource = 1 << 2,
+    Tech_CancelKillsSource = 1 << 3,
+  };
+
+  // Something a unit can build, morph into, merge into or research.
+  struct TechItem {
+    uint32_t target; // UnitTypeId, or UpgradeId for researches
+    uint32_t ability; // AbilityId
+    String targetName;
+    String abilityName; // "Ability,Command"
+    int32_t unitCount; // 0 for researches
+    uint8_t flags; // TechItemFlags
+    uint8_t reserved[3];
+    Range requirements; // Table_Indices into Table_Requirements
+    double time;
+    int64_t minerals; // researches only
+    int64_t vespene; // researches only
+  };
+
+  struct TechEntry {
+    uint32_t unit; // UnitTypeId
+    Race race;
+    uint8_t reserved[3];
+    String name;
+    Range builds; // Table_TechItems
+    Range morphs; // Table_TechItems
+    Range merges; // Table_TechItems
+    Range researches; // Table_TechItems
+  };
+
+  // A weapon of a unit, one row of the damage matrix.
+  struct Attack {
+    uint32_t unit; // Table_Units
+    uint32_t weapon; // Table_Weapons
+  };
+
+  // What an Attack does to one target unit, all zero when its filters rule the target out
+  // or it deals no damage. A hit is everything the weapon's effect sets off once: the
+  // impacts, set and persistent effects, with attribute bonuses and, against life, the
+  // target's armor applied. hitsToKill spends shields before life, and splash is left
+  // out: this is the unit the weapon is fired at.
+  //
+  // The numbers are for units without upgrades. Shield armor, which only upgrades raise
+  // above zero, is not applied, and neither are weapon or armor upgrades, so against an
+  // upgraded target both per-hit values are too high and hitsToKill too low.
+  struct Damage {
+    float lifePerHit;
+    float shieldsPerHit;
+    float lifeDps;
+    float shieldsDps;
+    uint32_t hitsToKill;
+  };
+
+  static_assert( sizeof( Header ) == 16 + 16 * Table_Count, "unexpected Header layout" );
+  static_assert( sizeof( Footprint ) == 56, "unexpected Footprint layout" );
+  static_assert( sizeof( Unit ) == 320, "unexpected Unit layout" );
+  static_assert( sizeof( Effect ) == 88, "unexpected Effect layout" );
+  static_assert( sizeof( Weapon ) == 104, "unexpected Weapon layout" );
+  static_assert( sizeof( Requirement ) == 64, "unexpected Requirement layout" );
+  static_assert( sizeof( AbilityCommand ) == 40, "unexpected AbilityCommand layout" );
+  static_assert( sizeof( Ability ) == 32, "unexpected Ability layout" );
+  static_assert( sizeof( Upgrade ) == 24, "unexpected Upgrade layout" );
+  static_assert( sizeof( TechItem ) == 64, "unexpected TechItem layout" );
+  static_assert( sizeof( TechEntry ) == 48, "unexpected TechEntry layout" );
+  static_assert( sizeof( AliasClass ) == 32, "unexpected AliasClass layout" );
+  static_assert( sizeof( RequirementOp ) == 8, "unexpected RequirementOp layout" );
+  static_assert( sizeof( Damage ) == 20, "unexpected Damage layout" );
+
+  // The records of one table, or of a Range in it.
+  template <class T>
+  class Span
+  {
+  public:
+    Span():
+        data_( nullptr ), size_( 0 ) {}
+    Span( const T* data, uint32_t size ):
+        data_( data ), size_( size ) {}
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    uint32_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& operator[]( uint32_t i ) const { return data_[i]; }
+
+  private:
+    const T* data_;
+    uint32_t size_;
+  };
+
+  // Read-only view of a gamedata.db image that somebody else keeps in memory. The header
+  // and the id tables are checked once here, so the lookups by id need no more than a
+  // bounds check and an index; records, ranges and strings are used as they are.
+  class Database
+  {
+  public:
+    Database( const void* data, size_t size ):
+        base_( static_cast<const char*>( data ) )
+    {
+      static const uint32_t recordSizes[Table_Count] = {
+          sizeof( char ), sizeof( String ), sizeof( uint32_t ), sizeof( double ), sizeof( Point ),
+          sizeof( Polygon ), sizeof( Footprint ), sizeof( Ref ), sizeof( Unit ), sizeof( AttributeBonus ),
+          sizeof( SplashArea ), sizeof( Effect ), sizeof( Weapon ), sizeof( Requirement ), sizeof( AbilityCommand ),
+          sizeof( Ability ), sizeof( UpgradeEffect ), sizeof( Upgrade ), sizeof( TechItem ), sizeof( TechEntry ),
+          sizeof( uint32_t ), sizeof( uint32_t ), sizeof( uint32_t ), sizeof( AliasClass ), sizeof( uint64_t ),
+          sizeof( RequirementOp ), sizeof( Attack ), sizeof( Damage ),
+      };
+
+      if ( !base_ || size < sizeof( Header ) || ( reinterpret_cast<uintptr_t>( base_ ) & 7 ) != 0 )
+        throw std::runtime_error( "gamedata.db: truncated or misaligned" );
+      header_ = reinterpret_cast<const Header*>( base_ );
+      if ( header_->magic != dbMagic || header_->version != dbVersion || header_->tableCount != Table_Count )
+        throw std::runtime_error( "gamedata.db: unsupported format" );
+      for ( uint32_t i = 0; i < Table_Count; i++ )
+      {
+        auto& info = header_->tables[i];
+        if ( info.recordSize != recordSizes[i] || ( info.offset & 7 ) != 0 || info.offset > size ||
+             ( size - info.offset ) / info.recordSize < info.count )
+          throw std::runtime_error( "gamedata.db: bad table directory" );
+      }
+
+      units_ = table<Unit>( Table_Units );
+      commands_ = table<AbilityCommand>( Table_AbilityCommands );
+      upgrades_ = table<Upgrade>( Table_Upgrades );
+      unitIds_ = idTable( Table_UnitIds, units_.size() );
+      abilityIds_ = idTable( Table_AbilityIds, commands_.size() );
+      upgradeIds_ = idTable( Table_UpgradeIds, upgrades_.size() );
+
+      attacks_ = table<Attack>( Table_Attacks );
+      damage_ = table<Damage>( Table_Damage );
+      if ( damage_.size() != static_cast<uint64_t>( attacks_.size() ) * units_.size() )
+        throw std::runtime_error( "gamedata.db: bad damage matrix" );
+      for ( auto& attack : attacks_ )
+        if ( attack.unit >= units_.size() || attack.weapon >= table<Weapon>( Table_Weapons ).size() )
+          throw std::runtime_error( "gamedata.db: bad damage matrix" );
+
+      // so that following effect links always ends
+      auto effects = table<Effect>( Table_Effects );
+      auto indices = table<uint32_t>( Table_Indices );
+      for ( uint32_t e = 0; e < effects.size(); e++ )
+      {
+        auto& fx = effects[e];
+        bool ok = ( fx.impact == none || fx.impact < e ) && fx.children.first <= indices.size() && indices.size() - fx.children.first >= fx.children.count;
+        for ( uint32_t c = 0; ok && c < fx.children.count; c++ )
+          ok = ( indices[fx.children.first + c] < e );
+        if ( !ok )
+          throw std::runtime_error( "gamedata.db: bad effect links" );
+      }
+    }
+
+    template <class T>
+    Span<T> table( TableId id ) const
+    {
+      auto& info = header_->tables[id];
+      return Span<T>( reinterpret_cast<const T*>( base_ + info.offset ), info.count );
+    }
+
+    // the records a Range refers to; it is up to the caller to name the table the Range is documented with
+    template <class T>
+    Span<T> range( TableId id, Range r ) const
+    {
+      return Span<T>( table<T>( id ).begin() + r.first, r.count );
+    }
+
+    // NUL-terminated
+    const char* text( String s ) const
+    {
+      return base_ + header_->tables[Table_Strings].offset + s.offset;
+    }
+
+    // nullptr for ids the file has no record of
+    const Unit* unit( uint32_t id ) const { return lookup( unitIds_, units_, id ); }
+    const AbilityCommand* abilityCommand( uint32_t id ) const { return lookup( abilityIds_, commands_, id ); }
+    const Upgrade* upgrade( uint32_t id ) const { return lookup( upgradeIds_, upgrades_, id ); }
+
+    const Ability& ability( const AbilityCommand& cmd ) const
+    {
+      return table<Ability>( Table_Abilities )[cmd.ability];
+    }
+
+    // nullptr unless req is a Requirement_UnitCount
+    const AliasClass* aliasClass( const Requirement& req ) const
+    {
+      auto classes = table<AliasClass>( Table_AliasClasses );
+      return ( req.type == Requirement_UnitCount && req.aliasClass < classes.size() ? &classes[req.aliasClass] : nullptr );
+    }
+
+    // Every class has a bitset of the same width, so the units one has can be counted
+    // against a class by ANDing a bitset of their ids with this, a word at a time.
+    Span<uint64_t> unitSet( const AliasClass& cls ) const
+    {
+      return range<uint64_t>( Table_UnitSets, cls.unitSet );
+    }
+
+    static bool contains( Span<uint64_t> set, uint32_t id )
+    {
+      return id / 64 < set.size() && ( set[id / 64] >> ( id % 64 ) & 1 ) != 0;
+    }
+
+    // The damage matrix: a row per Attack with a column per record of units(), so that
+    // damage( a, t ) is attacks()[a] against units()[t].
+    Span<Attack> attacks() const { return attacks_; }
+    Span<Damage> damageRow( uint32_t attack ) const { return Span<Damage>( damage_.begin() + static_cast<size_t>( attack ) * units_.size(), units_.size() ); }
+    const Damage& damage( uint32_t attack, uint32_t target ) const { return damageRow( attack )[target]; }
+
+    Span<Unit> units() const { return units_; }
+    Span<Upgrade> upgrades() const { return upgrades_; }
+
+  private:
+    Span<uint32_t> idTable( TableId id, uint32_t recordCount ) const
+    {
+      auto ids = table<uint32_t>( id );
+      for ( auto index : ids )
+        if ( index != none && index >= recordCount )
+          throw std::runtime_error( "gamedata.db: bad id table" );
+      return ids;
+    }
+
+    template <class T>
+    static const T* lookup( Span<uint32_t> ids, Span<T> records, uint32_t id )
+    {
+      if ( id >= ids.size() || ids[id] == none )
+        return nullptr;
+      return records.begin() + ids[id];
+    }
+
+    const char* base_;
+    const Header* header_;
+    Span<Unit> units_;
+    Span<AbilityCommand> commands_;
+    Span<Upgrade> upgrades_;
+    Span<uint32_t> unitIds_;
+    Span<uint32_t> abilityIds_;
+    Span<uint32_t> upgradeIds_;
+    Span<Attack> attacks_;
+    Span<Damage> damage_;
+  };
+
+  namespace detail {
+
+    // Keeps a whole file mapped for as long as it lives.
+    class FileMapping
+    {
+    public:
+      explicit FileMapping( const std::string& path ):
+          data_( nullptr ), size_( 0 )
+      {
+#if defined( _WIN32 )
+        mapping_ = NULL;
+        file_ = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        LARGE_INTEGER size;
+        if ( file_ != INVALID_HANDLE_VALUE && GetFileSizeEx( file_, &size ) && size.QuadPart > 0 )
+        {
+          size_ = static_cast<size_t>( size.QuadPart );
+          mapping_ = CreateFileMappingA( file_, NULL, PAGE_READONLY, 0, 0, NULL );
+          if ( mapping_ )
+            data_ = MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 );
+        }
+#else
+        fd_ = open( path.c_str(), O_RDONLY );
+        struct stat st;
+        if ( fd_ >= 0 && fstat( fd_, &st ) == 0 && st.st_size > 0 )
+        {
+          size_ = static_cast<size_t>( st.st_size );
+          void* mapped = mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+          if ( mapped != MAP_FAILED )
+            data_ = mapped;
+        }
+#endif
+        if ( !data_ )
+        {
+          close();
+          throw std::runtime_error( "could not map " + path );
+        }
+      }
+
+      ~FileMapping()
+      {
+        close();
+      }
+
+      const void* data() const { return data_; }
+      size_t size() const { return size_; }
+
+    private:
+      FileMapping( const FileMapping& ) = delete;
+      FileMapping& operator=( const FileMapping& ) = delete;
+
+      void close()
+      {
+#if defined( _WIN32 )
+        if ( data_ )
+          UnmapViewOfFile( data_ );
+        if ( mapping_ )
+          CloseHandle( mapping_ );
+        if ( file_ != INVALID_HANDLE_VALUE )
+          CloseHandle( file_ );
+        mapping_ = NULL;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if ( data_ )
+          munmap( data_, size_ );
+        if ( fd_ >= 0 )
+          ::close( fd_ );
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+      }
+
+#if defined( _WIN32 )
+      HANDLE file_;
+      HANDLE mapping_;
+#else
+      int fd_;
+#endif
+      void* data_;
+      size_t size_;
+    };
+
+  }
+
+  // A gamedata.db file mapped read-only, eg. MappedDatabase db( "v4.3.2.65384/gamedata.db" ).
+  class MappedDatabase: private detail::FileMapping, public Database
+  {
+  public:
+    explicit MappedDatabase( const std::string& path ):
+        detail::FileMapping( path ), Database( detail::FileMapping::data(), detail::FileMapping::size() ) {}
+  };
+
+  // What a player has, as bitsets over UnitTypeIds and UpgradeIds.
+  struct TechState {
+    std::vector<uint64_t> units;
+    std::vector<uint64_t> upgrades;
+
+    void addUnit( uint32_t id ) { set( units, id ); }
+    void addUpgrade( uint32_t id ) { set( upgrades, id ); }
+
+  private:
+    static void set( std::vector<uint64_t>& bits, uint32_t id )
+    {
+      if ( id / 64 >= bits.size() )
+        bits.resize( id / 64 + 1, 0 );
+      bits[id / 64] |= uint64_t( 1 ) << ( id % 64 );
+    }
+  };
+
+  // Evaluates every requirement of a database against a TechState at once. First each
+  // alias class is checked against the units by ANDing the two bitsets a word at a time,
+  // then the programs in Table_RequirementCode, which are laid out in the order of
+  // Table_Requirements, run front to back on one small stack. Unit and upgrade counts are
+  // 1 when the player has any and 0 otherwise, which is all the tech requirements ask.
+  // The programs are checked once here, so evaluate() trusts them.
+  class RequirementEvaluator
+  {
+  public:
+    explicit RequirementEvaluator( const Database& db ):
+        db_( db ), requirements_( db.table<Requirement>( Table_Requirements ) ), code_( db.table<RequirementOp>( Table_RequirementCode ) ),
+        classes_( db.table<AliasClass>( Table_AliasClasses ) )
+    {
+      size_t depth = 0;
+      for ( auto& req : requirements_ )
+      {
+        if ( req.program.first > code_.size() || code_.size() - req.program.first < req.program.count )
+          throw std::runtime_error( "gamedata.db: bad requirement program" );
+        size_t stack = 0;
+        for ( auto& op : db_.range<RequirementOp>( Table_RequirementCode, req.program ) )
+        {
+          if ( op.code > Op_Not || ( op.code == Op_UnitCount && op.arg >= classes_.size() ) || ( op.code >= Op_And && op.arg > stack ) )
+            throw std::runtime_error( "gamedata.db: bad requirement program" );
+          stack = ( op.code >= Op_And ? stack - op.arg : stack ) + 1;
+          depth = ( stack > depth ? stack : depth );
+        }
+        if ( stack != 1 )
+          throw std::runtime_error( "gamedata.db: bad requirement program" );
+      }
+      stack_.resize( depth );
+      classHas_.resize( classes_.size() );
+      results_.resize( requirements_.size() );
+    }
+
+    // one byte per record of Table_Requirements, 1 where the requirement holds
+    const std::vector<uint8_t>& evaluate( const TechState& state )
+    {
+      for ( uint32_t i = 0; i < classes_.size(); i++ )
+      {
+        auto set = db_.unitSet( classes_[i] );
+        size_t words = ( set.size() < state.units.size() ? set.size() : state.units.size() );
+        uint64_t any = 0;
+        for ( size_t w = 0; w < words; w++ )
+          any |= set[static_cast<uint32_t>( w )] & state.units[w];
+        classHas_[i] = ( any != 0 );
+      }
+
+      int32_t* stack = stack_.data();
+      for ( uint32_t r = 0; r < requirements_.size(); r++ )
+      {
+        size_t top = 0;
+        for ( auto& op : db_.range<RequirementOp>( Table_RequirementCode, requirements_[r].program ) )
+        {
+          if ( op.code >= Op_And )
+            top -= op.arg; // the operands, read below from where the result goes
+          const int32_t* args = stack + top;
+          int32_t result = 1;
+          switch ( op.code )
+          {
+            case Op_Value:
+              result = static_cast<int32_t>( op.arg );
+              break;
+            case Op_UnitCount:
+              result = classHas_[op.arg];
+              break;
+            case Op_UpgradeCount:
+              result = ( op.arg / 64 < state.upgrades.size() && ( state.upgrades[op.arg / 64] >> ( op.arg % 64 ) & 1 ) != 0 );
+              break;
+            case Op_And:
+              for ( uint32_t i = 0; i < op.arg; i++ )
+                result &= ( args[i] != 0 );
+              break;
+            case Op_Or:
+              result = 0;
+              for ( uint32_t i = 0; i < op.arg; i++ )
+                result |= ( args[i] != 0 );
+              break;
+            case Op_Eq:
+              for ( uint32_t i = 1; i < op.arg; i++ )
+                result &= ( args[i] == args[0] );
+              break;
+            case Op_Not:
+              for ( uint32_t i = 0; i < op.arg; i++ )
+                result &= ( args[i] == 0 );
+              break;
+          }
+          stack[top++] = result;
+        }
+        results_[r] = ( stack[0] != 0 );
+      }
+      return results_;
+    }
+
+    // whether all the requirement trees of a Range such as TechItem::requirements or
+    // AbilityCommand::requirements hold, as of the last evaluate()
+    bool allowed( Range requirements ) const
+    {
+      for ( auto index : db_.range<uint32_t>( Table_Indices, requirements ) )
+        if ( !results_[index] )
+          return false;
+      return true;
+    }
+
+  private:
+    const Database& db_;
+    Span<Requirement> requirements_;
+    Span<RequirementOp> code_;
+    Span<AliasClass> classes_;
+    std::vector<int32_t> stack_;
+    std::vector<uint8_t> classHas_;
+    std::vector<uint8_t> results_;
+  };
+
+  // The dataset directories of this repository, oldest first.
+  const char* const datasets[] = {
+      "v3.19.1.58600",
+      "v4.1.2.60604",
+      "v4.1.3.61021",
+      "v4.1.4.61545",
+      "v4.2.4.64128",
+      "v4.3.0.64469",
+      "v4.3.1.65094",
+      "v4.3.2.65384",
+  };
+
+  // The game build a dataset directory such as "v4.3.2.65384" was exported from, 0 if the name has none.
+  inline uint32_t datasetBuild( const std::string& name )
+  {
+    auto dot = name.rfind( '.' );
+    if ( dot == std::string::npos )
+      return 0;
+    return static_cast<uint32_t>( strtoul( name.c_str() + dot + 1, nullptr, 10 ) );
+  }
+
+  // The dataset to use with a game build: the newest one exported from that build or an
+  // older one, or the oldest of all for a build that predates them. Empty if names is.
+  inline std::string selectDataset( const std::vector<std::string>& names, uint32_t build )
+  {
+    std::string best;
+    std::string oldest;
+    for ( auto& name : names )
+    {
+      auto nameBuild = datasetBuild( name );
+      if ( nameBuild <= build && ( best.empty() || nameBuild > datasetBuild( best ) ) )
+        best = name;
+      if ( oldest.empty() || nameBuild < datasetBuild( oldest ) )
+        oldest = name;
+    }
+    return best.empty() ? oldest : best;
+  }
+
+  inline std::string selectDataset( uint32_t build )
+  {
+    return selectDataset( std::vector<std::string>( std::begin( datasets ), std::end( datasets ) ), build );
+  }
+
+}